@@ -1,19 +1,21 @@
 #include <picogl/framework/application.h>
 #include <picogl/framework/renderers.h>
+#include <picogl/framework/culling.h>
 #include <picogl/framework/asset_io.h>
 #include <picogl/framework/viewport.h>
 #include <picogl/framework/image.h>
+#include <picogl/framework/program_cache.h>
 
 #include <spdlog/spdlog.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 
 #define PICOGL_IMPLEMENTATION
 #include <picogl/picogl.hpp>
 
 #include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <vector>
 
@@ -60,43 +62,42 @@ void gui_choice(GLenum& value, const std::string& name, const std::unordered_map
 
 struct Window
 {
+	Window(const std::string& scope) : m_scope{ scope } {}
+
 	virtual void render_body(framework::RendererCollection& renderers) = 0;
 
 	void render(framework::RendererCollection& renderers)
 	{
-		if (m_query)
-		{
-			GLint value = 0;
-			m_query.get(value, GL_QUERY_RESULT_NO_WAIT);
-			if (value) {
-				m_current = (m_current + 1) % ValuesCount;
-				m_values[m_current] = value * 1e-6f;
-			}
-		} else {
-			m_query = picogl::Query::make(GL_TIME_ELAPSED);
-		}
-
-		m_query.begin();
+		PICOGL_GPU_SCOPE(m_scope);
 		render_body(renderers);
-		m_query.end();
 	}
 
 	void perf_gui()
 	{
-		if (ImGui::TreeNode("Perfs")) {
-			std::array<float, ValuesCount> values;
-			for (std::size_t i = 0; i < ValuesCount; ++i)
-				values[i] = m_values[(m_current + i) % ValuesCount];
-			ImGui::PlotLines("Render time", values.data(), ValuesCount, 0,
-				fmt::format("{:1.1f}", m_values[(m_current - 1) % ValuesCount]).c_str(), 0.0f, 5.0f, ImVec2(250.0f, 50.0f));
-			ImGui::TreePop();
+		const picogl::GpuProfiler* profiler = picogl::GpuProfiler::get_current();
+		if (!profiler || !ImGui::TreeNode("Perfs"))
+			return;
+
+		if (const picogl::GpuProfiler::ScopeStats* stats = profiler->find_scope(m_scope)) {
+			const std::vector<float>& history = stats->m_history_ms;
+			std::vector<float> values(history.size());
+			for (std::size_t i = 0; i < history.size(); ++i)
+				values[i] = history[(stats->m_next + i) % history.size()];
+			ImGui::PlotLines("Render time", values.data(), int(values.size()), 0,
+				fmt::format("{:1.1f}", stats->m_last_ms).c_str(), 0.0f, 5.0f, ImVec2(250.0f, 50.0f));
 		}
+
+		// The window scope and the ones nested in it.
+		for (const picogl::GpuProfiler::ScopeStats& stats : profiler->get_scopes()) {
+			if (stats.m_name.compare(0, m_scope.size(), m_scope) != 0 || (stats.m_name.size() > m_scope.size() && stats.m_name[m_scope.size()] != '/'))
+				continue;
+			ImGui::Text(fmt::format("{}{}: avg {:1.2f} ms, min {:1.2f}, p95 {:1.2f}",
+				std::string(2 * stats.m_depth, ' '), stats.m_name.substr(stats.m_name.rfind('/') + 1), stats.m_avg_ms, stats.m_min_ms, stats.m_p95_ms).c_str());
+		}
+		ImGui::TreePop();
 	}
 
-	static constexpr std::size_t ValuesCount = 128;
-	std::array<float, ValuesCount> m_values = {};
-	std::size_t m_current = 0;
-	picogl::Query m_query;
+	std::string m_scope;
 };
 
 struct TexWindow : Window, framework::Viewport2D
@@ -115,13 +116,14 @@ struct TexWindow : Window, framework::Viewport2D
 		picogl::Texture m_tex;
 	};
 
-	TexWindow() : framework::Viewport2D("Texture Viewer")
+	TexWindow() : Window("texture_viewer"), framework::Viewport2D("Texture Viewer")
 	{
 	}
 
 	void setup()
 	{
 		m_modes[Mode::Kitten].m_tex = framework::make_texture_from_file("../example/resources/kitten.png");
+		m_upload_pool = picogl::UploadPool::make();
 	}
 
 	void settings_gui()
@@ -214,9 +216,25 @@ struct TexWindow : Window, framework::Viewport2D
 			const glm::ivec2 tex_pos =
 				glm::ivec2(glm::round(m_vp_size * (mouse_pos - image_topleft) / image_size)) - glm::ivec2(readback_radius);
 
-			std::fill(m_readback_img.m_pixels.begin(), m_readback_img.m_pixels.end(), std::byte{ 0 });
-			final_framebuffer().readback(m_readback_img.m_pixels.data(), tex_pos.x, tex_pos.y, readback_size, readback_size);
-			m_readback_tex.upload_data(m_readback_img.m_pixels.data());
+			// The closeup lags one or two frames behind but never stalls the pipeline.
+			// Only the part inside the framebuffer is read back, the rest of the closeup stays black.
+			if (m_readback && m_readback.ready()) {
+				std::fill(m_readback_img.m_pixels.begin(), m_readback_img.m_pixels.end(), std::byte{ 0 });
+				const std::size_t row_size = std::size_t(m_readback.width()) * sizeof(glm::u8vec4);
+				const std::byte* src = static_cast<const std::byte*>(m_readback.map());
+				for (GLsizei y = 0; y < m_readback.height(); ++y)
+					std::memcpy(&m_readback_img.at<glm::u8vec4>(m_readback_offset.x, m_readback_offset.y + y), src + y * row_size, row_size);
+				m_readback_tex.upload_data(m_readback_img.m_pixels.data());
+				m_readback = {};
+			}
+
+			const picogl::Framebuffer& framebuffer = final_framebuffer();
+			const glm::ivec2 read_min = glm::max(tex_pos, glm::ivec2(0));
+			const glm::ivec2 read_max = glm::min(tex_pos + glm::ivec2(readback_size), glm::ivec2(framebuffer.width(), framebuffer.height()));
+			if (!m_readback && glm::all(glm::lessThan(read_min, read_max))) {
+				m_readback_offset = read_min - tex_pos;
+				m_readback = framebuffer.readback_async(read_min.x, read_min.y, read_max.x - read_min.x, read_max.y - read_min.y);
+			}
 
 			ImGui::BeginTooltip();
 			ImGui::Image(reinterpret_cast<ImTextureID>(static_cast<std::size_t>(m_readback_tex)), { 150, 150 });
@@ -230,10 +248,27 @@ struct TexWindow : Window, framework::Viewport2D
 
 		if (m_color_changed)
 		{
-			m_modes[Mode::Checkers].m_tex = framework::make_texture_from_image(m_checkers, GL_RGBA32F);
-
-			framework::Image perlin = (m_perlin * m_color_A).add<glm::vec4>((glm::vec4(1) - m_perlin) * m_color_B);
-			m_modes[Mode::Perlin].m_tex = framework::make_texture_from_image(perlin, GL_RGBA32F);
+			// Textures are created once, later color changes are streamed through the upload pool.
+			picogl::Texture& checkers = m_modes[Mode::Checkers].m_tex;
+			if (!checkers)
+				checkers = framework::make_texture_from_image(m_checkers, GL_RGBA32F);
+			else
+				framework::update_texture_from_image(checkers, m_checkers, m_upload_pool);
+
+			// Colors are blended straight into the staging memory, without an intermediate image.
+			picogl::Texture& perlin_tex = m_modes[Mode::Perlin].m_tex;
+			if (!perlin_tex) {
+				framework::Image perlin = (m_perlin * m_color_A).add<glm::vec4>((glm::vec4(1) - m_perlin) * m_color_B);
+				perlin_tex = framework::make_texture_from_image(perlin, GL_RGBA32F);
+			} else {
+				framework::update_texture_from_rows(perlin_tex, m_upload_pool, [&](const std::uint32_t y, std::byte* row) {
+					for (std::uint32_t x = 0; x < m_perlin.m_width; ++x) {
+						const glm::vec4 t = m_perlin.at<glm::vec4>(x, y);
+						const glm::vec4 color = t * m_color_A + (glm::vec4(1) - t) * m_color_B;
+						std::memcpy(row + x * sizeof(glm::vec4), &color, sizeof(glm::vec4));
+					}
+					});
+			}
 
 			m_color_changed = false;
 		}
@@ -244,6 +279,16 @@ struct TexWindow : Window, framework::Viewport2D
 		return m_modes[m_mode].m_tex;
 	}
 
+	const picogl::Sampler& get_sampler()
+	{
+		picogl::Sampler::Parameters sampling;
+		sampling.m_mag_filter = m_tex_mag_filter;
+		sampling.m_min_filter = m_tex_min_filter;
+		sampling.m_wrapping = { m_tex_wrap, m_tex_wrap, m_tex_wrap };
+		sampling.m_border_color = m_border_color;
+		return m_samplers.get(sampling);
+	}
+
 	void render_body(framework::RendererCollection& renderers) override
 	{
 		if (!m_framebuffer)
@@ -256,13 +301,10 @@ struct TexWindow : Window, framework::Viewport2D
 		picogl::Texture& tex = get_texture();
 		if (m_framebuffer && tex)
 		{
-			tex.set_filtering(m_tex_mag_filter, m_tex_min_filter);
-			tex.set_wrapping(m_tex_wrap, m_tex_wrap);
 			tex.set_swizzling(m_swizzle);
-			tex.set_border_color(m_border_color);
 
-			glDisable(GL_DEPTH_TEST);
-			renderers.m_texture.render(m_modes[m_mode].m_tex, m_screen_to_uv, m_force_lod ? m_lod : -1.0f);
+			picogl::set_enabled(GL_DEPTH_TEST, false);
+			renderers.m_texture.render(m_modes[m_mode].m_tex, m_screen_to_uv, m_force_lod ? m_lod : -1.0f, &get_sampler());
 		}
 	}
 
@@ -278,14 +320,18 @@ struct TexWindow : Window, framework::Viewport2D
 
 	std::array<int, 4> m_swizzle = { GL_RED , GL_GREEN, GL_BLUE, GL_ALPHA };
 	std::array<float, 4> m_border_color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	picogl::SamplerCache m_samplers;
 
 	glm::vec4 m_color_A = glm::vec4(0, 0, 0, 1);
 	glm::vec4 m_color_B = glm::vec4(1);
 	bool m_color_changed = true;
+	picogl::UploadPool m_upload_pool;
 
 	framework::Image m_checkers = framework::make_checkers(50, 50, 5);
 	framework::Image m_perlin = framework::make_perlin(150, 150, 5);
 	framework::Image m_readback_img;
+	picogl::Framebuffer::Readback m_readback;
+	glm::ivec2 m_readback_offset = {};
 	picogl::Texture m_readback_tex;
 
 	std::unordered_map<Mode, ModeData> m_modes = {
@@ -312,9 +358,10 @@ struct ModelerWindow : Window, framework::Viewport3D
 
 	struct Mesh
 	{
-		picogl::Mesh m_gl_mesh = {};
+		picogl::MeshPool::Handle m_handle = {};
 		framework::AABB m_aabb = {};
 		glm::mat4 m_self_transform = {};
+		glm::mat4 m_dequantization = glm::mat4(1);
 	};
 
 	struct Instance
@@ -331,40 +378,48 @@ struct ModelerWindow : Window, framework::Viewport3D
 		bool m_selected = true;
 	};
 
-	static Mesh make_mesh(framework::Mesh& mesh)
+	static Mesh make_mesh(const framework::Mesh& mesh, picogl::MeshPool& pool)
 	{
 		Mesh dst;
 		dst.m_aabb = mesh.m_aabb;
-		dst.m_gl_mesh = std::move(mesh.m_mesh);
+		dst.m_dequantization = mesh.m_dequantization;
+		dst.m_handle = pool.add(mesh.m_mesh);
 		const glm::vec3 extent = dst.m_aabb.diagonal();
 		const float max_extent = glm::max(glm::max(extent.x, extent.y), extent.z);
 		dst.m_self_transform = glm::inverse(glm::translate(dst.m_aabb.center()) * glm::scale(glm::vec3(max_extent)));
 		return dst;
 	}
 
-	static Mesh make_mesh_from_file(const std::string& path)
+	static Mesh make_mesh_from_file(const std::string& path, picogl::MeshPool& pool)
 	{
-		auto meshes = framework::make_mesh_from_obj(path);
-		return make_mesh(meshes.front());
+		auto meshes = framework::make_mesh_from_obj(path, framework::VertexFormat::Quantized, { 0.5f, 0.25f, 0.125f });
+		return make_mesh(meshes.front(), pool);
 	}
 
-	ModelerWindow() : framework::Viewport3D("Modeler", { GL_RGB32I })
+	ModelerWindow() : Window("modeler"), framework::Viewport3D("Modeler", { GL_RGB32I })
 	{
 	}
 
 	void update_instances()
 	{
+		PICOGL_TRACE_SCOPE("update_instances");
 		m_instances_flatten.clear();
 
-		const GLsizei object_count = m_combined_mesh.get_submeshes_count();
-		m_instances_offset.resize(object_count, 0);
-
-		std::size_t size = m_instances.empty() ? 0 : m_instances[0].size();
-		for (std::size_t i = 1; i < object_count; ++i) {
-			m_instances_offset[i] = m_instances_offset[i - 1] + m_instances_count[i - 1];
-			size += m_instances[i].size();
+		// Each object has one draw per submesh, all of them drawing the object instances.
+		m_instances_offset.assign(m_mesh_pool.get_draw_count(), 0);
+		std::size_t size = 0;
+		std::size_t bound_count = 0;
+		for (std::size_t object_id = 0; object_id < m_meshes.size(); ++object_id) {
+			const picogl::MeshPool::Handle handle = m_meshes[object_id].m_handle;
+			const GLsizei first_draw = m_mesh_pool.get_first_draw(handle);
+			for (GLsizei submesh = 0; submesh < m_mesh_pool.get_submeshes_count(handle); ++submesh)
+				m_instances_offset[first_draw + submesh] = GLint(size);
+			size += m_instances[object_id].size();
+			bound_count += m_instances[object_id].size() * m_mesh_pool.get_submeshes_count(handle);
 		}
 		m_instances_flatten.reserve(size);
+		m_instance_bounds.clear();
+		m_instance_bounds.reserve(bound_count);
 
 		GLint object_id = 0;
 		for (const auto& instances : m_instances) {
@@ -375,28 +430,47 @@ struct ModelerWindow : Window, framework::Viewport3D
 					InstanceData o;
 					o.m_object_id = object_id;
 					o.m_instance_id = instance_id;
-					o.m_object_to_world = instance.m_transform * m_meshes[object_id].m_self_transform;
-					o.m_normal_to_world = glm::mat3(glm::transpose(glm::inverse(o.m_object_to_world)));
+					// Normals are not quantized, the dequantization only applies to positions.
+					const glm::mat4 object_to_world = instance.m_transform * m_meshes[object_id].m_self_transform;
+					o.m_object_to_world = object_to_world * m_meshes[object_id].m_dequantization;
+					o.m_normal_to_world = glm::mat3(glm::transpose(glm::inverse(object_to_world)));
 					o.m_rendering_mode = instance.m_rendering_mode;
+
+					// One bound per submesh draw, the culler fills each draw with the instances it keeps.
+					const framework::AABB aabb = m_meshes[object_id].m_aabb.transform(glm::mat4x3(object_to_world));
+					const picogl::MeshPool::Handle handle = m_meshes[object_id].m_handle;
+					const GLsizei first_draw = m_mesh_pool.get_first_draw(handle);
+					framework::InstanceBounds bounds;
+					bounds.m_min = aabb.m_min;
+					bounds.m_max = aabb.m_max;
+					bounds.m_instance_id = GLuint(m_instances_offset[first_draw] + instance_id);
+					for (GLsizei submesh = 0; submesh < m_mesh_pool.get_submeshes_count(handle); ++submesh) {
+						bounds.m_draw_id = GLuint(first_draw + submesh);
+						m_instance_bounds.push_back(bounds);
+					}
 					++instance_id;
 					return o;
 				});
 			++object_id;
 		}
 
-		m_instance_ssbo = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, m_instances_flatten);
+		const GLsizeiptr instances_size = GLsizeiptr(m_instances_flatten.size() * sizeof(InstanceData));
+		if (m_instance_stream.frame_size() < instances_size)
+			m_instance_stream = picogl::StreamBuffer::make(2 * instances_size);
 		m_instance_offset_ssbo = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, m_instances_offset);
+		m_culler.set_instances(m_mesh_pool, m_instance_bounds);
 	}
 
 	void set_instances()
 	{
-		const GLsizei object_count = m_combined_mesh.get_submeshes_count();
+		const GLsizei object_count = GLsizei(m_meshes.size());
 		const int old_count = m_instances.empty() ? 0 : (int)m_instances[0].size();
 		for (int object_id = 0; object_id < object_count; ++object_id) {
 			if (m_instance_count == old_count)
 				continue;
 
-			m_instances_count[object_id] = m_instance_count;
+			const picogl::MeshPool::Handle handle = m_meshes[object_id].m_handle;
+			m_mesh_pool.set_instances_count(handle, std::vector<GLuint>(m_mesh_pool.get_submeshes_count(handle), GLuint(m_instance_count)));
 			m_instances[object_id].resize(m_instance_count);
 			for (int i = old_count; i < m_instance_count; ++i) {
 				Instance& instance = m_instances[object_id][i];
@@ -407,27 +481,29 @@ struct ModelerWindow : Window, framework::Viewport3D
 					m_instances[object_id].front().m_transform;
 			}
 		}
-		m_combined_mesh.set_instances_count(m_instances_count);
 		update_instances();
 	}
 
-	void setup()
+	void setup(framework::ProgramCache& program_cache)
 	{
 		m_camera.m_position = 3.0f * glm::vec3(1);
+		m_culler = framework::InstanceCuller::make(shader_path, program_cache);
+		m_depth_pyramid = framework::DepthPyramid::make(shader_path, program_cache);
+
+		m_mesh_pool = picogl::MeshPool::make();
+		m_meshes.push_back(make_mesh_from_file("../example/resources/apple.obj", m_mesh_pool));
+		m_meshes.push_back(make_mesh_from_file("../example/resources/banana.obj", m_mesh_pool));
+		m_meshes.push_back(make_mesh(framework::make_torus(1.0f, 0.4f, 64u, framework::VertexFormat::Quantized, 4u), m_mesh_pool));
+
+		// Standalone mesh split into meshlets, its clusters are culled on the GPU when enabled.
+		m_cluster_culler = framework::ClusterCuller::make(shader_path, program_cache);
+		m_cluster_mesh = std::move(framework::make_mesh_from_obj("../example/resources/apple.obj", framework::VertexFormat::Float, {}, 64u).front());
+		m_cluster_culler.set_clusters(m_cluster_mesh.m_meshlets);
+		const glm::vec3 extent = m_cluster_mesh.m_aabb.diagonal();
+		const float max_extent = glm::max(glm::max(extent.x, extent.y), extent.z);
+		m_cluster_model = glm::scale(glm::vec3(2.0f / max_extent)) * glm::translate(-m_cluster_mesh.m_aabb.center());
 
-		m_meshes.push_back(make_mesh_from_file("../example/resources/apple.obj"));
-		m_meshes.push_back(make_mesh_from_file("../example/resources/banana.obj"));
-		auto torus = framework::make_torus(1.0f, 0.4f, 32u);
-		m_meshes.push_back(make_mesh(torus));
-
-		m_combined_mesh = picogl::Mesh::combine({
-			m_meshes[0].m_gl_mesh,
-			m_meshes[1].m_gl_mesh,
-			m_meshes[2].m_gl_mesh
-			});
-
-		const GLsizei object_count = m_combined_mesh.get_submeshes_count();
-		m_instances_count.resize(object_count, 1);
+		const GLsizei object_count = GLsizei(m_meshes.size());
 		m_instances.resize(object_count);
 
 		set_instances();
@@ -443,8 +519,18 @@ struct ModelerWindow : Window, framework::Viewport3D
 
 		ImGui::SliderInt("Sample Count", &m_sample_count, 1, max_sample_count);
 
-		if (ImGui::SliderInt("Instance Count", &m_instance_count, 1, 500))
+		if (ImGui::SliderInt("Instance Count", &m_instance_count, 1, 50000))
 			set_instances();
+		ImGui::Checkbox("GPU Culling", &m_gpu_culling);
+		if (m_gpu_culling) {
+			ImGui::Checkbox("Occlusion Culling", &m_occlusion_culling);
+			const framework::InstanceCuller::Stats& stats = m_culler.stats();
+			ImGui::Text("Visible %u, frustum culled %u, occlusion culled %u",
+				stats.m_visible_count, stats.m_frustum_culled_count, stats.m_occlusion_culled_count);
+		}
+		ImGui::Checkbox("Cluster Culling", &m_cluster_culling);
+		if (m_cluster_culling)
+			ImGui::Text("%d clusters", m_cluster_culler.cluster_count());
 
 		static bool all = false;
 		static int mode_all = 0;
@@ -482,7 +568,14 @@ struct ModelerWindow : Window, framework::Viewport3D
 
 		const glm::ivec2 mouse_position = glm::ivec2(ImGui::GetMousePos().x, ImGui::GetMousePos().y) - glm::ivec2(m_vp_position);
 		if (ImGui::IsWindowFocused() && ImGui::IsItemHovered()) {
-			final_framebuffer().readback(&m_hovered_instance, mouse_position.x, mouse_position.y, 1, 1, GL_COLOR_ATTACHMENT1);
+			if (m_picking_readback && m_picking_readback.ready()) {
+				std::memcpy(&m_hovered_instance, m_picking_readback.map(), sizeof(SelectedInstance));
+				m_picking_readback = {};
+			}
+			const picogl::Framebuffer& framebuffer = final_framebuffer();
+			const bool inside = mouse_position.x >= 0 && mouse_position.y >= 0 && mouse_position.x < framebuffer.width() && mouse_position.y < framebuffer.height();
+			if (!m_picking_readback && inside)
+				m_picking_readback = framebuffer.readback_async(mouse_position.x, mouse_position.y, 1, 1, GL_COLOR_ATTACHMENT1);
 			if (m_hovered_instance.m_global_instance_id) {
 				ImGui::BeginTooltip();
 				ImGui::Text(fmt::format("Object {}, Instance {}", m_hovered_instance.m_object_id, m_hovered_instance.m_instance_id).c_str());
@@ -500,18 +593,66 @@ struct ModelerWindow : Window, framework::Viewport3D
 		if (!fb)
 			return;
 
+		m_instance_stream.next_frame();
+		const picogl::StreamBuffer::Range instances = m_instance_stream.upload(m_instances_flatten);
+
 		fb.clear<GLfloat>(GL_DEPTH, { 1.0f });
 		fb.clear<GLfloat>(GL_COLOR, { 0.8f, 0.8f, 0.8f, 1.0f }, 0);
 		fb.clear<GLint>(GL_COLOR, {}, 1);
 
 		glViewport(0, 0, fb.width(), fb.height());
 
-		fb.bind_draw();
-		if (m_texture)
-			m_texture->bind_as_sampler(GL_TEXTURE0);
-		renderers.m_multi_renderer.render(m_camera, m_combined_mesh, m_instance_ssbo, m_instance_offset_ssbo);
+		const auto draw_culled = [&] {
+			PICOGL_GPU_SCOPE("multi_draw");
+			fb.bind_draw();
+			if (m_texture)
+				m_texture->bind_as_sampler(GL_TEXTURE0, m_sampler);
+			renderers.m_culled_multi_renderer.render(m_camera, m_mesh_pool, m_culler, instances);
+		};
+
+		if (m_gpu_culling && m_occlusion_culling) {
+			{
+				PICOGL_GPU_SCOPE("cull");
+				m_culler.cull_early(m_camera);
+			}
+			draw_culled();
+			{
+				PICOGL_GPU_SCOPE("depth_pyramid");
+				m_depth_pyramid.build(resolve_depth());
+			}
+			{
+				PICOGL_GPU_SCOPE("cull");
+				m_culler.cull_late(m_camera, m_depth_pyramid);
+			}
+			draw_culled();
+		} else if (m_gpu_culling) {
+			{
+				PICOGL_GPU_SCOPE("cull");
+				m_culler.cull(m_camera);
+			}
+			draw_culled();
+		} else {
+			// Without culling, each object draws at the finest level its instances need.
+			const std::vector<GLuint> draw_lods = m_culler.select_lods(m_camera, m_mesh_pool, m_instance_bounds);
+			for (const Mesh& mesh : m_meshes) {
+				const GLsizei first_draw = m_mesh_pool.get_first_draw(mesh.m_handle);
+				const auto lods_begin = draw_lods.begin() + first_draw;
+				m_mesh_pool.set_lods(mesh.m_handle, std::vector<GLuint>(lods_begin, lods_begin + m_mesh_pool.get_submeshes_count(mesh.m_handle)));
+			}
+
+			PICOGL_GPU_SCOPE("multi_draw");
+			fb.bind_draw();
+			if (m_texture)
+				m_texture->bind_as_sampler(GL_TEXTURE0, m_sampler);
+			renderers.m_multi_renderer.render(m_camera, m_mesh_pool, instances, m_instance_offset_ssbo);
+		}
 
 		fb.bind_draw(GL_COLOR_ATTACHMENT0);
+		if (m_cluster_culling) {
+			PICOGL_GPU_SCOPE("cluster_culling");
+			m_cluster_culler.cull(m_camera, m_cluster_model, m_cluster_mesh.m_mesh);
+			renderers.m_phong.render(m_camera, m_cluster_mesh.m_mesh, m_cluster_model, m_camera.m_position);
+		}
 		if (m_selected_instance.m_global_instance_id) {
 			const GLuint selected_object = m_selected_instance.m_object_id - 1;
 			const GLuint selected_instance = m_selected_instance.m_instance_id - 1;
@@ -526,16 +667,25 @@ struct ModelerWindow : Window, framework::Viewport3D
 		renderers.m_grid_renderer.render(m_camera);
 	}
 
-	std::vector<GLuint> m_instances_count;
 	std::vector<std::vector<Instance>> m_instances;
 	std::vector<InstanceData> m_instances_flatten;
 	std::vector<GLint> m_instances_offset;
-	picogl::Buffer m_instance_ssbo;
+	picogl::StreamBuffer m_instance_stream;
 	picogl::Buffer m_instance_offset_ssbo;
 
 	std::vector<Mesh> m_meshes;
-	picogl::Mesh m_combined_mesh;
+	picogl::MeshPool m_mesh_pool;
+	std::vector<framework::InstanceBounds> m_instance_bounds;
+	framework::InstanceCuller m_culler;
+	framework::DepthPyramid m_depth_pyramid;
+	bool m_gpu_culling = true;
+	bool m_occlusion_culling = true;
+	framework::Mesh m_cluster_mesh;
+	glm::mat4 m_cluster_model = glm::mat4(1);
+	framework::ClusterCuller m_cluster_culler;
+	bool m_cluster_culling = false;
 	const picogl::Texture* m_texture = {};
+	const picogl::Sampler* m_sampler = {};
 
 	int m_instance_count = 250;
 
@@ -545,23 +695,25 @@ struct ModelerWindow : Window, framework::Viewport3D
 		GLint m_instance_id = 0;
 		GLint m_global_instance_id = 0;
 	} m_hovered_instance, m_selected_instance;
+	picogl::Framebuffer::Readback m_picking_readback;
 };
 
 struct RayMarchingWindow : Window, framework::Viewport3D
 {
-	RayMarchingWindow() : framework::Viewport3D("Raymarching")
+	RayMarchingWindow() : Window("raymarching"), framework::Viewport3D("Raymarching")
 	{
 	}
 
-	void setup()
+	void setup(framework::ProgramCache& program_cache)
 	{
 		m_cubemap = framework::make_cubemap_from_file("../example/resources/sky.png", GL_RGBA8);
 		m_camera.m_position = 0.5f * glm::vec3(1, 0, 1);
 		m_cube = framework::make_cube().m_mesh;
 
-		auto vertex = picogl::Shader::make(GL_VERTEX_SHADER, framework::make_string_from_file(shader_path + "/mesh_interface.vert"));
-		auto fragment = picogl::Shader::make(GL_FRAGMENT_SHADER, framework::make_string_from_file(shader_path + "/raymarching.frag"));
-		m_raymarching = picogl::Program::make({ vertex, fragment });
+		m_raymarching = program_cache.make_program({
+			{ GL_VERTEX_SHADER, framework::make_string_from_file(shader_path + "/mesh_interface.vert") },
+			{ GL_FRAGMENT_SHADER, framework::make_string_from_file(shader_path + "/raymarching.frag") },
+			});
 
 		//Compute density.
 		const int w = 64;
@@ -607,11 +759,11 @@ struct RayMarchingWindow : Window, framework::Viewport3D
 		{
 			m_raymarching.use();
 			m_density.bind_as_sampler(GL_TEXTURE0);
-			m_raymarching.set_uniform("intensity", glUniform1f, m_intensity);
-			m_raymarching.set_uniform("eye_pos", glUniform3fv, 1, glm::value_ptr(m_camera.m_position));
-			m_raymarching.set_uniform("grid_size", glUniform3iv, 1, glm::value_ptr(glm::ivec3(m_grid_size)));
-			m_raymarching.set_uniform("view_proj", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(m_camera.m_view_proj));
-			m_raymarching.set_uniform("model", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(glm::mat4(1)));
+			m_raymarching.set("intensity", m_intensity);
+			m_raymarching.set("eye_pos", m_camera.m_position);
+			m_raymarching.set("grid_size", glm::ivec3(m_grid_size));
+			m_raymarching.set("view_proj", m_camera.m_view_proj);
+			m_raymarching.set("model", glm::mat4(1));
 			m_cube.draw();
 		}
 		debug_gl();
@@ -637,10 +789,13 @@ struct DemoApp : framework::Application
 		Application::setup();
 
 		ImGui::GetIO().ConfigWindowsMoveFromTitleBarOnly = true;
-		m_renderers = framework::RendererCollection::make(m_resource_path);
+		m_program_cache = framework::ProgramCache::make(std::filesystem::temp_directory_path() / "picogl_program_cache");
+		m_renderers = framework::RendererCollection::make(m_resource_path, m_program_cache);
 		m_tex_window.setup();
-		m_modeler_window.setup();
-		m_raymarching_window.setup();
+		m_modeler_window.setup(m_program_cache);
+		m_raymarching_window.setup(m_program_cache);
+		spdlog::info("Program cache: {} hits, {} misses", m_program_cache.hit_count(), m_program_cache.miss_count());
+		m_tracer.dump_on_frame_time(100.0f, std::filesystem::temp_directory_path() / "picogl_spike_trace.json");
 	}
 
 	void update() override
@@ -650,6 +805,7 @@ struct DemoApp : framework::Application
 		m_raymarching_window.update();
 
 		m_modeler_window.m_texture = &m_tex_window.get_texture();
+		m_modeler_window.m_sampler = &m_tex_window.get_sampler();
 	}
 
 	void gui() override
@@ -685,8 +841,17 @@ struct DemoApp : framework::Application
 				m_raymarching_window.settings_gui();
 				ImGui::TreePop();
 			}
+			ImGui::Separator();
+			ImGui::Text(fmt::format("GL state changes: {} issued, {} skipped", m_state_cache.issued_count(), m_state_cache.skipped_count()).c_str());
+			if (ImGui::Button("Save trace"))
+				m_tracer.request_dump(std::filesystem::temp_directory_path() / "picogl_trace.json");
+			memory_gui();
+#if PICOGL_INSTRUMENT
+			instrumentation_gui();
+#endif
 		}
 		ImGui::End();
+		m_state_cache.reset_counters();
 
 		ImGui::SetNextWindowPos({ 0.0f, 0.0f });
 		ImGui::SetNextWindowSize({ m_main_window_width * 0.35f, m_main_window_height * 0.5f });
@@ -705,19 +870,90 @@ struct DemoApp : framework::Application
 	{
 		picogl::Framebuffer::get_default().clear();
 
-		glEnable(GL_MULTISAMPLE);
-		glEnable(GL_BLEND);
+		picogl::set_enabled(GL_MULTISAMPLE, true);
+		picogl::set_enabled(GL_BLEND, true);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		glBlendEquation(GL_FUNC_ADD);
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+		picogl::set_enabled(GL_DEPTH_TEST, true);
+		picogl::set_enabled(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
 
 		m_modeler_window.render(m_renderers);
 		m_tex_window.render(m_renderers);
 		m_raymarching_window.render(m_renderers);
 	}
 
+	void memory_gui()
+	{
+		if (!ImGui::TreeNode("GPU memory"))
+			return;
+
+		const picogl::MemoryStats::Snapshot snapshot = picogl::MemoryStats::snapshot();
+		const auto usage_text = [](const std::string& name, const picogl::MemoryStats::Usage& usage) {
+			ImGui::Text(fmt::format("{}: {:.2f} MB in {} objects, peak {:.2f} MB",
+				name, usage.m_bytes / double(1 << 20), usage.m_count, usage.m_peak_bytes / double(1 << 20)).c_str());
+		};
+		usage_text("Total", snapshot.m_total);
+		usage_text("Buffers", snapshot.m_buffers);
+		usage_text("Textures", snapshot.m_textures);
+		usage_text("Renderbuffers", snapshot.m_renderbuffers);
+		for (const auto& label : snapshot.m_labels)
+			usage_text(label.first, label.second);
+
+		// Growth since the reference snapshot, to spot leaks over a long session.
+		if (ImGui::Button("Set reference"))
+			m_memory_reference = snapshot;
+		ImGui::SameLine();
+		if (ImGui::Button("Reset peaks"))
+			picogl::MemoryStats::reset_peaks();
+		const picogl::MemoryStats::Snapshot diff = snapshot.diff(m_memory_reference);
+		ImGui::Text(fmt::format("Since reference: {:+.2f} MB, {:+} objects", diff.m_total.m_bytes / double(1 << 20), diff.m_total.m_count).c_str());
+		ImGui::TreePop();
+	}
+
+#if PICOGL_INSTRUMENT
+	void instrumentation_gui()
+	{
+		if (!ImGui::TreeNode("GL calls"))
+			return;
+
+		using Counter = picogl::Instrumentation::Counter;
+		constexpr std::array<Counter, 8> columns = {
+			Counter::DrawCalls, Counter::DrawCommands, Counter::Triangles, Counter::Dispatches,
+			Counter::StateChanges, Counter::UniformUploads, Counter::BufferUploadBytes, Counter::TextureUploadBytes,
+		};
+		const auto counters_row = [&](const std::string& name, const picogl::Instrumentation::Counters& counters) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(name.c_str());
+			for (const Counter counter : columns) {
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", static_cast<unsigned long long>(counters[std::size_t(counter)]));
+			}
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", counters[std::size_t(Counter::CallNanoseconds)] * 1e-6);
+		};
+
+		if (ImGui::BeginTable("gl_calls", int(columns.size()) + 2, ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollX | ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableSetupColumn("scope");
+			for (const Counter counter : columns)
+				ImGui::TableSetupColumn(picogl::Instrumentation::get_name(counter));
+			ImGui::TableSetupColumn("call_ms");
+			ImGui::TableHeadersRow();
+
+			counters_row("frame", picogl::Instrumentation::get_last_frame());
+			for (const auto& [name, counters] : picogl::Instrumentation::get_last_frame_scopes())
+				counters_row(name, counters);
+			ImGui::EndTable();
+		}
+		if (ImGui::Button("Copy as JSON"))
+			ImGui::SetClipboardText(picogl::Instrumentation::to_json().c_str());
+		ImGui::TreePop();
+	}
+#endif
+
+	framework::ProgramCache m_program_cache;
 	framework::RendererCollection m_renderers;
+	picogl::MemoryStats::Snapshot m_memory_reference;
 	std::filesystem::path m_resource_path;
 
 	TexWindow m_tex_window;
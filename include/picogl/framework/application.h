@@ -1,5 +1,7 @@
 #pragma once
 
+#include <picogl/framework/trace.h>
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -25,6 +27,11 @@ namespace framework
 
 	protected:
 		std::shared_ptr<GLFWwindow> m_main_window;
+		picogl::StateCache m_state_cache;
+		// Current during the whole frame, from update() to the GUI draw.
+		picogl::GpuProfiler m_gpu_profiler;
+		// Frames and their update, render and gui steps, along with the GPU scopes of the profiler.
+		Tracer m_tracer;
 		int m_main_window_width = {};
 		int m_main_window_height = {};
 		std::string m_name = "myApp";
@@ -2,12 +2,15 @@
 
 #include <glad/glad.h>
 #include <picogl/framework/image.h>
+#include <picogl/framework/mesh_processing.h>
 #include <picogl/picogl.hpp>
 
 #include <glm/glm.hpp>
 
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <random>
 #include <string>
 #include <vector>
@@ -28,27 +31,52 @@ namespace framework
 		glm::vec3 m_max;
 	};
 
+	// Float triangle mesh vertices take 44 bytes. Quantized ones take 20: unorm16 positions relative
+	// to the mesh AABB, snorm 2_10_10_10 normals, half float uvs and unorm8 colors.
+	enum class VertexFormat
+	{
+		Float,
+		Quantized,
+	};
+
 	struct Mesh
 	{
 		picogl::Mesh m_mesh;
 		framework::AABB m_aabb;
+		// Maps stored positions to object space, identity unless quantized.
+		glm::mat4 m_dequantization = glm::mat4(1);
+		// Estimated distance of each coarser level to the full resolution one, in object units.
+		std::vector<float> m_lod_errors;
+		// Clusters of m_mesh, in the order of its submeshes, if it was split.
+		std::vector<Meshlet> m_meshlets;
 	};
 
 	AABB make_aabb(const std::vector<glm::vec3>& positions);
 	std::string make_string_from_file(const std::filesystem::path& filepath);
-	std::vector<Mesh> make_mesh_from_obj(const std::filesystem::path& filepath);
+	// Levels of detail are simplified down to each of the ratios of the original triangle count, if any.
+	// Otherwise, shapes can be split into meshlets of at most meshlet_triangle_count triangles.
+	// Optimizing reorders triangles for the vertex cache and overdraw, and vertices for fetch locality.
+	std::vector<Mesh> make_mesh_from_obj(const std::filesystem::path& filepath, const VertexFormat format = VertexFormat::Float,
+		const std::vector<float>& lod_ratios = {}, const std::uint32_t meshlet_triangle_count = 0, const bool optimize = true);
 	picogl::Texture make_texture_from_file(const std::filesystem::path& filepath);
 	Image make_image_from_file(const std::filesystem::path& filepath);
 
-	Mesh make_cube();
-	Mesh make_torus(const float R, const float r, std::uint32_t precision = 32u);
-	Mesh make_sphere(std::uint32_t precision = 32u);
+	Mesh make_cube(const VertexFormat format = VertexFormat::Float);
+	// Each extra level of detail skips every other row and column of the previous one. Triangles and vertices
+	// are reordered as for imported meshes.
+	Mesh make_torus(const float R, const float r, std::uint32_t precision = 32u, const VertexFormat format = VertexFormat::Float, const std::uint32_t lod_count = 1u);
+	Mesh make_sphere(std::uint32_t precision = 32u, const VertexFormat format = VertexFormat::Float, const std::uint32_t lod_count = 1u);
 	Mesh make_aabb_lines(const AABB& aabb);
 
 	Image make_perlin(std::uint32_t w, std::uint32_t h, std::uint32_t size);
 	Image make_checkers(std::uint32_t w, std::uint32_t h, std::uint32_t size);
 
 	picogl::Texture make_texture_from_image(const Image& src, GLenum internal_format);
+	// Reuploads an image of the same size through the staging pool instead of a synchronous client copy.
+	void update_texture_from_image(picogl::Texture& dst, const Image& src, picogl::UploadPool& pool);
+	// Same, with each row of pixels written by fill_row straight into the staging memory, so that generated or
+	// converted pixels skip any intermediate Image.
+	void update_texture_from_rows(picogl::Texture& dst, picogl::UploadPool& pool, const std::function<void(std::uint32_t y, std::byte* row)>& fill_row);
 	picogl::Texture make_cubemap_from_file(const std::filesystem::path& filepath, GLenum internal_format);
 
 	namespace utils
@@ -67,7 +95,27 @@ namespace framework
 			const std::vector<glm::vec3>& ps,
 			const std::vector<glm::vec3>& ns,
 			const std::vector<glm::vec2>& uv,
-			const std::vector<glm::vec3>& cs);
+			const std::vector<glm::vec3>& cs,
+			const std::vector<std::vector<T>>& lods = {});
+
+		// Quantizes against dst.m_aabb if requested, which must already be set.
+		// Lods are coarser triangle lists over the same vertices.
+		template<typename T>
+		void set_triangle_mesh(
+			Mesh& dst,
+			const std::vector<T>& tris,
+			const std::vector<glm::vec3>& ps,
+			const std::vector<glm::vec3>& ns,
+			const std::vector<glm::vec2>& uv,
+			const std::vector<glm::vec3>& cs,
+			const VertexFormat format,
+			const std::vector<std::vector<T>>& lods = {});
+
+		glm::u16vec4 quantize_position(const glm::vec3& position, const AABB& aabb);
+		glm::mat4 make_dequantization(const AABB& aabb);
+		std::uint32_t quantize_normal(const glm::vec3& normal);
+		std::uint32_t quantize_uv(const glm::vec2& uv);
+		std::uint32_t quantize_color(const glm::vec3& color);
 
 		template<typename T, int N>
 		glm::vec<N, T> make_random_vec()
@@ -100,10 +148,13 @@ namespace framework
 			const std::vector<glm::vec3>& ps,
 			const std::vector<glm::vec3>& ns,
 			const std::vector<glm::vec2>& uv,
-			const std::vector<glm::vec3>& cs)
+			const std::vector<glm::vec3>& cs,
+			const std::vector<std::vector<T>>& lods)
 		{
 			picogl::Mesh mesh = picogl::Mesh::make();
 			mesh.set_indices(GL_TRIANGLES, tris, GL_UNSIGNED_INT);
+			if (!lods.empty())
+				mesh.set_lod_indices(lods);
 			mesh.set_vertex_attributes({
 				{ps, GL_FLOAT, 3},
 				{ns, GL_FLOAT, 3},
@@ -113,5 +164,46 @@ namespace framework
 
 			return mesh;
 		}
+
+		template<typename T>
+		void set_triangle_mesh(
+			Mesh& dst,
+			const std::vector<T>& tris,
+			const std::vector<glm::vec3>& ps,
+			const std::vector<glm::vec3>& ns,
+			const std::vector<glm::vec2>& uv,
+			const std::vector<glm::vec3>& cs,
+			const VertexFormat format,
+			const std::vector<std::vector<T>>& lods)
+		{
+			if (format == VertexFormat::Float) {
+				dst.m_mesh = make_triangle_mesh(tris, ps, ns, uv, cs, lods);
+				dst.m_dequantization = glm::mat4(1);
+				return;
+			}
+
+			std::vector<glm::u16vec4> q_ps(ps.size());
+			std::vector<std::uint32_t> q_ns(ns.size()), q_uv(uv.size()), q_cs(cs.size());
+			for (std::size_t i = 0; i < ps.size(); ++i)
+				q_ps[i] = quantize_position(ps[i], dst.m_aabb);
+			for (std::size_t i = 0; i < ns.size(); ++i)
+				q_ns[i] = quantize_normal(ns[i]);
+			for (std::size_t i = 0; i < uv.size(); ++i)
+				q_uv[i] = quantize_uv(uv[i]);
+			for (std::size_t i = 0; i < cs.size(); ++i)
+				q_cs[i] = quantize_color(cs[i]);
+
+			dst.m_mesh = picogl::Mesh::make();
+			dst.m_mesh.set_indices(GL_TRIANGLES, tris, GL_UNSIGNED_INT);
+			if (!lods.empty())
+				dst.m_mesh.set_lod_indices(lods);
+			dst.m_mesh.set_vertex_attributes({
+				{q_ps, GL_UNSIGNED_SHORT, 4, true},
+				{q_ns, GL_INT_2_10_10_10_REV, 4, true},
+				{q_uv, GL_HALF_FLOAT, 2},
+				{q_cs, GL_UNSIGNED_BYTE, 4, true}
+				});
+			dst.m_dequantization = make_dequantization(dst.m_aabb);
+		}
 	}
 }
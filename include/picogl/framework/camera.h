@@ -3,6 +3,8 @@
 #define GLM_FORCE_RADIANS 
 #include <glm/glm.hpp>
 
+#include <array>
+
 namespace framework
 {
 	class Camera
@@ -14,6 +16,9 @@ namespace framework
 		glm::vec3 right() const;
 		glm::vec3 up() const;
 
+		// World space planes as (normal, distance), normals point inside the frustum.
+		std::array<glm::vec4, 6> frustum_planes() const;
+
 		glm::mat4 m_view = {};
 		glm::mat4 m_proj = {};
 		glm::mat4 m_view_proj = {};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <picogl/framework/camera.h>
+#include <picogl/framework/mesh_processing.h>
+#include <picogl/framework/program_cache.h>
+
+#include <glad/glad.h>
+#include <picogl/picogl.hpp>
+
+#include <glm/glm.hpp>
+#include <array>
+#include <filesystem>
+#include <vector>
+
+namespace framework
+{
+	// World space bounds of an instance, matches the std430 layout of cull_instances.comp.
+	// An instance of a mesh with several submeshes needs one bounds per submesh draw.
+	struct InstanceBounds
+	{
+		glm::vec3 m_min;
+		GLuint m_draw_id; // Pool draw the instance belongs to.
+		glm::vec3 m_max;
+		GLuint m_instance_id; // Written to the visible list, typically an index in the instance data.
+	};
+
+	// Max reduction of a depth buffer, each texel keeps the farthest depth of the pixels it covers.
+	class DepthPyramid
+	{
+	public:
+		static DepthPyramid make(const std::filesystem::path& shader_folder, ProgramCache& cache);
+
+		// Reallocated when the depth size changes.
+		void build(const picogl::Texture& depth);
+		void bind_as_sampler(const GLuint slot) const;
+
+		GLsizei width() const;
+		GLsizei height() const;
+		GLsizei level_count() const;
+
+	private:
+		picogl::Program m_program;
+		picogl::Texture m_pyramid;
+	};
+
+	// Culls instances of a MeshPool on the GPU. Visible instances are appended to a compacted list,
+	// and the indirect draws only cover them: shaders fetch visible_instances[gl_BaseInstance + gl_InstanceID].
+	// Draws without visible instances are also removed and the draw count stays on the GPU, which requires GL 4.6
+	// like the framework shaders.
+	// Draws with levels of detail get one command per level, each instance picks one from its projected size.
+	class InstanceCuller
+	{
+	public:
+		struct Stats
+		{
+			GLuint m_visible_count = 0;
+			GLuint m_frustum_culled_count = 0;
+			GLuint m_occlusion_culled_count = 0;
+		};
+
+		static InstanceCuller make(const std::filesystem::path& shader_folder, ProgramCache& cache);
+
+		// To call again whenever the pool draws or the instances change.
+		void set_instances(const picogl::MeshPool& pool, const std::vector<InstanceBounds>& bounds);
+
+		// Frustum culling only, followed by a single draw().
+		void cull(const Camera& camera);
+
+		// Two-phase occlusion culling. The early phase keeps the instances visible last frame, which are drawn
+		// and reduced into the depth pyramid. The late phase tests everything against it, and the following draw()
+		// only adds the instances that became visible.
+		void cull_early(const Camera& camera);
+		void cull_late(const Camera& camera, const DepthPyramid& pyramid);
+
+		void draw(const picogl::MeshPool& pool) const;
+
+		// Projected height in pixels below which the next coarser level is used, halved at each level.
+		void set_lod_pixel_size(const float pixel_size);
+		// Same selection on the CPU, one level per pool draw, e.g. for MeshPool::set_lods when drawing without culling.
+		// All the instances of a draw share its level, the finest one picked by any of them.
+		std::vector<GLuint> select_lods(const Camera& camera, const picogl::MeshPool& pool, const std::vector<InstanceBounds>& bounds) const;
+
+		void bind_visible_instances(const GLuint index) const;
+		GLsizei instance_count() const;
+		// Counters of the last frame the GPU is done with, a few frames behind.
+		const Stats& stats() const;
+
+	private:
+		enum class Phase : GLuint
+		{
+			Frustum,
+			Early,
+			Late,
+		};
+
+		struct StatsReadback
+		{
+			picogl::Buffer m_buffer;
+			picogl::Fence m_fence;
+			bool m_pending = false;
+		};
+
+		void begin_frame();
+		void dispatch(const Camera& camera, const Phase phase, const DepthPyramid* pyramid);
+		void end_frame();
+
+		picogl::Program m_cull_program;
+		picogl::Program m_compact_program;
+		picogl::Buffer m_bounds;
+		picogl::Buffer m_reset_draws; // Pool draws with zero instances, each one starting at its region of the visible list.
+		picogl::Buffer m_draws;
+		picogl::Buffer m_draw_lods; // First command and level count of each pool draw.
+		picogl::Buffer m_compacted_draws;
+		picogl::Buffer m_draw_count;
+		picogl::Buffer m_visible_instances;
+		picogl::Buffer m_visibility;
+		picogl::Buffer m_stats_buffer;
+		std::array<StatsReadback, 3> m_stats_readbacks;
+		std::size_t m_stats_frame = 0;
+		Stats m_stats;
+		GLsizei m_instance_count = 0;
+		GLsizei m_pool_draw_count = 0;
+		GLsizei m_command_count = 0;
+		float m_lod_pixel_size = 256.0f;
+	};
+
+	// Culls the meshlets of a single mesh against the frustum and by normal cone. The mesh must have been split
+	// with Mesh::set_clusters using the same meshlets, its indirect draws are rewritten in place so that
+	// Mesh::draw() only draws the visible ones, still as a single multi draw.
+	class ClusterCuller
+	{
+	public:
+		static ClusterCuller make(const std::filesystem::path& shader_folder, ProgramCache& cache);
+
+		// Visible clusters are drawn instance_count times.
+		void set_clusters(const std::vector<Meshlet>& meshlets, const GLuint instance_count = 1);
+
+		// Cone culling is skipped if the model matrix does not scale uniformly.
+		void cull(const Camera& camera, const glm::mat4& model, const picogl::Mesh& mesh);
+
+		GLsizei cluster_count() const;
+
+	private:
+		picogl::Program m_program;
+		picogl::Buffer m_clusters;
+		GLsizei m_cluster_count = 0;
+		GLuint m_instance_count = 1;
+	};
+}
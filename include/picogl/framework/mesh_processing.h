@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace framework
+{
+	struct LodLevel
+	{
+		std::vector<std::uint32_t> m_indices;
+		// Quadric estimate of the distance to the original surface, in object units.
+		float m_error = 0.0f;
+	};
+
+	struct Meshlet
+	{
+		// Object space bounding sphere.
+		glm::vec3 m_center;
+		float m_radius;
+		// The triangles all face away from a viewpoint v if dot(m_center - v, m_cone_axis) >= m_cone_cutoff * |m_center - v| + m_radius.
+		// The cutoff is 1 when their normals spread too much for that to happen.
+		glm::vec3 m_cone_axis;
+		float m_cone_cutoff;
+		std::uint32_t m_first_index;
+		std::uint32_t m_index_count;
+	};
+
+	struct Meshlets
+	{
+		// Input triangles reordered so that each meshlet is a contiguous range.
+		std::vector<std::uint32_t> m_indices;
+		std::vector<Meshlet> m_meshlets;
+	};
+
+	struct VertexCacheStats
+	{
+		float m_acmr = 0.0f; // Vertex shader invocations per triangle, from 0.5 to 3.
+		float m_atvr = 0.0f; // Vertex shader invocations per referenced vertex, 1 at best.
+	};
+
+	struct SimplifyOptions
+	{
+		// Fractions of the original triangle count, in decreasing order.
+		std::vector<float> m_ratios = { 0.5f, 0.25f, 0.125f };
+		// Collapses moving the surface further than this, relative to the mesh extent, are skipped.
+		float m_max_error = 0.05f;
+		float m_normal_weight = 0.5f;
+		float m_uv_weight = 1.0f;
+		// 0 uses all hardware threads.
+		std::uint32_t m_thread_count = 0;
+	};
+
+	// Simplifies a triangle list with quadric error metric edge collapses, each level starting from the previous one.
+	// Normals and uvs, which may be empty, add to the collapse cost. Vertices sharing a position, such as the two sides
+	// of a uv seam, only collapse together along the seam. The chain stops early once a level cannot be reduced.
+	std::vector<LodLevel> make_lod_chain(
+		const std::vector<std::uint32_t>& indices,
+		const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& normals,
+		const std::vector<glm::vec2>& uvs,
+		const SimplifyOptions& options = {});
+
+	// Greedily grows clusters of connected triangles, each one picking the neighbor sharing the most vertices
+	// and then the closest one, to keep meshlets compact for culling.
+	Meshlets make_meshlets(
+		const std::vector<std::uint32_t>& indices,
+		const std::vector<glm::vec3>& positions,
+		const std::uint32_t max_triangle_count = 124u);
+
+	// Simulates a FIFO post-transform cache.
+	VertexCacheStats analyze_vertex_cache(const std::vector<std::uint32_t>& indices, const std::size_t vertex_count, const std::uint32_t cache_size = 16u);
+
+	// Tipsify: fans around the last vertices emitted while they are likely to still be in the cache.
+	std::vector<std::uint32_t> optimize_vertex_cache(const std::vector<std::uint32_t>& indices, const std::size_t vertex_count, const std::uint32_t cache_size = 16u);
+
+	// Splits a cache optimized triangle list into clusters whose cache efficiency stays within threshold
+	// of the whole list, then draws the clusters facing away from the mesh center first, so that they hide the others.
+	std::vector<std::uint32_t> optimize_overdraw(const std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		const std::uint32_t cache_size = 16u, const float threshold = 1.05f);
+
+	// New index of each vertex, in order of first use by the indices. Unused vertices go last.
+	std::vector<std::uint32_t> make_vertex_fetch_remap(const std::vector<std::uint32_t>& indices, const std::size_t vertex_count);
+	void remap_indices(std::vector<std::uint32_t>& indices, const std::vector<std::uint32_t>& remap);
+	template<typename T>
+	void remap_vertices(std::vector<T>& vertices, const std::vector<std::uint32_t>& remap);
+
+	template<typename T>
+	void remap_vertices(std::vector<T>& vertices, const std::vector<std::uint32_t>& remap)
+	{
+		std::vector<T> remapped(vertices.size());
+		for (std::size_t v = 0; v < vertices.size(); ++v)
+			remapped[remap[v]] = vertices[v];
+		vertices = std::move(remapped);
+	}
+}
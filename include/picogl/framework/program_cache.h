@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <picogl/picogl.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace framework
+{
+	// Linked program binaries stored on disk, keyed by the shader sources and the driver identity.
+	class ProgramCache
+	{
+	public:
+		using Sources = std::vector<std::pair<GLenum, std::string>>;
+
+		static ProgramCache make(const std::filesystem::path& folder);
+
+		// Loads the cached binary if still valid, otherwise builds from source and stores the result.
+		picogl::Program make_program(const Sources& sources);
+		// Cache misses are compiled and linked without waiting, so that the driver can build them in parallel.
+		picogl::Program make_program_async(const Sources& sources);
+		// Waits for programs from make_program_async and stores the binaries of the cache misses.
+		void finish(const std::vector<std::reference_wrapper<picogl::Program>>& programs);
+
+		std::size_t hit_count() const;
+		std::size_t miss_count() const;
+
+	private:
+		std::vector<std::pair<GLuint, std::filesystem::path>> m_pending_stores;
+		std::filesystem::path m_folder;
+		std::uint64_t m_driver_hash = 0;
+		bool m_enabled = false;
+		std::size_t m_hit_count = 0;
+		std::size_t m_miss_count = 0;
+	};
+}
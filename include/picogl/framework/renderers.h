@@ -1,6 +1,8 @@
 #pragma once
 
 #include <picogl/framework/camera.h>
+#include <picogl/framework/culling.h>
+#include <picogl/framework/program_cache.h>
 
 #include <glad/glad.h>
 #include <picogl/picogl.hpp>
@@ -27,13 +29,23 @@ namespace framework
 
 	struct TextureRenderer : Renderer
 	{
-		void render(const picogl::Texture& tex, const glm::mat3& uv_transform, float lod = -1.0f);
+		void render(const picogl::Texture& tex, const glm::mat3& uv_transform, float lod = -1.0f, const picogl::Sampler* sampler = nullptr);
 		picogl::Mesh m_dummy;
 	};
 
 	struct MultiRenderer : Renderer
 	{
-		void render(const Camera& camera, const picogl::Mesh& m, const picogl::Buffer& instance_ssbo, const picogl::Buffer& instance_offset_ssbo);
+		void render(const Camera& camera, const picogl::Mesh& m, const picogl::StreamBuffer::Range& instances, const picogl::Buffer& instance_offset_ssbo);
+		void render(const Camera& camera, const picogl::MeshPool& pool, const picogl::StreamBuffer::Range& instances, const picogl::Buffer& instance_offset_ssbo);
+
+	private:
+		void setup(const Camera& camera, const picogl::StreamBuffer::Range& instances, const picogl::Buffer& instance_offset_ssbo);
+	};
+
+	// Same shading as MultiRenderer, for the instances left visible by an InstanceCuller.
+	struct CulledMultiRenderer : Renderer
+	{
+		void render(const Camera& camera, const picogl::MeshPool& pool, const InstanceCuller& culler, const picogl::StreamBuffer::Range& instances);
 	};
 
 	struct GridRenderer : Renderer
@@ -50,12 +62,13 @@ namespace framework
 
 	struct RendererCollection
 	{
-		static RendererCollection make(const std::filesystem::path& shader_folder);
+		static RendererCollection make(const std::filesystem::path& shader_folder, ProgramCache& cache);
 
 		SingleColorRenderer m_single_color;
 		PhongRenderer m_phong;
 		TextureRenderer m_texture;
 		MultiRenderer m_multi_renderer;
+		CulledMultiRenderer m_culled_multi_renderer;
 		GridRenderer m_grid_renderer;
 		CubeMapRenderer m_cubemap_renderer;
 	};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace picogl
+{
+	class GpuProfiler;
+}
+
+#ifndef PICOGL_CONCAT
+#define PICOGL_CONCAT_IMPL(a, b) a##b
+#define PICOGL_CONCAT(a, b) PICOGL_CONCAT_IMPL(a, b)
+#endif // !PICOGL_CONCAT
+
+// Traces the rest of the enclosing block on the calling thread, with the current Tracer if any.
+// The name must outlive the tracer, e.g. a string literal.
+#define PICOGL_TRACE_SCOPE(name) const framework::TraceScope PICOGL_CONCAT(picogl_trace_scope_, __LINE__){ name }
+
+namespace framework
+{
+	// CPU scopes of any thread and GPU scopes of a picogl::GpuProfiler on a single timeline, written as
+	// Chrome trace events to open in chrome://tracing or ui.perfetto.dev. Each thread records into its own
+	// ring of the last events, without locking once registered, and the oldest events are overwritten.
+	class Tracer
+	{
+	public:
+		static Tracer* get_current();
+		static void set_current(Tracer* tracer);
+
+		// Capacities are in events, per thread and for the GPU.
+		static Tracer make(const std::size_t thread_capacity = 1 << 14, const std::size_t gpu_capacity = 1 << 14);
+
+		// Names must outlive the tracer, e.g. string literals.
+		void begin_scope(const char* name);
+		void end_scope();
+		// Names the track of the calling thread, "thread N" by default.
+		void set_thread_name(const std::string& name);
+
+		// From the thread owning the GL context. Each frame is traced as a "frame" scope, and the GPU clock
+		// is sampled at its beginning to move the GPU scopes collected by the profiler to the CPU timeline.
+		void begin_frame();
+		void end_frame(const picogl::GpuProfiler* profiler = nullptr);
+
+		// Written at the end of the current frame.
+		void request_dump(const std::filesystem::path& path);
+		// Written at the end of frames longer than frame_ms, at most once per second so that the file holds
+		// the last spike with the frames leading to it. 0 disables it.
+		void dump_on_frame_time(const float frame_ms, const std::filesystem::path& path);
+		// From the thread owning the GL context. Returns false if the file could not be written.
+		bool dump(const std::filesystem::path& path) const;
+
+		std::uint64_t frame_index() const;
+
+	private:
+		struct Event
+		{
+			std::atomic<const char*> m_name = nullptr;
+			std::atomic<std::int64_t> m_begin_ns = 0;
+			std::atomic<std::int64_t> m_end_ns = 0;
+		};
+
+		// Single writer ring, read back while being written.
+		struct ThreadBuffer
+		{
+			std::unique_ptr<Event[]> m_events;
+			std::size_t m_capacity = 0;
+			std::atomic<std::uint64_t> m_write_count = 0;
+			std::atomic<bool> m_in_use = false; // Released when its thread exits, for the next new thread.
+			std::vector<std::pair<const char*, std::int64_t>> m_open_scopes; // Writer only.
+			std::string m_name; // Guarded by the tracer mutex.
+			std::uint32_t m_track = 0;
+		};
+
+		struct Shared
+		{
+			std::mutex m_mutex;
+			std::vector<std::shared_ptr<ThreadBuffer>> m_threads;
+			std::chrono::steady_clock::time_point m_start;
+			std::size_t m_thread_capacity = 0;
+		};
+
+		struct GpuEvent
+		{
+			const char* m_name;
+			std::int64_t m_begin_ns;
+			std::int64_t m_end_ns;
+		};
+
+		ThreadBuffer& get_thread_buffer();
+		std::int64_t now_ns() const;
+		void write(ThreadBuffer& buffer, const char* name, const std::int64_t begin_ns, const std::int64_t end_ns);
+
+		std::shared_ptr<Shared> m_shared;
+		// Render thread only.
+		std::vector<GpuEvent> m_gpu_events;
+		std::size_t m_gpu_write_count = 0;
+		std::unordered_set<std::string> m_gpu_names; // Stable storage for the profiler scope names.
+		std::int64_t m_gpu_to_cpu_ns = 0;
+		std::int64_t m_frame_begin_ns = 0;
+		std::uint64_t m_frame_index = 0;
+		std::filesystem::path m_dump_path;
+		std::filesystem::path m_spike_dump_path;
+		float m_spike_frame_ms = 0.0f;
+		std::int64_t m_spike_dump_ns = -1;
+	};
+
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* name);
+		~TraceScope();
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		Tracer* m_tracer = nullptr;
+	};
+}
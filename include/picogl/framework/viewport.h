@@ -25,6 +25,8 @@ namespace framework
 		virtual void update();
 
 		const picogl::Framebuffer& final_framebuffer() const;
+		// Single sampled depth of what was rendered so far, resolved first when multisampled.
+		const picogl::Texture& resolve_depth();
 
 	protected:
 		picogl::Framebuffer m_framebuffer;
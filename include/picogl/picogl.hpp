@@ -1,8 +1,19 @@
 #ifndef PICOGL_INCLUDE
 #define PICOGL_INCLUDE
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -11,6 +22,40 @@
 #define PICOGL_ASSERT assert
 #endif // !PICOGL_ASSERT
 
+// Direct State Access (GL 4.5) is used to edit objects without binding them.
+// Define PICOGL_USE_DSA to 0 to fall back to bind-to-edit on older contexts.
+#ifndef PICOGL_USE_DSA
+#define PICOGL_USE_DSA 1
+#endif // !PICOGL_USE_DSA
+
+// Define PICOGL_INSTRUMENT to 1 to count the GL work submitted through picogl, see Instrumentation.
+// The counting calls compile to nothing otherwise.
+#ifndef PICOGL_INSTRUMENT
+#define PICOGL_INSTRUMENT 0
+#endif // !PICOGL_INSTRUMENT
+
+#define PICOGL_CONCAT_IMPL(a, b) a##b
+#define PICOGL_CONCAT(a, b) PICOGL_CONCAT_IMPL(a, b)
+
+// Times the rest of the enclosing block on the GPU, with the current GpuProfiler if any.
+#define PICOGL_GPU_SCOPE(name) const picogl::GpuProfiler::Scope PICOGL_CONCAT(picogl_gpu_scope_, __LINE__){ name }
+
+// Count the GL call issued in the rest of the enclosing block and time it on the CPU. Arguments are not evaluated
+// when PICOGL_INSTRUMENT is 0.
+#if PICOGL_INSTRUMENT
+#define PICOGL_INSTRUMENT_CALL(counter, value) const picogl::impl::InstrumentedCall PICOGL_CONCAT(picogl_instrumented_call_, __LINE__){ \
+	{ { picogl::Instrumentation::Counter::counter, std::uint64_t(value) } } }
+#define PICOGL_INSTRUMENT_UPLOAD(kind, bytes) const picogl::impl::InstrumentedCall PICOGL_CONCAT(picogl_instrumented_call_, __LINE__){ \
+	{ { picogl::Instrumentation::Counter::kind##Uploads, 1 }, { picogl::Instrumentation::Counter::kind##UploadBytes, std::uint64_t(bytes) } } }
+#define PICOGL_INSTRUMENT_DRAW(commands, triangles) const picogl::impl::InstrumentedCall PICOGL_CONCAT(picogl_instrumented_call_, __LINE__){ \
+	{ { picogl::Instrumentation::Counter::DrawCalls, 1 }, { picogl::Instrumentation::Counter::DrawCommands, std::uint64_t(commands) }, \
+	{ picogl::Instrumentation::Counter::Triangles, std::uint64_t(triangles) } } }
+#else
+#define PICOGL_INSTRUMENT_CALL(counter, value) ((void)0)
+#define PICOGL_INSTRUMENT_UPLOAD(kind, bytes) ((void)0)
+#define PICOGL_INSTRUMENT_DRAW(commands, triangles) ((void)0)
+#endif // PICOGL_INSTRUMENT
+
 #define PICOGL_ENUM_CLASS_OPERATORS(Name)																						\
 	constexpr Name operator&(const Name a, const Name b) {																		\
 		return static_cast<Name>(static_cast<std::underlying_type_t<Name>>(a) & static_cast<std::underlying_type_t<Name>>(b));	\
@@ -39,10 +84,40 @@ namespace picogl
 
 		PixelInfo get_pixel_info(const GLenum internal_format);
 		GLuint get_scalar_sizeof(const GLenum type);
+		// Index helpers over GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT data.
+		GLuint get_max_index(const void* indices, const GLenum type, const std::size_t count);
+		// The destination type must be able to hold every index.
+		void convert_indices(const void* src, const GLenum src_type, void* dst, const GLenum dst_type, const std::size_t count);
+		// Packed types hold all their channels in a single scalar.
+		GLuint get_attribute_sizeof(const GLenum type, const GLsizei channel_count);
+		GLuint get_uniform_sizeof(const GLenum type);
+		void upload_uniform(const GLuint program, const GLint location, const GLenum type, const GLsizei count, const void* data);
+
+		// Binding helpers, going through the current StateCache if any.
+		void use_program(const GLuint program);
+		void bind_vertex_array(const GLuint vao);
+		void bind_buffer(const GLenum target, const GLuint buffer);
+		void bind_buffer_range(const GLenum target, const GLuint index, const GLuint buffer, const GLintptr offset = 0, const GLsizeiptr size = 0);
+		void active_texture(const GLenum slot);
+		void bind_texture(const GLenum target, const GLuint texture);
+		void bind_texture_unit(const GLuint unit, const GLenum target, const GLuint texture);
+		void bind_framebuffer(const GLenum target, const GLuint framebuffer);
+		void bind_sampler(const GLuint unit, const GLuint sampler);
+
+		// Updates an object side shadow of its own state, true if the GL call can be skipped.
+		template<typename T>
+		bool skip_unchanged(T& shadow, const T& value);
+
+		bool has_extension(const char* name);
+		// Lets the driver compile on its own threads, checked once for the first context.
+		bool parallel_shader_compile();
 
 		template<typename Container>
 		GLuint get_data_size(const Container& container);
 
+		// Copies count elements of element_sizeof bytes to a strided destination, using worker threads for large counts.
+		void copy_strided(char* dst, const std::size_t dst_stride, const char* src, const std::size_t element_sizeof, const std::size_t count);
+
 		enum class GLObjectType
 		{
 			Buffer,
@@ -50,6 +125,7 @@ namespace picogl
 			Query,
 			Program,
 			RenderBuffer,
+			Sampler,
 			Shader,
 			Texture,
 			VertexArray
@@ -84,6 +160,220 @@ namespace picogl
 	GLenum gl_debug(std::string& message);
 	GLenum gl_framebuffer_status(std::string& message, const GLenum target = GL_FRAMEBUFFER);
 
+	// Sync objects are GLsync handles rather than GLuint names, hence not a GLObject.
+	class Fence
+	{
+	public:
+		static Fence make();
+
+		Fence();
+		Fence(Fence&& rhs) noexcept;
+		Fence& operator=(Fence&& rhs) noexcept;
+		~Fence();
+
+		// An empty fence is always signaled.
+		bool signaled() const;
+		bool wait(const GLuint64 timeout_ns = ~GLuint64(0)) const;
+
+		operator GLsync() const;
+
+	private:
+		GLsync m_sync = nullptr;
+	};
+
+	// One fence per frame in flight, to know when the GPU is done with per-frame resources.
+	class FenceRing
+	{
+	public:
+		static FenceRing make(const GLsizei frame_count);
+
+		// Fences the current frame and moves to the next one, waiting for the GPU to release it.
+		// Returns false if the wait timed out.
+		bool next_frame(const GLuint64 timeout_ns = ~GLuint64(0));
+
+		GLsizei frame_index() const;
+		GLsizei frame_count() const;
+
+	private:
+		std::vector<Fence> m_fences;
+		GLsizei m_frame = 0;
+	};
+
+	// Opt-in shadow of the bindings and capabilities picogl changes. While a cache is current,
+	// calls that would not change anything are skipped. Raw GL calls touching the same state,
+	// such as a GUI backend, must be followed by invalidate().
+	class StateCache
+	{
+	public:
+		static StateCache* get_current();
+		static void set_current(StateCache* cache);
+
+		void invalidate();
+		// Deleted names are unbound by GL and may be reused by new objects.
+		void forget(const impl::GLObjectType type, const GLuint gl);
+
+		// Each returns true if the matching GL call must be issued.
+		bool update_program(const GLuint program);
+		bool update_vertex_array(const GLuint vao);
+		bool update_buffer(const GLenum target, const GLuint buffer);
+		bool update_active_texture(const GLenum slot);
+		bool update_texture(const GLuint unit, const GLenum target, const GLuint texture);
+		// Binding on the active texture unit.
+		bool update_texture(const GLenum target, const GLuint texture);
+		bool update_framebuffer(const GLenum target, const GLuint framebuffer);
+		bool update_sampler(const GLuint unit, const GLuint sampler);
+		bool update_capability(const GLenum capability, const bool enabled);
+
+		// Shadows a binding changed by a call that is always issued, such as an indexed buffer binding.
+		void set_buffer(const GLenum target, const GLuint buffer);
+		// For state shadowed outside of the cache, such as sampler parameters.
+		void count(const bool issued);
+
+		std::size_t issued_count() const;
+		std::size_t skipped_count() const;
+		void reset_counters();
+
+	private:
+		static constexpr GLuint Unknown = ~GLuint(0);
+
+		bool update(GLuint& shadow, const GLuint value);
+
+		GLuint m_program = Unknown;
+		GLuint m_vertex_array = Unknown;
+		GLuint m_active_texture = Unknown;
+		GLuint m_draw_framebuffer = Unknown;
+		GLuint m_read_framebuffer = Unknown;
+		std::unordered_map<GLenum, GLuint> m_buffers;
+		std::unordered_map<std::uint64_t, GLuint> m_textures; // Keyed by unit and target.
+		std::unordered_map<GLenum, GLuint> m_capabilities;
+		std::unordered_map<GLuint, GLuint> m_samplers;
+		std::size_t m_issued_count = 0;
+		std::size_t m_skipped_count = 0;
+	};
+
+	// Bytes of the buffers, textures and renderbuffers alive, from the sizes, formats, levels, layers and samples
+	// they are allocated with. Driver padding, alignment and compression are not accounted for.
+	class MemoryStats
+	{
+	public:
+		struct Usage
+		{
+			GLsizeiptr m_bytes = 0;
+			GLsizeiptr m_peak_bytes = 0; // Since the last reset_peaks().
+			std::ptrdiff_t m_count = 0;
+		};
+
+		struct Snapshot
+		{
+			Usage m_total;
+			Usage m_buffers;
+			Usage m_textures;
+			Usage m_renderbuffers;
+			std::map<std::string, Usage> m_labels; // Unlabeled objects are only in the totals.
+
+			// Bytes and counts relative to an earlier snapshot, e.g. to find what a session leaked. Peaks are kept.
+			Snapshot diff(const Snapshot& before) const;
+		};
+
+		static Snapshot snapshot();
+		static void reset_peaks();
+
+		// Names the object for debuggers with glObjectLabel. Buffers, textures and renderbuffers are then also
+		// accounted under that label.
+		static void set_label(const impl::GLObjectType type, const GLuint gl, const std::string& label);
+	};
+
+	namespace impl
+	{
+		// Sizes of the live objects, recorded by the allocating calls and released along with their GLObject.
+		class MemoryRegistry
+		{
+		public:
+			static MemoryRegistry& get();
+			static bool is_tracked(const GLObjectType type);
+
+			// Replaces the previous size of the object, if any.
+			void allocate(const GLObjectType type, const GLuint gl, const GLsizeiptr bytes);
+			void release(const GLObjectType type, const GLuint gl);
+			void set_label(const GLObjectType type, const GLuint gl, const std::string& label);
+
+			const MemoryStats::Snapshot& stats() const;
+			void reset_peaks();
+
+		private:
+			struct Allocation
+			{
+				GLObjectType m_type;
+				GLsizeiptr m_bytes = 0;
+				std::string m_label;
+			};
+
+			void update(const Allocation& allocation, const GLsizeiptr bytes, const std::ptrdiff_t count);
+
+			std::unordered_map<std::uint64_t, Allocation> m_allocations; // Keyed by type and name.
+			MemoryStats::Snapshot m_stats;
+		};
+	}
+
+	// Counts of the GL work submitted through picogl, for the current and last frames, and for the last frame scopes,
+	// which include their nested scopes. Only gathered when PICOGL_INSTRUMENT is 1, from the thread owning the context.
+	class Instrumentation
+	{
+	public:
+		enum class Counter
+		{
+			DrawCalls,
+			DrawCommands, // Multi draws count each command, those written by the GPU up to the maximum.
+			Triangles, // Instances included. Commands written by the GPU are counted as last uploaded by the CPU.
+			Dispatches,
+			StateChanges, // Bindings and capabilities actually issued.
+			UniformUploads,
+			BufferUploads,
+			BufferUploadBytes,
+			TextureUploads,
+			TextureUploadBytes,
+			CallNanoseconds, // CPU time spent in the counted calls.
+			Count
+		};
+		using Counters = std::array<std::uint64_t, std::size_t(Counter::Count)>;
+
+		static const char* get_name(const Counter counter);
+
+		static void add(const Counter counter, const std::uint64_t value);
+
+		// Ends the current frame, its counts become the last frame ones. No scope may be open.
+		static void next_frame();
+		static const Counters& get_frame();
+		static const Counters& get_last_frame();
+		static const std::map<std::string, Counters>& get_last_frame_scopes();
+
+		// Scopes are keyed by name, which should be unique among the open scopes. GpuProfiler scopes are also
+		// Instrumentation scopes, under their nested name.
+		static void begin_scope(const std::string& name);
+		static void end_scope();
+
+		// Last frame and scope counts as a JSON object.
+		static std::string to_json();
+	};
+
+	namespace impl
+	{
+		class InstrumentedCall
+		{
+		public:
+			explicit InstrumentedCall(std::initializer_list<std::pair<Instrumentation::Counter, std::uint64_t>> counts);
+			~InstrumentedCall();
+
+			InstrumentedCall(const InstrumentedCall&) = delete;
+			InstrumentedCall& operator=(const InstrumentedCall&) = delete;
+
+		private:
+			std::chrono::steady_clock::time_point m_start;
+		};
+	}
+
+	void set_enabled(const GLenum capability, const bool enabled);
+
 	class Buffer
 	{
 	public:
@@ -96,6 +386,12 @@ namespace picogl
 		template<typename T>
 		static Buffer make(const GLenum target, const std::vector<T>& values, const GLenum usage = GL_STATIC_DRAW);
 
+		// Immutable storage, mapped once for the whole lifetime of the buffer.
+		static Buffer make_persistent(
+			const GLenum target,
+			const GLsizeiptr size,
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+
 		void copy_to(Buffer& dst, const GLintptr to = 0) const;
 		void copy_to(Buffer& dst, const GLintptr to, const GLintptr from, const GLsizeiptr size) const;
 
@@ -106,17 +402,88 @@ namespace picogl
 
 		void upload_data(const void* data, const GLsizeiptr size = 0, const GLintptr offset = 0);
 		GLsizeiptr get_size() const;
+		void* get_mapped_data() const;
+		// See MemoryStats::set_label.
+		void set_label(const std::string& label) const;
+
+		// Temporary mapping of a range, the whole buffer by default.
+		void* map(const GLbitfield access, const GLintptr offset = 0, const GLsizeiptr size = 0);
+		void unmap();
 
 	private:
 		impl::GLObject<impl::GLObjectType::Buffer> m_gl;
 		GLenum m_target;
 		GLsizeiptr m_size;
+		void* m_mapped_data = nullptr;
+	};
+
+	// Persistently mapped buffer split in frame_count regions. Each frame, allocations are
+	// suballocated from the current region, which is only reused once the GPU is done with it.
+	class StreamBuffer
+	{
+	public:
+		struct Range
+		{
+			void bind(const GLenum target, const GLuint index) const;
+			void bind(const GLenum target) const;
+
+			char* m_data = nullptr;
+			GLuint m_buffer = 0;
+			GLintptr m_offset = 0;
+			GLsizeiptr m_size = 0;
+		};
+
+		static StreamBuffer make(const GLsizeiptr frame_size, const GLsizei frame_count = 3);
+
+		// Returns an empty range if the current frame region is full.
+		Range allocate(const GLsizeiptr size);
+
+		template<typename T>
+		Range upload(const std::vector<T>& values);
+
+		void next_frame();
+
+		operator GLuint() const;
+		GLsizeiptr frame_size() const;
+		GLsizei frame_count() const;
+
+	private:
+		Buffer m_buffer;
+		FenceRing m_fences;
+		GLsizeiptr m_frame_size = 0;
+		GLsizeiptr m_alignment = 1;
+		GLsizeiptr m_head = 0;
 	};
 
+	namespace impl
+	{
+		// Recycles persistently mapped buffers of a given kind, handing out the smallest fitting one.
+		class BufferPool
+		{
+		public:
+			BufferPool(const GLenum target, const GLbitfield flags, const std::size_t max_pooled_count = 8);
+
+			Buffer acquire(const GLsizeiptr size);
+			void release(Buffer&& buffer);
+
+		private:
+			std::vector<Buffer> m_buffers;
+			GLenum m_target;
+			GLbitfield m_flags;
+			std::size_t m_max_pooled_count;
+		};
+	}
+
 	class Shader
 	{
 	public:
 		static Shader make(const GLenum type, const std::string& code);
+		// Issues the compilation without waiting for it, finish must be called before querying the status.
+		static Shader make_async(const GLenum type, const std::string& code);
+
+		// Never blocks, always true without GL_KHR_parallel_shader_compile.
+		bool ready() const;
+		Shader& finish();
 
 		bool compiled() const;
 		const std::string& get_log() const;
@@ -126,12 +493,49 @@ namespace picogl
 		impl::GLObject<impl::GLObjectType::Shader> m_gl;
 		GLenum m_type;
 		std::string m_log;
+		bool m_pending = false;
 	};
 
 	class Program
 	{
 	public:
-		static Program make(const std::vector<std::reference_wrapper<const Shader>>& shaders);
+		// Active uniform, as reflected at link time. Uniforms from blocks are not listed.
+		struct Uniform
+		{
+			std::string m_name;
+			GLint m_location = -1;
+			GLenum m_type = {};
+			GLsizei m_array_size = 1;
+			GLuint m_value_offset = 0;
+			GLuint m_value_sizeof = 0;
+			// Only tracks what was last sent to GL.
+			mutable bool m_value_set = false;
+		};
+
+		// Active uniform block or shader storage block.
+		struct Block
+		{
+			std::string m_name;
+			GLuint m_index = 0;
+			GLint m_binding = 0;
+			GLint m_data_size = 0;
+		};
+
+		using UniformHandle = GLint;
+		static constexpr UniformHandle InvalidUniform = -1;
+
+		// A retrievable binary is required to later call get_binary.
+		static Program make(const std::vector<std::reference_wrapper<const Shader>>& shaders, const bool retrievable_binary = false);
+		// Fails to link if the binary was produced by another driver, the program should then be built from source.
+		static Program make_from_binary(const GLenum format, const void* binary, const GLsizei size);
+		// Issues the link without waiting for it, finish must be called before querying the status or uniforms.
+		static Program make_async(const std::vector<std::reference_wrapper<const Shader>>& shaders, const bool retrievable_binary = false);
+
+		// Never blocks, always true without GL_KHR_parallel_shader_compile.
+		bool ready() const;
+		Program& finish();
+
+		std::vector<char> get_binary(GLenum& format) const;
 
 		operator GLuint() const;
 		bool linked() const;
@@ -139,12 +543,137 @@ namespace picogl
 
 		void use() const;
 
+		// Raw glUniform* call on the program in use, the cached value of the uniform is dropped.
 		template<typename glUniformFunc, typename ...Args>
 		void set_uniform(const char* name, glUniformFunc&& f, Args&& ...args) const;
 
+		UniformHandle get_uniform_handle(const char* name) const;
+		GLint get_uniform_location(const char* name) const;
+		const std::vector<Uniform>& get_uniforms() const;
+		const std::vector<Block>& get_uniform_blocks() const;
+		const std::vector<Block>& get_storage_blocks() const;
+
+		// Typed setters, the upload is skipped when the value did not change since the last call.
+		// Bools are uploaded as GLint.
+		template<typename T>
+		void set(const UniformHandle handle, const T& value);
+		template<typename T>
+		void set(const char* name, const T& value);
+		template<typename T>
+		void set(const UniformHandle handle, const T* values, const GLsizei count);
+
 	private:
+		friend class CommandList;
+
+		bool check_link_status();
+		void reflect();
+		void set_value(const UniformHandle handle, const void* data, const GLuint data_sizeof, const GLsizei count);
+
 		impl::GLObject<impl::GLObjectType::Program> m_gl;
 		std::string m_log;
+		std::vector<Uniform> m_uniforms; // Sorted by name.
+		std::vector<Block> m_uniform_blocks;
+		std::vector<Block> m_storage_blocks;
+		std::vector<char> m_uniform_values;
+		bool m_pending = false;
+	};
+
+	// Sampling parameters decoupled from textures, several textures can share one sampler.
+	// Swizzling is not sampler state and stays on the texture.
+	class Sampler
+	{
+	public:
+		struct Parameters
+		{
+			bool operator==(const Parameters& rhs) const;
+
+			GLenum m_mag_filter = GL_LINEAR;
+			GLenum m_min_filter = GL_NEAREST_MIPMAP_LINEAR;
+			std::array<GLenum, 3> m_wrapping = { GL_REPEAT, GL_REPEAT, GL_REPEAT };
+			std::array<float, 4> m_border_color = {};
+			float m_min_lod = -1000.0f;
+			float m_max_lod = 1000.0f;
+			GLenum m_compare_mode = GL_NONE;
+			GLenum m_compare_func = GL_LEQUAL;
+		};
+
+		static Sampler make(const Parameters& parameters);
+
+		void bind(const GLuint unit) const;
+
+		const Parameters& parameters() const;
+		operator GLuint() const;
+
+	private:
+		impl::GLObject<impl::GLObjectType::Sampler> m_gl;
+		Parameters m_parameters;
+	};
+
+	// Deduplicates samplers by parameters. Beyond capacity, the least recently used sampler is destroyed, so that
+	// parameters edited live do not leak samplers. A returned reference stays valid until capacity other parameters are requested.
+	class SamplerCache
+	{
+	public:
+		static SamplerCache make(const std::size_t capacity);
+
+		const Sampler& get(const Sampler::Parameters& parameters);
+		std::size_t size() const;
+
+	private:
+		std::list<Sampler> m_samplers; // Most recently used first.
+		std::size_t m_capacity = 16;
+	};
+
+	class Texture;
+
+	// Ring of persistently mapped GL_PIXEL_UNPACK_BUFFERs used to stage texture uploads.
+	// Staging memory can be written from any thread, acquiring and uploading must happen on the GL thread.
+	class UploadPool
+	{
+		struct Slot
+		{
+			Buffer m_buffer;
+			Fence m_fence;
+			bool m_acquired = false;
+		};
+
+	public:
+		// Mapped staging memory, its slot is fenced and handed back to the pool once destroyed.
+		class Staging
+		{
+		public:
+			Staging();
+			Staging(Staging&& rhs) noexcept;
+			Staging& operator=(Staging&& rhs) noexcept;
+			~Staging();
+
+			void* data() const;
+			GLsizeiptr size() const;
+			// Includes the GL_UNPACK_ALIGNMENT padding, 0 if not acquired for a texture.
+			GLsizeiptr row_stride() const;
+			explicit operator bool() const;
+
+		private:
+			friend class UploadPool;
+			friend class Texture;
+
+			std::shared_ptr<std::vector<Slot>> m_slots;
+			std::size_t m_slot = 0;
+			void* m_data = nullptr;
+			GLsizeiptr m_size = 0;
+			GLsizeiptr m_row_stride = 0;
+		};
+
+		static UploadPool make(const GLsizei slot_count = 4);
+
+		// Waits for the GPU to be done with the oldest slot, which is reallocated if too small.
+		Staging acquire(const GLsizeiptr size);
+		// Sized for the base level of the texture, one layer or face for array and cube textures.
+		Staging acquire(const Texture& texture);
+
+	private:
+		std::shared_ptr<std::vector<Slot>> m_slots;
+		std::size_t m_next = 0;
 	};
 
 	class Texture
@@ -203,8 +732,11 @@ namespace picogl
 		Texture& set_alignment(const GLint pack = 1, const GLint unpack = 1);
 		Texture& set_border_color(const std::array<float, 4>& rgba);
 		Texture& upload_data(const void* data, GLuint level = 0, GLuint layer = 0, GLenum face = 0);
+		// Sources the upload from the staging buffer, which is released to its pool afterwards.
+		Texture& upload_data(UploadPool::Staging&& staging, GLuint level = 0, GLuint layer = 0, GLenum face = 0);
 
-		void bind_as_sampler(const GLuint slot = GL_TEXTURE0) const;
+		// Without a sampler, the texture own sampling state is used.
+		void bind_as_sampler(const GLuint slot = GL_TEXTURE0, const Sampler* sampler = nullptr) const;
 		void bind_as_image(
 			const GLuint unit,
 			const GLint level = 0,
@@ -223,6 +755,12 @@ namespace picogl
 		GLsizei lod_count_1D() const;
 		GLsizei lod_count_2D() const;
 		GLsizei lod_count_3D() const;
+		// Bytes of all allocated levels, layers and samples.
+		GLsizeiptr storage_size() const;
+		// Bytes of an upload_data call, which covers a single layer or face.
+		GLsizeiptr upload_size() const;
+		// See MemoryStats::set_label.
+		Texture& set_label(const std::string& label);
 
 		void generate_mipmap() const;
 
@@ -250,17 +788,51 @@ namespace picogl
 		GLsizei m_height = 0;
 		GLsizei m_depth = 0;
 		Options m_opts = Options::Default;
+
+		// Sampling state shadows, initialized to the GL defaults.
+		std::array<GLint, 4> m_swizzle = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+		std::array<GLenum, 3> m_wrapping = { GL_REPEAT, GL_REPEAT, GL_REPEAT };
+		std::array<GLenum, 2> m_filtering = { GL_LINEAR, GL_NEAREST_MIPMAP_LINEAR };
+		std::array<float, 4> m_border_color = {};
 	};
 	PICOGL_ENUM_CLASS_OPERATORS(Texture::Options);
 
 	class Framebuffer
 	{
 	public:
+		// Pending asynchronous readback, its buffer goes back to the framebuffer pool once destroyed.
+		class Readback
+		{
+		public:
+			Readback();
+			Readback(Readback&& rhs) noexcept;
+			Readback& operator=(Readback&& rhs) noexcept;
+			~Readback();
+
+			bool ready() const;
+			// Blocks until the readback is done if it is not ready yet.
+			const void* map() const;
+
+			GLsizei width() const;
+			GLsizei height() const;
+			explicit operator bool() const;
+
+		private:
+			friend class Framebuffer;
+
+			std::shared_ptr<impl::BufferPool> m_pool;
+			Buffer m_buffer;
+			Fence m_fence;
+			GLsizei m_width = 0;
+			GLsizei m_height = 0;
+		};
+
 		static Framebuffer make(const GLsizei width, const GLsizei height, const GLsizei sample_count = 1);
 		static Framebuffer get_default(const GLsizei width = 0, const GLsizei height = 0, const GLsizei sample_count = 1);
 		static Framebuffer make_from_texture(Texture&& texture);
 
-		Framebuffer& set_depth_attachment(const GLenum format = GL_DEPTH_COMPONENT32);
+		// A sampleable depth is a texture instead of a renderbuffer, e.g. to build a depth pyramid from it.
+		Framebuffer& set_depth_attachment(const GLenum format = GL_DEPTH_COMPONENT32, const bool sampleable = false);
 		Framebuffer& add_color_attachment(const GLenum internal_format, const GLenum target = GL_TEXTURE_2D, Texture::Options options = {});
 
 		void bind(const GLenum target = GL_FRAMEBUFFER) const;
@@ -275,6 +847,8 @@ namespace picogl
 
 		void readback(void* dst, GLint x, GLint y, GLsizei width, GLsizei height, GLenum attach_from = GL_COLOR_ATTACHMENT0) const;
 		void readback(void* dst, GLenum attach_from = GL_COLOR_ATTACHMENT0) const;
+		// The region must lie within the framebuffer, pixels outside of it would be left undefined in the pooled buffer.
+		Readback readback_async(GLint x, GLint y, GLsizei width, GLsizei height, GLenum attach_from = GL_COLOR_ATTACHMENT0) const;
 
 		void blit_to(
 			Framebuffer& to,
@@ -295,18 +869,24 @@ namespace picogl
 			GLint from_h,
 			const GLenum attachment_from = GL_COLOR_ATTACHMENT0) const;
 
+		// Also resolves multisampled depth.
+		void blit_depth_to(Framebuffer& to) const;
+
 		GLsizei sample_count() const;
 		GLsizei width() const;
 		GLsizei height() const;
 		const std::vector<Texture>& color_attachments() const;
+		const Texture& depth_texture() const;
 		GLuint depth_handle() const;
 		operator GLuint() const;
 
 	private:
 		impl::GLObject<impl::GLObjectType::Framebuffer> m_gl;
 		impl::GLObject<impl::GLObjectType::RenderBuffer> m_depth_attachment;
+		Texture m_depth_texture;
 		std::vector<Texture> m_color_attachments;
 		std::vector<GLenum> m_attachments;
+		mutable std::shared_ptr<impl::BufferPool> m_readback_pool;
 		GLsizei m_sample_count = 1;
 		GLsizei m_width = 0;
 		GLsizei m_height = 0;
@@ -327,13 +907,52 @@ namespace picogl
 			bool m_normalized = GL_FALSE;
 		};
 
+		// Matches the GL layout, for commands built elsewhere, e.g. on the GPU.
+		struct DrawElementsIndirectCommand
+		{
+			GLuint m_count;
+			GLuint m_instance_count;
+			GLuint m_first_index;
+			GLuint m_base_vertex;
+			GLuint m_base_instance;
+		};
+
+		// Index range of a level of detail, in indices from the start of the index buffer.
+		struct LodRange
+		{
+			GLuint m_first_index;
+			GLuint m_index_count;
+		};
+
+		enum class Layout
+		{
+			Interleaved,
+			// One stream and binding per attribute, streams can then be updated independently.
+			Separate,
+		};
+
 		static Mesh make();
+		// Only interleaved meshes can be combined. Indices are widened to the widest type of the meshes.
 		static Mesh combine(const std::vector<std::reference_wrapper<const Mesh>>& meshes);
 
+		// With narrow, GL_UNSIGNED_INT indices are stored as GL_UNSIGNED_SHORT when they all fit,
+		// halving the index buffer and the index fetch bandwidth.
 		template<typename Container>
-		Mesh& set_indices(const GLenum primitive_type, const Container& indices, const GLenum type = GL_UNSIGNED_INT);
-		Mesh& set_vertex_attributes(const std::vector<VertexAttribute>& attributes);
+		Mesh& set_indices(const GLenum primitive_type, const Container& indices, const GLenum type = GL_UNSIGNED_INT, const bool narrow = true);
+		// Coarser levels of a single submesh mesh, from finest to coarsest. They share its vertices and
+		// are appended to its index buffer, converted to its index type.
+		template<typename Container>
+		Mesh& set_lod_indices(const std::vector<Container>& lods, const GLenum type = GL_UNSIGNED_INT);
+		Mesh& set_vertex_attributes(const std::vector<VertexAttribute>& attributes, const Layout layout = Layout::Interleaved);
+		// Separate layout only, the attribute must match the one it replaces.
+		Mesh& update_vertex_attribute(const GLuint index, const VertexAttribute& attribute);
 		Mesh& set_instances_count(const std::vector<GLuint>& instances_count);
+		// Level drawn by each submesh, 0 being the full resolution one. Rewrites the indirect draws.
+		Mesh& set_lods(const std::vector<GLuint>& lods);
+		// Splits a single submesh without levels of detail into consecutive index ranges, e.g. meshlets.
+		// Each one becomes a submesh with its own indirect draw, all drawn by the same multi draw,
+		// so that they can be culled on the GPU by rewriting their instance counts.
+		Mesh& set_clusters(const std::vector<GLuint>& index_counts);
 
 		void draw() const;
 		void draw(GLenum primitive_type) const;
@@ -342,40 +961,236 @@ namespace picogl
 		operator GLuint() const;
 		GLsizei get_vertex_sizeof() const;
 		GLsizei get_submeshes_count() const;
+		// Including the full resolution level.
+		GLsizei get_lod_count(const GLsizei submesh = 0) const;
+		GLenum get_index_type() const;
+		// One DrawElementsIndirectCommand per submesh, empty until instance counts, levels or clusters are set.
+		const Buffer& get_indirect_draw_buffer() const;
 
 	private:
+		friend class MeshPool;
+
 		struct SubMesh
 		{
 			GLuint m_index_count;
 			GLuint m_indice_offset;
 			GLuint m_first_index;
+			std::vector<LodRange> m_lods; // Coarser levels only.
 		};
 
-		struct DrawElementsIndirectCommand
-		{
-			GLuint m_count;
-			GLuint m_instance_count;
-			GLuint m_first_index;
-			GLuint m_base_vertex;
-			GLuint m_base_instance;
-		};
+		void update_draws();
+		GLsizeiptr get_total_index_count() const;
+		// Of the indirect draws as last written by update_draws.
+		std::uint64_t get_indirect_triangle_count(const GLenum primitive_type) const;
 
-		void set_vertex_attribute(std::vector<char>& vertex_data, GLuint& index, std::size_t& offset,
-			const GLsizei stride, const VertexAttribute& attribute);
+		// GPU copy when the types match, otherwise read back and converted to the wider dst_type. Offsets and count are in indices.
+		static void copy_indices(const Buffer& src, const GLenum src_type, const GLintptr from, Buffer& dst, const GLenum dst_type, const GLintptr to, const GLsizeiptr count);
 
-		void setup_attribute_pointer(const GLuint index, const std::size_t offset, const GLsizei stride, const VertexAttribute& attribute);
+		void setup_attribute_pointer(const GLuint index, const GLuint binding, const std::size_t offset, const GLsizei stride, const VertexAttribute& attribute);
+		bool has_same_layout(const Mesh& other) const;
 
 		impl::GLObject<impl::GLObjectType::VertexArray> m_vao;
 		Buffer m_index_buffer;
-		Buffer m_vertex_buffer; // Vertex data is interleaved.
+		Buffer m_vertex_buffer; // Interleaved, or one stream per attribute.
 		Buffer m_indirect_draw_buffer;
 		GLenum m_primitive_type = {};
 		GLenum m_indice_type = {};
 		GLsizei m_index_count = 0;
 		GLsizei m_vertex_count = 0;
 		std::vector<VertexAttribute> m_vertex_attributes;
+		std::vector<GLintptr> m_stream_offsets;
+		Layout m_layout = Layout::Interleaved;
 		std::vector<SubMesh> m_submeshes;
 		std::vector<GLuint> m_instances_count = { 1 };
+		std::vector<GLuint> m_lods;
+	};
+
+	namespace impl
+	{
+		// First fit allocator over [0, capacity), freed ranges are merged with their neighbours.
+		class RangeAllocator
+		{
+		public:
+			static constexpr GLsizeiptr Invalid = -1;
+
+			explicit RangeAllocator(const GLsizeiptr capacity = 0);
+
+			GLsizeiptr allocate(const GLsizeiptr size);
+			void free(const GLsizeiptr offset, const GLsizeiptr size);
+			void grow(const GLsizeiptr capacity);
+			GLsizeiptr capacity() const;
+
+		private:
+			std::map<GLsizeiptr, GLsizeiptr> m_free_ranges; // Offset to size.
+			GLsizeiptr m_capacity = 0;
+		};
+	}
+
+	// Meshes sharing a vertex layout, suballocated from growable vertex, index and draw arenas behind a single VAO.
+	// Adding or removing a mesh only touches its own ranges, and the whole pool is drawn with one indirect multi-draw.
+	class MeshPool
+	{
+	public:
+		using Handle = std::size_t;
+
+		// Capacities are in vertices, indices and draws, the arenas grow on demand.
+		static MeshPool make(const GLsizeiptr vertex_capacity = 1 << 16, const GLsizeiptr index_capacity = 1 << 18, const GLsizeiptr draw_capacity = 64);
+
+		// Copies the mesh buffers into the pool, the source mesh can be released afterwards.
+		// The index arena takes the type of the first mesh, and is widened when a mesh needs more bits.
+		Handle add(const Mesh& mesh);
+		void remove(const Handle handle);
+		void set_instances_count(const Handle handle, const std::vector<GLuint>& instances_count);
+		// Level drawn by each submesh of the mesh, 0 being the full resolution one. Only its draws are rewritten.
+		void set_lods(const Handle handle, const std::vector<GLuint>& lods);
+
+		void draw() const;
+		// Draws the pool geometry with external commands, e.g. written by a culling pass. With a draw_count
+		// buffer, the count is read from its first GLuint and max_draw_count is an upper bound (GL 4.6).
+		void draw_indirect(const Buffer& draws, const GLsizei max_draw_count, const Buffer* draw_count = nullptr) const;
+
+		// Draw commands of the whole pool as uploaded, at the levels set. The first get_draw_count() ones are in use.
+		const std::vector<Mesh::DrawElementsIndirectCommand>& get_draws() const;
+		// Levels of a draw from the full resolution one, with indices relative to the pool index arena.
+		// Empty for the draws of removed meshes.
+		const std::vector<Mesh::LodRange>& get_lods(const GLsizei draw) const;
+		// Draw id of the first submesh of the mesh, as seen by gl_DrawID. Stable while the mesh lives.
+		GLsizei get_first_draw(const Handle handle) const;
+		GLsizei get_submeshes_count(const Handle handle) const;
+		// Upper bound of the draw ids, removed meshes leave empty draws behind.
+		GLsizei get_draw_count() const;
+		std::size_t get_mesh_count() const;
+
+	private:
+		struct Entry
+		{
+			GLsizeiptr m_first_vertex = impl::RangeAllocator::Invalid;
+			GLsizeiptr m_vertex_count = 0;
+			GLsizeiptr m_first_index = impl::RangeAllocator::Invalid;
+			GLsizeiptr m_index_count = 0;
+			GLsizeiptr m_first_draw = impl::RangeAllocator::Invalid;
+			std::vector<Mesh::SubMesh> m_submeshes;
+			std::vector<GLuint> m_lods; // Empty while all submeshes draw their full resolution.
+		};
+
+		GLsizeiptr allocate(impl::RangeAllocator& allocator, Buffer& buffer, const GLenum target, const GLsizeiptr count, const GLsizeiptr element_sizeof);
+		GLsizeiptr allocate_draws(const GLsizeiptr count);
+		void attach_buffers();
+		// Converts the whole index arena to a wider type, first indices are unchanged.
+		void widen_indices(const GLenum type);
+		void upload_draws(const Entry& entry, const std::vector<GLuint>& instances_count);
+		// Of the draws in use, as uploaded.
+		std::uint64_t get_triangle_count() const;
+
+		Mesh m_mesh; // Owns the VAO, the arenas and the shared layout.
+		impl::RangeAllocator m_vertex_ranges;
+		impl::RangeAllocator m_index_ranges;
+		impl::RangeAllocator m_draw_ranges;
+		std::vector<Mesh::DrawElementsIndirectCommand> m_draws;
+		std::vector<std::vector<Mesh::LodRange>> m_draw_lods;
+		GLsizei m_draw_count = 0;
+		std::vector<Entry> m_entries;
+		std::vector<Handle> m_free_handles;
+	};
+
+	// Commands recorded into a linear arena without any GL call, so that worker threads can each fill their own list.
+	// Lists are then replayed in submission order on the thread owning the context. Objects are referenced, not copied,
+	// and must outlive the replay. Uniform values are copied when recorded.
+	class CommandList
+	{
+	public:
+		// Initial arena size in bytes, it doubles when full and is kept by clear().
+		static CommandList make(const std::size_t capacity = 1 << 16);
+
+		void use_program(Program& program);
+		// Same checks and value cache as Program::set, applied at replay. Invalid handles record nothing.
+		template<typename T>
+		void set(Program& program, const Program::UniformHandle handle, const T& value);
+		template<typename T>
+		void set(Program& program, const char* name, const T& value);
+		template<typename T>
+		void set(Program& program, const Program::UniformHandle handle, const T* values, const GLsizei count);
+		// A size of 0 binds the whole buffer.
+		void bind_buffer_range(const GLenum target, const GLuint index, const Buffer& buffer, const GLintptr offset = 0, const GLsizeiptr size = 0);
+		void bind_ssbo(const GLuint index, const Buffer& buffer, const GLintptr offset = 0, const GLsizeiptr size = 0);
+		void draw(const Mesh& mesh);
+		void draw(const Mesh& mesh, const GLenum primitive_type);
+		void draw(const MeshPool& pool);
+		void draw_indirect(const MeshPool& pool, const Buffer& draws, const GLsizei max_draw_count, const Buffer* draw_count = nullptr);
+
+		// From the thread owning the context.
+		void replay() const;
+		void clear();
+
+		bool empty() const;
+		std::size_t command_count() const;
+		std::size_t size() const;
+
+	private:
+		enum class Type : std::uint32_t
+		{
+			UseProgram,
+			SetUniform,
+			BindBufferRange,
+			DrawMesh,
+			DrawMeshPool,
+			DrawMeshPoolIndirect,
+		};
+
+		// Followed by the command, then by its extra data, each padded to Alignment.
+		struct Header
+		{
+			Type m_type;
+			std::uint32_t m_size; // Of the whole command, header included.
+		};
+
+		struct UseProgramCommand
+		{
+			Program* m_program;
+		};
+
+		// Followed by the values.
+		struct SetUniformCommand
+		{
+			Program* m_program;
+			Program::UniformHandle m_handle;
+			GLuint m_value_sizeof;
+			GLsizei m_count;
+		};
+
+		struct BindBufferRangeCommand
+		{
+			GLenum m_target;
+			GLuint m_index;
+			GLuint m_buffer;
+			GLintptr m_offset;
+			GLsizeiptr m_size;
+		};
+
+		struct DrawMeshCommand
+		{
+			const Mesh* m_mesh;
+			GLenum m_primitive_type;
+			bool m_mesh_primitive;
+		};
+
+		struct DrawMeshPoolCommand
+		{
+			const MeshPool* m_pool;
+			const Buffer* m_draws; // Indirect only.
+			const Buffer* m_draw_count;
+			GLsizei m_max_draw_count;
+		};
+
+		static constexpr std::size_t Alignment = 8;
+
+		template<typename Command>
+		void record(const Type type, const Command& command, const void* extra = nullptr, const std::size_t extra_size = 0);
+		void set_value(Program& program, const Program::UniformHandle handle, const void* data, const GLuint data_sizeof, const GLsizei count);
+
+		std::vector<char> m_arena;
+		std::size_t m_size = 0;
+		std::size_t m_command_count = 0;
 	};
 
 	class Query
@@ -389,6 +1204,10 @@ namespace picogl
 		template<typename T>
 		void get(T& t, const GLenum type = GL_QUERY_RESULT_NO_WAIT);
 
+		// GL_TIMESTAMP queries only, records the GPU time once all previous commands are done.
+		void timestamp() const;
+		bool available() const;
+
 		operator GLuint() const;
 
 	protected:
@@ -396,25 +1215,123 @@ namespace picogl
 		GLenum m_target = {};
 	};
 
-	namespace impl
+	// Timings of named and nested GPU scopes, from pairs of GL_TIMESTAMP queries. Each frame records
+	// into its own set of queries, read back frame_count frames later so that collecting never stalls.
+	// If the GPU is further behind, the ring grows rather than waiting or dropping samples.
+	class GpuProfiler
 	{
-		template<>
-		inline void gl_creator<GLObjectType::Buffer>(GLuint* gl) {
-			glCreateBuffers(1, gl);
-		}
+	public:
+		struct ScopeStats
+		{
+			std::string m_name; // Including the enclosing scopes, e.g. "modeler/multi_draw".
+			GLuint m_depth = 0;
+			// Over the history, a scope entered several times in a frame counts as a single sample.
+			float m_last_ms = 0.0f;
+			float m_min_ms = 0.0f;
+			float m_avg_ms = 0.0f;
+			float m_p95_ms = 0.0f;
+			std::vector<float> m_history_ms; // Ring, m_history_ms[m_next] is the oldest sample once full.
+			std::size_t m_next = 0;
+		};
 
-		template<>
+		// Raw GPU timestamps, in nanoseconds.
+		struct Event
+		{
+			std::size_t m_scope; // Index in get_scopes().
+			GLuint64 m_begin_ns;
+			GLuint64 m_end_ns;
+		};
+
+		// Starts a scope with the current profiler, if it is recording a frame.
+		class Scope
+		{
+		public:
+			explicit Scope(const std::string& name);
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			GpuProfiler* m_profiler = nullptr;
+		};
+
+		static GpuProfiler* get_current();
+		static void set_current(GpuProfiler* profiler);
+
+		static GpuProfiler make(const GLsizei frame_count = 4, const std::size_t history_size = 128);
+
+		// Collects the timings of the frame being reused before recording into it.
+		void begin_frame();
+		void end_frame();
+
+		void begin_scope(const std::string& name);
+		void end_scope();
+
+		// In order of first use.
+		const std::vector<ScopeStats>& get_scopes() const;
+		const ScopeStats* find_scope(const std::string& name) const;
+		// Scopes of the frame collected by the last begin_frame, if any.
+		const std::vector<Event>& get_collected_events() const;
+
+	private:
+		struct Record
+		{
+			std::size_t m_scope;
+			std::size_t m_begin_query;
+			std::size_t m_end_query;
+		};
+
+		struct Frame
+		{
+			std::vector<Query> m_queries;
+			std::size_t m_query_count = 0;
+			std::vector<Record> m_records;
+		};
+
+		std::size_t record_timestamp(Frame& frame);
+		// Returns false if some queries are not available yet.
+		bool collect(Frame& frame);
+		void add_sample(ScopeStats& scope, const float ms);
+
+		std::vector<Frame> m_frames;
+		std::size_t m_frame = 0;
+		std::size_t m_history_size = 0;
+		std::vector<ScopeStats> m_scopes;
+		std::unordered_map<std::string, std::size_t> m_scope_indices;
+		std::vector<std::size_t> m_open_records; // Of the current frame.
+		std::vector<double> m_frame_ms; // Per scope, negative if not entered.
+		std::vector<Event> m_collected_events;
+		bool m_recording = false;
+	};
+
+	namespace impl
+	{
+		template<>
+		inline void gl_creator<GLObjectType::Buffer>(GLuint* gl) {
+			glCreateBuffers(1, gl);
+		}
+
+		template<>
 		inline void gl_deleter<GLObjectType::Buffer>(const GLuint* gl) {
+			if (StateCache* cache = StateCache::get_current())
+				cache->forget(GLObjectType::Buffer, *gl);
 			glDeleteBuffers(1, gl);
 		}
 
 		template<>
 		inline void gl_creator<GLObjectType::Framebuffer>(GLuint* gl) {
+#if PICOGL_USE_DSA
+			glCreateFramebuffers(1, gl);
+#else
 			glGenFramebuffers(1, gl);
+#endif
 		}
 
 		template<>
 		inline void gl_deleter<GLObjectType::Framebuffer>(const GLuint* gl) {
+			if (StateCache* cache = StateCache::get_current())
+				cache->forget(GLObjectType::Framebuffer, *gl);
 			glDeleteFramebuffers(1, gl);
 		}
 
@@ -435,12 +1352,18 @@ namespace picogl
 
 		template<>
 		inline void gl_deleter<GLObjectType::Program>(const GLuint* gl) {
+			if (StateCache* cache = StateCache::get_current())
+				cache->forget(GLObjectType::Program, *gl);
 			glDeleteProgram(*gl);
 		}
 
 		template<>
 		inline void gl_creator<GLObjectType::RenderBuffer>(GLuint* gl) {
+#if PICOGL_USE_DSA
+			glCreateRenderbuffers(1, gl);
+#else
 			glGenRenderbuffers(1, gl);
+#endif
 		}
 
 		template<>
@@ -448,6 +1371,22 @@ namespace picogl
 			glDeleteRenderbuffers(1, gl);
 		}
 
+		template<>
+		inline void gl_creator<GLObjectType::Sampler>(GLuint* gl) {
+#if PICOGL_USE_DSA
+			glCreateSamplers(1, gl);
+#else
+			glGenSamplers(1, gl);
+#endif
+		}
+
+		template<>
+		inline void gl_deleter<GLObjectType::Sampler>(const GLuint* gl) {
+			if (StateCache* cache = StateCache::get_current())
+				cache->forget(GLObjectType::Sampler, *gl);
+			glDeleteSamplers(1, gl);
+		}
+
 		template<>
 		inline void gl_creator<GLObjectType::Shader, GLenum>(GLuint* gl, const GLenum shader_type) {
 			*gl = glCreateShader(shader_type);
@@ -459,22 +1398,35 @@ namespace picogl
 		}
 
 		template<>
-		inline void gl_creator<GLObjectType::Texture>(GLuint* gl) {
+		inline void gl_creator<GLObjectType::Texture, GLenum>(GLuint* gl, const GLenum target) {
+#if PICOGL_USE_DSA
+			glCreateTextures(target, 1, gl);
+#else
+			(void)target;
 			glGenTextures(1, gl);
+#endif
 		}
 
 		template<>
 		inline void gl_deleter<GLObjectType::Texture>(const GLuint* gl) {
+			if (StateCache* cache = StateCache::get_current())
+				cache->forget(GLObjectType::Texture, *gl);
 			glDeleteTextures(1, gl);
 		}
 
 		template<>
 		inline void gl_creator<GLObjectType::VertexArray>(GLuint* gl) {
+#if PICOGL_USE_DSA
+			glCreateVertexArrays(1, gl);
+#else
 			glGenVertexArrays(1, gl);
+#endif
 		}
 
 		template<>
 		inline void gl_deleter<GLObjectType::VertexArray>(const GLuint* gl) {
+			if (StateCache* cache = StateCache::get_current())
+				cache->forget(GLObjectType::VertexArray, *gl);
 			glDeleteVertexArrays(1, gl);
 		}
 
@@ -503,8 +1455,11 @@ namespace picogl
 		template<GLObjectType Type>
 		inline GLObject<Type>::~GLObject()
 		{
-			if (m_id)
+			if (m_id) {
+				if (MemoryRegistry::is_tracked(Type))
+					MemoryRegistry::get().release(Type, m_id);
 				gl_deleter<Type>(&m_id);
+			}
 		}
 
 		template<GLObjectType Type>
@@ -521,6 +1476,17 @@ namespace picogl
 		{
 			return GLuint(container.size() * sizeof(typename Container::value_type));
 		}
+
+		template<typename T>
+		bool skip_unchanged(T& shadow, const T& value)
+		{
+			StateCache* cache = StateCache::get_current();
+			const bool unchanged = cache && shadow == value;
+			shadow = value;
+			if (cache)
+				cache->count(!unchanged);
+			return unchanged;
+		}
 	}
 
 	template<typename Container>
@@ -533,7 +1499,7 @@ namespace picogl
 	}
 
 	template<typename Container>
-	Mesh& Mesh::set_indices(const GLenum primitive_type, const Container& indices, const GLenum type)
+	Mesh& Mesh::set_indices(const GLenum primitive_type, const Container& indices, const GLenum type, const bool narrow)
 	{
 		const GLuint type_sizeof = impl::get_scalar_sizeof(type);
 		const GLuint indice_sizeof = sizeof(typename Container::value_type);
@@ -542,25 +1508,171 @@ namespace picogl
 		PICOGL_ASSERT(!indices.empty());
 		PICOGL_ASSERT(indice_sizeof % type_sizeof == 0);
 
-		m_index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, indices, GL_STATIC_DRAW);
-		m_indice_type = type;
+		const GLsizei index_count = static_cast<GLsizei>(indices.size() * (indice_sizeof / type_sizeof));
+		// Byte indices are not narrowed to, some hardware has no native support for them.
+		if (narrow && type == GL_UNSIGNED_INT && impl::get_max_index(indices.data(), type, index_count) <= 0xFFFF) {
+			std::vector<GLushort> narrowed(index_count);
+			impl::convert_indices(indices.data(), type, narrowed.data(), GL_UNSIGNED_SHORT, narrowed.size());
+			m_index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, narrowed, GL_STATIC_DRAW);
+			m_indice_type = GL_UNSIGNED_SHORT;
+		} else {
+			m_index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, indices, GL_STATIC_DRAW);
+			m_indice_type = type;
+		}
+#if PICOGL_USE_DSA
+		glVertexArrayElementBuffer(m_vao, m_index_buffer);
+#endif
 		m_primitive_type = primitive_type;
-		m_index_count = static_cast<GLsizei>(indices.size() * (indice_sizeof / type_sizeof));
+		m_index_count = index_count;
 
 		SubMesh submesh;
 		submesh.m_first_index = 0;
-		submesh.m_index_count = static_cast<GLsizei>(indices.size() * (indice_sizeof / type_sizeof));
+		submesh.m_index_count = index_count;
 		submesh.m_indice_offset = 0;
 		m_submeshes = { submesh };
+		m_lods.clear();
+
+		return *this;
+	}
+
+	template<typename Container>
+	Mesh& Mesh::set_lod_indices(const std::vector<Container>& lods, const GLenum type)
+	{
+		PICOGL_ASSERT(m_index_buffer && m_submeshes.size() == 1);
+		const GLuint type_sizeof = impl::get_scalar_sizeof(type);
+		const GLuint indice_sizeof = sizeof(typename Container::value_type);
+		const GLuint dst_type_sizeof = impl::get_scalar_sizeof(m_indice_type);
+		PICOGL_ASSERT(indice_sizeof % type_sizeof == 0);
+
+		// Previous levels are replaced, the full resolution indices are kept as is.
+		SubMesh& submesh = m_submeshes.front();
+		const GLsizeiptr base_count = submesh.m_index_count;
+		GLsizeiptr total_count = base_count;
+		for (const Container& lod : lods)
+			total_count += impl::get_data_size(lod) / type_sizeof;
+
+		Buffer index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, total_count * dst_type_sizeof);
+		m_index_buffer.copy_to(index_buffer, 0, 0, base_count * dst_type_sizeof);
+
+		submesh.m_lods.clear();
+		GLsizeiptr first_index = base_count;
+		std::vector<char> converted;
+		for (const Container& lod : lods) {
+			PICOGL_ASSERT(!lod.empty());
+			const GLsizeiptr count = impl::get_data_size(lod) / type_sizeof;
+			const void* data = lod.data();
+			if (type != m_indice_type) {
+				// Levels only use vertices of the full resolution one, which fit its type.
+				PICOGL_ASSERT(dst_type_sizeof >= type_sizeof || impl::get_max_index(data, type, count) < (GLuint(1) << (8 * dst_type_sizeof)));
+				converted.resize(count * dst_type_sizeof);
+				impl::convert_indices(data, type, converted.data(), m_indice_type, count);
+				data = converted.data();
+			}
+			index_buffer.upload_data(data, count * dst_type_sizeof, first_index * dst_type_sizeof);
+			submesh.m_lods.push_back({ GLuint(first_index), GLuint(count) });
+			first_index += count;
+		}
 
+		m_index_buffer = std::move(index_buffer);
+#if PICOGL_USE_DSA
+		glVertexArrayElementBuffer(m_vao, m_index_buffer);
+#endif
+		if (m_indirect_draw_buffer)
+			update_draws();
 		return *this;
 	}
+
+	template<typename T>
+	void Program::set(const UniformHandle handle, const T& value)
+	{
+		if constexpr (std::is_same_v<T, bool>) {
+			const GLint v = value;
+			set_value(handle, &v, sizeof(GLint), 1);
+		} else
+			set_value(handle, &value, sizeof(T), 1);
+	}
+
+	template<typename T>
+	void Program::set(const char* name, const T& value)
+	{
+		set(get_uniform_handle(name), value);
+	}
+
+	template<typename T>
+	void Program::set(const UniformHandle handle, const T* values, const GLsizei count)
+	{
+		if constexpr (std::is_same_v<T, bool>) {
+			const std::vector<GLint> v(values, values + count);
+			set_value(handle, v.data(), sizeof(GLint), count);
+		} else
+			set_value(handle, values, sizeof(T), count);
+	}
+
+	template<typename T>
+	void CommandList::set(Program& program, const Program::UniformHandle handle, const T& value)
+	{
+		if constexpr (std::is_same_v<T, bool>) {
+			const GLint v = value;
+			set_value(program, handle, &v, sizeof(GLint), 1);
+		} else
+			set_value(program, handle, &value, sizeof(T), 1);
+	}
+
+	template<typename T>
+	void CommandList::set(Program& program, const char* name, const T& value)
+	{
+		set(program, program.get_uniform_handle(name), value);
+	}
+
+	template<typename T>
+	void CommandList::set(Program& program, const Program::UniformHandle handle, const T* values, const GLsizei count)
+	{
+		if constexpr (std::is_same_v<T, bool>) {
+			const std::vector<GLint> v(values, values + count);
+			set_value(program, handle, v.data(), sizeof(GLint), count);
+		} else
+			set_value(program, handle, values, sizeof(T), count);
+	}
+
+	template<typename Command>
+	void CommandList::record(const Type type, const Command& command, const void* extra, const std::size_t extra_size)
+	{
+		static_assert(std::is_trivially_copyable_v<Command> && alignof(Command) <= Alignment);
+		const auto align = [](const std::size_t size) { return (size + Alignment - 1) & ~(Alignment - 1); };
+		const std::size_t command_offset = align(sizeof(Header));
+		const std::size_t extra_offset = command_offset + align(sizeof(Command));
+		const std::size_t size = extra_offset + align(extra_size);
+
+		if (m_size + size > m_arena.size())
+			m_arena.resize(std::max(2 * m_arena.size(), m_size + size));
+
+		char* data = m_arena.data() + m_size;
+		const Header header = { type, std::uint32_t(size) };
+		std::memcpy(data, &header, sizeof(Header));
+		std::memcpy(data + command_offset, &command, sizeof(Command));
+		if (extra_size)
+			std::memcpy(data + extra_offset, extra, extra_size);
+		m_size += size;
+		++m_command_count;
+	}
+
 	template<typename T>
 	inline Buffer Buffer::make(const GLenum target, const std::vector<T>& values, const GLenum usage)
 	{
 		return Buffer::make(target, impl::get_data_size(values), values.data(), usage);
 	}
 
+	template<typename T>
+	StreamBuffer::Range StreamBuffer::upload(const std::vector<T>& values)
+	{
+		const Range range = allocate(impl::get_data_size(values));
+		if (range.m_data) {
+			PICOGL_INSTRUMENT_UPLOAD(Buffer, range.m_size);
+			std::memcpy(range.m_data, values.data(), range.m_size);
+		}
+		return range;
+	}
+
 	template<typename T>
 	void Framebuffer::clear(GLenum buffer, const std::array<T, 4>& rgba, GLint attachement_index) const
 	{
@@ -637,6 +1749,13 @@ namespace picogl
 				{ GL_RGB32F, { GL_RGB32F, GL_RGB, GL_FLOAT, 3 } },
 				{ GL_RGBA8, { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 } },
 				{ GL_RGBA32F, { GL_RGBA32F, GL_RGBA, GL_FLOAT, 4 } },
+				{ GL_DEPTH_COMPONENT16, { GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, 1 } },
+				{ GL_DEPTH_COMPONENT24, { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 1 } },
+				{ GL_DEPTH_COMPONENT32, { GL_DEPTH_COMPONENT32, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 1 } },
+				{ GL_DEPTH_COMPONENT32F, { GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 1 } },
+				{ GL_DEPTH24_STENCIL8, { GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 1 } },
+				{ GL_DEPTH32F_STENCIL8, { GL_DEPTH32F_STENCIL8, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, 1 } },
+				{ GL_STENCIL_INDEX8, { GL_STENCIL_INDEX8, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, 1 } },
 			};
 
 			return gl_pixel_infos.at(internal_format);
@@ -655,10 +1774,293 @@ namespace picogl
 				{ GL_HALF_FLOAT, 2 },
 				{ GL_FLOAT, 4 },
 				{ GL_DOUBLE, 8 },
+				// Packed depth and stencil.
+				{ GL_UNSIGNED_INT_24_8, 4 },
+				{ GL_FLOAT_32_UNSIGNED_INT_24_8_REV, 8 },
 			};
 
 			return gl_scalar_type_sizeofs.at(type);
 		}
+
+		inline std::uint64_t get_triangle_count(const GLenum primitive_type, const GLuint vertex_count)
+		{
+			switch (primitive_type) {
+			case GL_TRIANGLES: return vertex_count / 3;
+			case GL_TRIANGLE_STRIP:
+			case GL_TRIANGLE_FAN: return vertex_count > 2 ? vertex_count - 2 : 0;
+			default: return 0;
+			}
+		}
+
+		inline GLuint get_max_index(const void* indices, const GLenum type, const std::size_t count)
+		{
+			GLuint max_index = 0;
+			for (std::size_t i = 0; i < count; ++i) {
+				switch (type)
+				{
+				case GL_UNSIGNED_BYTE: max_index = std::max<GLuint>(max_index, static_cast<const GLubyte*>(indices)[i]); break;
+				case GL_UNSIGNED_SHORT: max_index = std::max<GLuint>(max_index, static_cast<const GLushort*>(indices)[i]); break;
+				case GL_UNSIGNED_INT: max_index = std::max<GLuint>(max_index, static_cast<const GLuint*>(indices)[i]); break;
+				default: PICOGL_ASSERT(false); return 0;
+				}
+			}
+			return max_index;
+		}
+
+		template<typename Src, typename Dst>
+		void convert_indices(const Src* src, Dst* dst, const std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				dst[i] = static_cast<Dst>(src[i]);
+		}
+
+		template<typename Src>
+		void convert_indices(const Src* src, void* dst, const GLenum dst_type, const std::size_t count)
+		{
+			switch (dst_type)
+			{
+			case GL_UNSIGNED_BYTE: convert_indices(src, static_cast<GLubyte*>(dst), count); break;
+			case GL_UNSIGNED_SHORT: convert_indices(src, static_cast<GLushort*>(dst), count); break;
+			case GL_UNSIGNED_INT: convert_indices(src, static_cast<GLuint*>(dst), count); break;
+			default: PICOGL_ASSERT(false);
+			}
+		}
+
+		inline void convert_indices(const void* src, const GLenum src_type, void* dst, const GLenum dst_type, const std::size_t count)
+		{
+			switch (src_type)
+			{
+			case GL_UNSIGNED_BYTE: convert_indices(static_cast<const GLubyte*>(src), dst, dst_type, count); break;
+			case GL_UNSIGNED_SHORT: convert_indices(static_cast<const GLushort*>(src), dst, dst_type, count); break;
+			case GL_UNSIGNED_INT: convert_indices(static_cast<const GLuint*>(src), dst, dst_type, count); break;
+			default: PICOGL_ASSERT(false);
+			}
+		}
+
+		inline GLuint get_attribute_sizeof(const GLenum type, const GLsizei channel_count)
+		{
+			switch (type)
+			{
+			case GL_INT_2_10_10_10_REV:
+			case GL_UNSIGNED_INT_2_10_10_10_REV:
+			case GL_UNSIGNED_INT_10F_11F_11F_REV:
+				return 4;
+			default:
+				return channel_count * get_scalar_sizeof(type);
+			}
+		}
+
+		// Fixed size so the copy compiles down to plain loads and stores.
+		template<std::size_t N>
+		void copy_strided_fixed(char* dst, const std::size_t dst_stride, const char* src, const std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i, dst += dst_stride, src += N)
+				std::memcpy(dst, src, N);
+		}
+
+		inline void copy_strided_range(char* dst, const std::size_t dst_stride, const char* src, const std::size_t element_sizeof, const std::size_t count)
+		{
+			switch (element_sizeof)
+			{
+			case 4:
+				copy_strided_fixed<4>(dst, dst_stride, src, count);
+				break;
+			case 8:
+				copy_strided_fixed<8>(dst, dst_stride, src, count);
+				break;
+			case 12:
+				copy_strided_fixed<12>(dst, dst_stride, src, count);
+				break;
+			case 16:
+				copy_strided_fixed<16>(dst, dst_stride, src, count);
+				break;
+			default:
+				for (std::size_t i = 0; i < count; ++i, dst += dst_stride, src += element_sizeof)
+					std::memcpy(dst, src, element_sizeof);
+				break;
+			}
+		}
+
+		inline void copy_strided(char* dst, const std::size_t dst_stride, const char* src, const std::size_t element_sizeof, const std::size_t count)
+		{
+			// Below this, spawning threads costs more than the copy itself.
+			constexpr std::size_t min_count_per_thread = 1 << 16;
+			const std::size_t max_thread_count = std::max(1u, std::thread::hardware_concurrency());
+			const std::size_t thread_count = std::min(max_thread_count, count / min_count_per_thread);
+			if (thread_count <= 1) {
+				copy_strided_range(dst, dst_stride, src, element_sizeof, count);
+				return;
+			}
+
+			std::vector<std::thread> threads;
+			threads.reserve(thread_count - 1);
+			const std::size_t chunk = (count + thread_count - 1) / thread_count;
+			for (std::size_t first = chunk; first < count; first += chunk) {
+				const std::size_t chunk_count = std::min(chunk, count - first);
+				threads.emplace_back(copy_strided_range, dst + first * dst_stride, dst_stride, src + first * element_sizeof, element_sizeof, chunk_count);
+			}
+			copy_strided_range(dst, dst_stride, src, element_sizeof, std::min(chunk, count));
+
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+
+		inline GLuint get_uniform_sizeof(const GLenum type)
+		{
+			static const std::unordered_map<GLenum, GLuint> gl_uniform_type_sizeofs = {
+				{ GL_FLOAT, 4 },
+				{ GL_FLOAT_VEC2, 8 },
+				{ GL_FLOAT_VEC3, 12 },
+				{ GL_FLOAT_VEC4, 16 },
+				{ GL_INT, 4 },
+				{ GL_INT_VEC2, 8 },
+				{ GL_INT_VEC3, 12 },
+				{ GL_INT_VEC4, 16 },
+				{ GL_UNSIGNED_INT, 4 },
+				{ GL_UNSIGNED_INT_VEC2, 8 },
+				{ GL_UNSIGNED_INT_VEC3, 12 },
+				{ GL_UNSIGNED_INT_VEC4, 16 },
+				{ GL_BOOL, 4 },
+				{ GL_BOOL_VEC2, 8 },
+				{ GL_BOOL_VEC3, 12 },
+				{ GL_BOOL_VEC4, 16 },
+				{ GL_FLOAT_MAT2, 16 },
+				{ GL_FLOAT_MAT3, 36 },
+				{ GL_FLOAT_MAT4, 64 },
+				{ GL_FLOAT_MAT2x3, 24 },
+				{ GL_FLOAT_MAT2x4, 32 },
+				{ GL_FLOAT_MAT3x2, 24 },
+				{ GL_FLOAT_MAT3x4, 48 },
+				{ GL_FLOAT_MAT4x2, 32 },
+				{ GL_FLOAT_MAT4x3, 48 },
+				{ GL_DOUBLE, 8 },
+				{ GL_DOUBLE_VEC2, 16 },
+				{ GL_DOUBLE_VEC3, 24 },
+				{ GL_DOUBLE_VEC4, 32 },
+				{ GL_DOUBLE_MAT2, 32 },
+				{ GL_DOUBLE_MAT3, 72 },
+				{ GL_DOUBLE_MAT4, 128 },
+				{ GL_DOUBLE_MAT2x3, 48 },
+				{ GL_DOUBLE_MAT2x4, 64 },
+				{ GL_DOUBLE_MAT3x2, 48 },
+				{ GL_DOUBLE_MAT3x4, 96 },
+				{ GL_DOUBLE_MAT4x2, 64 },
+				{ GL_DOUBLE_MAT4x3, 96 },
+			};
+
+			// Samplers and images are set as a single int.
+			const auto it = gl_uniform_type_sizeofs.find(type);
+			return it != gl_uniform_type_sizeofs.end() ? it->second : 4;
+		}
+
+		inline void upload_uniform(const GLuint program, const GLint location, const GLenum type, const GLsizei count, const void* data)
+		{
+			PICOGL_INSTRUMENT_CALL(UniformUploads, 1);
+			const GLfloat* f = static_cast<const GLfloat*>(data);
+			const GLint* i = static_cast<const GLint*>(data);
+			const GLuint* u = static_cast<const GLuint*>(data);
+			const GLdouble* d = static_cast<const GLdouble*>(data);
+			switch (type)
+			{
+			case GL_FLOAT: glProgramUniform1fv(program, location, count, f); break;
+			case GL_FLOAT_VEC2: glProgramUniform2fv(program, location, count, f); break;
+			case GL_FLOAT_VEC3: glProgramUniform3fv(program, location, count, f); break;
+			case GL_FLOAT_VEC4: glProgramUniform4fv(program, location, count, f); break;
+			case GL_INT_VEC2: case GL_BOOL_VEC2: glProgramUniform2iv(program, location, count, i); break;
+			case GL_INT_VEC3: case GL_BOOL_VEC3: glProgramUniform3iv(program, location, count, i); break;
+			case GL_INT_VEC4: case GL_BOOL_VEC4: glProgramUniform4iv(program, location, count, i); break;
+			case GL_UNSIGNED_INT: glProgramUniform1uiv(program, location, count, u); break;
+			case GL_UNSIGNED_INT_VEC2: glProgramUniform2uiv(program, location, count, u); break;
+			case GL_UNSIGNED_INT_VEC3: glProgramUniform3uiv(program, location, count, u); break;
+			case GL_UNSIGNED_INT_VEC4: glProgramUniform4uiv(program, location, count, u); break;
+			case GL_FLOAT_MAT2: glProgramUniformMatrix2fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT3: glProgramUniformMatrix3fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT4: glProgramUniformMatrix4fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT2x3: glProgramUniformMatrix2x3fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT2x4: glProgramUniformMatrix2x4fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT3x2: glProgramUniformMatrix3x2fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT3x4: glProgramUniformMatrix3x4fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT4x2: glProgramUniformMatrix4x2fv(program, location, count, GL_FALSE, f); break;
+			case GL_FLOAT_MAT4x3: glProgramUniformMatrix4x3fv(program, location, count, GL_FALSE, f); break;
+			case GL_DOUBLE: glProgramUniform1dv(program, location, count, d); break;
+			case GL_DOUBLE_VEC2: glProgramUniform2dv(program, location, count, d); break;
+			case GL_DOUBLE_VEC3: glProgramUniform3dv(program, location, count, d); break;
+			case GL_DOUBLE_VEC4: glProgramUniform4dv(program, location, count, d); break;
+			case GL_DOUBLE_MAT2: glProgramUniformMatrix2dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT3: glProgramUniformMatrix3dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT4: glProgramUniformMatrix4dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT2x3: glProgramUniformMatrix2x3dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT2x4: glProgramUniformMatrix2x4dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT3x2: glProgramUniformMatrix3x2dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT3x4: glProgramUniformMatrix3x4dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT4x2: glProgramUniformMatrix4x2dv(program, location, count, GL_FALSE, d); break;
+			case GL_DOUBLE_MAT4x3: glProgramUniformMatrix4x3dv(program, location, count, GL_FALSE, d); break;
+			default: glProgramUniform1iv(program, location, count, i); break;
+			}
+		}
+	}
+
+	namespace impl
+	{
+		inline bool has_extension(const char* name)
+		{
+			GLint extension_count = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+			for (GLint i = 0; i < extension_count; ++i) {
+				const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+				if (extension && std::strcmp(extension, name) == 0)
+					return true;
+			}
+			return false;
+		}
+
+		inline bool parallel_shader_compile()
+		{
+#ifdef GL_KHR_parallel_shader_compile
+			static const bool supported = [] {
+				if (!has_extension("GL_KHR_parallel_shader_compile"))
+					return false;
+				// Let the driver pick the thread count.
+				glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+				return true;
+			}();
+			return supported;
+#else
+			return false;
+#endif
+		}
+
+		// Empty once compiled successfully.
+		inline std::string get_compile_log(const GLuint shader)
+		{
+			GLint log_length = 0, compile_status = GL_FALSE;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+			if (compile_status)
+				return {};
+
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
+			std::string log(static_cast<std::size_t>(log_length) + 1, '\0');
+			glGetShaderInfoLog(shader, log_length, NULL, log.data());
+			log.resize(std::strlen(log.c_str()));
+			return log.empty() ? "compilation failed" : log;
+		}
+
+		inline std::string get_shader_type_str(const GLuint shader)
+		{
+			static const std::unordered_map<GLenum, std::string> types = {
+				PICOGL_ENUM_STR(GL_VERTEX_SHADER),
+				PICOGL_ENUM_STR(GL_TESS_CONTROL_SHADER),
+				PICOGL_ENUM_STR(GL_TESS_EVALUATION_SHADER),
+				PICOGL_ENUM_STR(GL_GEOMETRY_SHADER),
+				PICOGL_ENUM_STR(GL_FRAGMENT_SHADER),
+				PICOGL_ENUM_STR(GL_COMPUTE_SHADER),
+			};
+
+			GLint type = 0;
+			glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+			const auto it = types.find(GLenum(type));
+			return it != types.end() ? it->second : "shader";
+		}
 	}
 
 	inline GLenum gl_debug(std::string& message)
@@ -703,848 +2105,3196 @@ namespace picogl
 		return status;
 	}
 
-	inline Buffer Buffer::make(const GLenum target, const GLsizeiptr size, const void* data, const GLenum usage)
+	namespace impl
 	{
-		Buffer buffer;
-		buffer.m_gl = impl::GLObject<impl::GLObjectType::Buffer>::make();
-		buffer.m_target = target;
-		buffer.m_size = size;
-		buffer.bind();
-		glBufferData(target, size, data, usage);
-		return buffer;
+		inline StateCache*& current_state_cache()
+		{
+			static StateCache* cache = nullptr;
+			return cache;
+		}
+
+		inline void use_program(const GLuint program)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_program(program)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glUseProgram(program);
+			}
+		}
+
+		inline void bind_vertex_array(const GLuint vao)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_vertex_array(vao)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glBindVertexArray(vao);
+			}
+		}
+
+		inline void bind_buffer(const GLenum target, const GLuint buffer)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_buffer(target, buffer)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glBindBuffer(target, buffer);
+			}
+		}
+
+		inline void bind_buffer_range(const GLenum target, const GLuint index, const GLuint buffer, const GLintptr offset, const GLsizeiptr size)
+		{
+			// Indexed bindings are not shadowed, but they also change the generic binding.
+			if (StateCache* cache = StateCache::get_current()) {
+				cache->set_buffer(target, buffer);
+				cache->count(true);
+			}
+
+			PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+			if (size)
+				glBindBufferRange(target, index, buffer, offset, size);
+			else
+				glBindBufferBase(target, index, buffer);
+		}
+
+		inline void active_texture(const GLenum slot)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_active_texture(slot)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glActiveTexture(slot);
+			}
+		}
+
+		inline void bind_texture(const GLenum target, const GLuint texture)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_texture(target, texture)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glBindTexture(target, texture);
+			}
+		}
+
+		inline void bind_texture_unit(const GLuint unit, const GLenum target, const GLuint texture)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_texture(unit, target, texture)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glBindTextureUnit(unit, texture);
+			}
+		}
+
+		inline void bind_framebuffer(const GLenum target, const GLuint framebuffer)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_framebuffer(target, framebuffer)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glBindFramebuffer(target, framebuffer);
+			}
+		}
+
+		inline void bind_sampler(const GLuint unit, const GLuint sampler)
+		{
+			StateCache* cache = StateCache::get_current();
+			if (!cache || cache->update_sampler(unit, sampler)) {
+				PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+				glBindSampler(unit, sampler);
+			}
+		}
 	}
 
-	inline void Buffer::copy_to(Buffer& dst, const GLintptr to) const
+	inline StateCache* StateCache::get_current()
 	{
-		copy_to(dst, to, 0, m_size);
+		return impl::current_state_cache();
 	}
 
-	inline void Buffer::copy_to(Buffer& dst, const GLintptr to, const GLintptr from, const GLsizeiptr size) const
+	inline void StateCache::set_current(StateCache* cache)
 	{
-		bind(GL_COPY_READ_BUFFER);
-		dst.bind(GL_COPY_WRITE_BUFFER);
-		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, size);
+		impl::current_state_cache() = cache;
+		if (cache)
+			cache->invalidate();
 	}
 
-	inline Buffer::operator GLuint() const
+	inline void StateCache::invalidate()
 	{
-		return m_gl;
+		m_program = Unknown;
+		m_vertex_array = Unknown;
+		m_active_texture = Unknown;
+		m_draw_framebuffer = Unknown;
+		m_read_framebuffer = Unknown;
+		m_buffers.clear();
+		m_textures.clear();
+		m_capabilities.clear();
+		m_samplers.clear();
 	}
 
-	inline void Buffer::bind() const
+	inline void StateCache::forget(const impl::GLObjectType type, const GLuint gl)
 	{
-		bind(m_target);
+		const auto forget_in = [gl](auto& bindings) {
+			for (auto& binding : bindings)
+				if (binding.second == gl)
+					binding.second = Unknown;
+		};
+
+		switch (type)
+		{
+		case impl::GLObjectType::Buffer:
+			forget_in(m_buffers);
+			break;
+		case impl::GLObjectType::Texture:
+			forget_in(m_textures);
+			break;
+		case impl::GLObjectType::Sampler:
+			forget_in(m_samplers);
+			break;
+		case impl::GLObjectType::Program:
+			if (m_program == gl)
+				m_program = Unknown;
+			break;
+		case impl::GLObjectType::VertexArray:
+			if (m_vertex_array == gl)
+				m_vertex_array = Unknown;
+			break;
+		case impl::GLObjectType::Framebuffer:
+			if (m_draw_framebuffer == gl)
+				m_draw_framebuffer = Unknown;
+			if (m_read_framebuffer == gl)
+				m_read_framebuffer = Unknown;
+			break;
+		default:
+			break;
+		}
 	}
 
-	inline void Buffer::bind(const GLenum target) const
+	inline bool StateCache::update_program(const GLuint program)
 	{
-		glBindBuffer(target, m_gl);
+		return update(m_program, program);
 	}
 
-	inline void Buffer::bind_as_ssbo(const GLuint index) const
+	inline bool StateCache::update_vertex_array(const GLuint vao)
 	{
-		bind(GL_SHADER_STORAGE_BUFFER);
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_gl);
+		// The element array binding is part of the vertex array state.
+		m_buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+		return update(m_vertex_array, vao);
 	}
 
-	inline void Buffer::upload_data(const void* data, const GLsizeiptr size, const GLintptr offset)
+	inline bool StateCache::update_buffer(const GLenum target, const GLuint buffer)
 	{
-		bind();
-		glBufferSubData(m_target, offset, size ? size : m_size, data);
+		const auto it = m_buffers.try_emplace(target, Unknown).first;
+		return update(it->second, buffer);
 	}
 
-	inline GLsizeiptr Buffer::get_size() const
+	inline bool StateCache::update_active_texture(const GLenum slot)
 	{
-		return m_size;
+		return update(m_active_texture, slot);
 	}
 
-	inline Shader Shader::make(const GLenum type, const std::string& code)
+	inline bool StateCache::update_texture(const GLuint unit, const GLenum target, const GLuint texture)
 	{
-		Shader shader;
-		shader.m_gl = impl::GLObject<impl::GLObjectType::Shader>::make(type);
-		shader.m_type = type;
-
-		const char* code_ptr = code.c_str();
-		glShaderSource(shader, 1, &code_ptr, NULL);
-		glCompileShader(shader);
-
-		GLint log_length, compile_status = GL_FALSE;
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
-		if (!compile_status) {
-			shader.m_log.resize(static_cast<std::size_t>(log_length) + 1);
-			glGetShaderInfoLog(shader, log_length, NULL, shader.m_log.data());
-		}
-
-		return shader;
+		const auto it = m_textures.try_emplace((std::uint64_t(unit) << 32) | target, Unknown).first;
+		return update(it->second, texture);
 	}
 
-	inline bool Shader::compiled() const
+	inline bool StateCache::update_framebuffer(const GLenum target, const GLuint framebuffer)
 	{
-		return !m_log.empty();
+		switch (target)
+		{
+		case GL_DRAW_FRAMEBUFFER:
+			return update(m_draw_framebuffer, framebuffer);
+		case GL_READ_FRAMEBUFFER:
+			return update(m_read_framebuffer, framebuffer);
+		default:
+		{
+			const bool changed = m_draw_framebuffer != framebuffer || m_read_framebuffer != framebuffer;
+			m_draw_framebuffer = m_read_framebuffer = framebuffer;
+			++(changed ? m_issued_count : m_skipped_count);
+			return changed;
+		}
+		}
 	}
 
-	inline const std::string& Shader::get_log() const
+	inline bool StateCache::update_sampler(const GLuint unit, const GLuint sampler)
 	{
-		return m_log;
+		const auto it = m_samplers.try_emplace(unit, Unknown).first;
+		return update(it->second, sampler);
 	}
 
-	inline Shader::operator GLuint() const
+	inline bool StateCache::update_capability(const GLenum capability, const bool enabled)
 	{
-		return m_gl;
+		const auto it = m_capabilities.try_emplace(capability, Unknown).first;
+		return update(it->second, enabled);
 	}
 
-	inline Program Program::make(const std::vector<std::reference_wrapper<const Shader>>& shaders)
+	inline bool StateCache::update_texture(const GLenum target, const GLuint texture)
 	{
-		Program program;
-		program.m_gl = impl::GLObject<impl::GLObjectType::Program>::make();
+		if (m_active_texture != Unknown)
+			return update_texture(m_active_texture - GL_TEXTURE0, target, texture);
+
+		// Any unit may be the active one.
+		for (auto& binding : m_textures)
+			if (GLenum(binding.first) == target)
+				binding.second = Unknown;
+		++m_issued_count;
+		return true;
+	}
 
-		for (const auto& shader : shaders)
-			glAttachShader(program, shader.get());
+	inline void StateCache::set_buffer(const GLenum target, const GLuint buffer)
+	{
+		m_buffers[target] = buffer;
+	}
 
-		glLinkProgram(program.m_gl);
+	inline void StateCache::count(const bool issued)
+	{
+		++(issued ? m_issued_count : m_skipped_count);
+	}
 
-		GLint log_length, link_status = GL_FALSE;
-		glGetProgramiv(program, GL_LINK_STATUS, &link_status);
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
-		if (!link_status) {
-			program.m_log.resize(static_cast<std::size_t>(log_length) + 1);
-			glGetProgramInfoLog(program, log_length, NULL, program.m_log.data());
-		}
+	inline std::size_t StateCache::issued_count() const
+	{
+		return m_issued_count;
+	}
 
-		for (const auto& shader : shaders)
-			glDetachShader(program, shader.get());
+	inline std::size_t StateCache::skipped_count() const
+	{
+		return m_skipped_count;
+	}
 
-		return program;
+	inline void StateCache::reset_counters()
+	{
+		m_issued_count = 0;
+		m_skipped_count = 0;
 	}
 
-	inline Program::operator GLuint() const
+	inline bool StateCache::update(GLuint& shadow, const GLuint value)
 	{
-		return m_gl;
+		const bool changed = shadow != value;
+		shadow = value;
+		++(changed ? m_issued_count : m_skipped_count);
+		return changed;
 	}
 
-	inline bool Program::linked() const
+	inline MemoryStats::Snapshot MemoryStats::Snapshot::diff(const Snapshot& before) const
 	{
-		return !m_log.empty();
+		const auto diff_usage = [](Usage& usage, const Usage& before) {
+			usage.m_bytes -= before.m_bytes;
+			usage.m_count -= before.m_count;
+		};
+
+		Snapshot diff = *this;
+		diff_usage(diff.m_total, before.m_total);
+		diff_usage(diff.m_buffers, before.m_buffers);
+		diff_usage(diff.m_textures, before.m_textures);
+		diff_usage(diff.m_renderbuffers, before.m_renderbuffers);
+		for (const auto& label : before.m_labels)
+			diff_usage(diff.m_labels[label.first], label.second);
+		return diff;
 	}
 
-	inline const std::string& Program::get_log() const
+	inline MemoryStats::Snapshot MemoryStats::snapshot()
 	{
-		return m_log;
+		return impl::MemoryRegistry::get().stats();
 	}
 
-	inline void Program::use() const
+	inline void MemoryStats::reset_peaks()
 	{
-		glUseProgram(m_gl);
+		impl::MemoryRegistry::get().reset_peaks();
 	}
 
-	template<typename glUniformFunc, typename ...Args>
-	inline void Program::set_uniform(const char* name, glUniformFunc&& f, Args && ...args) const
+	inline void MemoryStats::set_label(const impl::GLObjectType type, const GLuint gl, const std::string& label)
 	{
-		const GLint location = glGetUniformLocation(m_gl, name);
-		f(location, std::forward<Args>(args)...);
+		static const std::unordered_map<impl::GLObjectType, GLenum> gl_identifiers = {
+			{ impl::GLObjectType::Buffer, GL_BUFFER },
+			{ impl::GLObjectType::Framebuffer, GL_FRAMEBUFFER },
+			{ impl::GLObjectType::Query, GL_QUERY },
+			{ impl::GLObjectType::Program, GL_PROGRAM },
+			{ impl::GLObjectType::RenderBuffer, GL_RENDERBUFFER },
+			{ impl::GLObjectType::Sampler, GL_SAMPLER },
+			{ impl::GLObjectType::Shader, GL_SHADER },
+			{ impl::GLObjectType::Texture, GL_TEXTURE },
+			{ impl::GLObjectType::VertexArray, GL_VERTEX_ARRAY },
+		};
+
+		glObjectLabel(gl_identifiers.at(type), gl, GLsizei(label.size()), label.data());
+		if (impl::MemoryRegistry::is_tracked(type))
+			impl::MemoryRegistry::get().set_label(type, gl, label);
 	}
 
-	inline Texture Texture::make_1d(const GLenum internal_format, const GLsizei width, const GLsizei array_size, const void* data, const Options opts)
+	namespace impl
 	{
-		Texture texture;
-		const GLenum target = (array_size > 1 ? GL_TEXTURE_1D_ARRAY : GL_TEXTURE_1D);
-		texture.make(target, internal_format, array_size, 1, width, 0, 0, data, opts);
-		return texture;
+		inline MemoryRegistry& MemoryRegistry::get()
+		{
+			static MemoryRegistry registry;
+			return registry;
+		}
+
+		inline bool MemoryRegistry::is_tracked(const GLObjectType type)
+		{
+			return type == GLObjectType::Buffer || type == GLObjectType::Texture || type == GLObjectType::RenderBuffer;
+		}
+
+		inline void MemoryRegistry::allocate(const GLObjectType type, const GLuint gl, const GLsizeiptr bytes)
+		{
+			const auto [it, inserted] = m_allocations.try_emplace((std::uint64_t(type) << 32) | gl, Allocation{ type, 0, {} });
+			update(it->second, bytes - it->second.m_bytes, inserted ? 1 : 0);
+			it->second.m_bytes = bytes;
+		}
+
+		inline void MemoryRegistry::release(const GLObjectType type, const GLuint gl)
+		{
+			const auto it = m_allocations.find((std::uint64_t(type) << 32) | gl);
+			if (it == m_allocations.end())
+				return;
+			update(it->second, -it->second.m_bytes, -1);
+			m_allocations.erase(it);
+		}
+
+		inline void MemoryRegistry::set_label(const GLObjectType type, const GLuint gl, const std::string& label)
+		{
+			const auto it = m_allocations.find((std::uint64_t(type) << 32) | gl);
+			if (it == m_allocations.end())
+				return;
+			Allocation& allocation = it->second;
+			if (!allocation.m_label.empty()) {
+				MemoryStats::Usage& usage = m_stats.m_labels[allocation.m_label];
+				usage.m_bytes -= allocation.m_bytes;
+				--usage.m_count;
+			}
+			allocation.m_label = label;
+			if (!label.empty()) {
+				MemoryStats::Usage& usage = m_stats.m_labels[label];
+				usage.m_bytes += allocation.m_bytes;
+				++usage.m_count;
+				usage.m_peak_bytes = std::max(usage.m_peak_bytes, usage.m_bytes);
+			}
+		}
+
+		inline const MemoryStats::Snapshot& MemoryRegistry::stats() const
+		{
+			return m_stats;
+		}
+
+		inline void MemoryRegistry::reset_peaks()
+		{
+			for (MemoryStats::Usage* usage : { &m_stats.m_total, &m_stats.m_buffers, &m_stats.m_textures, &m_stats.m_renderbuffers })
+				usage->m_peak_bytes = usage->m_bytes;
+			for (auto& label : m_stats.m_labels)
+				label.second.m_peak_bytes = label.second.m_bytes;
+		}
+
+		inline void MemoryRegistry::update(const Allocation& allocation, const GLsizeiptr bytes, const std::ptrdiff_t count)
+		{
+			const auto update_usage = [&](MemoryStats::Usage& usage) {
+				usage.m_bytes += bytes;
+				usage.m_count += count;
+				usage.m_peak_bytes = std::max(usage.m_peak_bytes, usage.m_bytes);
+			};
+
+			update_usage(m_stats.m_total);
+			switch (allocation.m_type) {
+			case GLObjectType::Buffer: update_usage(m_stats.m_buffers); break;
+			case GLObjectType::Texture: update_usage(m_stats.m_textures); break;
+			case GLObjectType::RenderBuffer: update_usage(m_stats.m_renderbuffers); break;
+			default: break;
+			}
+			if (!allocation.m_label.empty())
+				update_usage(m_stats.m_labels[allocation.m_label]);
+		}
 	}
 
-	inline Texture Texture::make_2d(const GLenum internal_format, const GLsizei width, const GLsizei height, const GLsizei array_size, const GLsizei sample_count, const void* data, const Options opts)
+	namespace impl
 	{
-		Texture texture;
-		const GLenum target = sample_count > 1 ?
-			(array_size > 1 ? GL_TEXTURE_2D_MULTISAMPLE_ARRAY : GL_TEXTURE_2D_MULTISAMPLE) :
-			(array_size > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
-		texture.make(target, internal_format, array_size, sample_count, width, height, 0, data, opts);
-		return texture;
+		struct InstrumentationState
+		{
+			Instrumentation::Counters m_frame = {};
+			Instrumentation::Counters m_last_frame = {};
+			std::map<std::string, Instrumentation::Counters> m_scopes;
+			std::map<std::string, Instrumentation::Counters> m_last_scopes;
+			std::vector<Instrumentation::Counters*> m_open_scopes;
+		};
+
+		inline InstrumentationState& instrumentation_state()
+		{
+			static InstrumentationState state;
+			return state;
+		}
+
+		inline InstrumentedCall::InstrumentedCall(std::initializer_list<std::pair<Instrumentation::Counter, std::uint64_t>> counts)
+		{
+			for (const auto& [counter, value] : counts)
+				Instrumentation::add(counter, value);
+			m_start = std::chrono::steady_clock::now();
+		}
+
+		inline InstrumentedCall::~InstrumentedCall()
+		{
+			const auto duration = std::chrono::steady_clock::now() - m_start;
+			Instrumentation::add(Instrumentation::Counter::CallNanoseconds, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+		}
 	}
 
-	inline Texture Texture::make_3d(const GLenum internal_format, const GLsizei width, const GLsizei height, const GLsizei depth, const void* data, const Options opts)
+	inline const char* Instrumentation::get_name(const Counter counter)
 	{
-		Texture texture;
-		texture.make(GL_TEXTURE_3D, internal_format, 1, 1, width, height, depth, data, opts);
-		return texture;
+		static const std::array<const char*, std::size_t(Counter::Count)> names = {
+			"draw_calls",
+			"draw_commands",
+			"triangles",
+			"dispatches",
+			"state_changes",
+			"uniform_uploads",
+			"buffer_uploads",
+			"buffer_upload_bytes",
+			"texture_uploads",
+			"texture_upload_bytes",
+			"call_ns",
+		};
+		return names[std::size_t(counter)];
 	}
 
-	inline Texture Texture::make_cubemap(const GLenum internal_format, const GLsizei width, const GLsizei height, const GLsizei array_size, const Options opts)
+	inline void Instrumentation::add(const Counter counter, const std::uint64_t value)
 	{
-		Texture texture;
-		const GLenum target = (array_size > 1 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP);
-		texture.make(target, internal_format, array_size, 1, width, height, 0, nullptr, opts);
-		return texture;
+		impl::InstrumentationState& state = impl::instrumentation_state();
+		state.m_frame[std::size_t(counter)] += value;
+		for (Counters* scope : state.m_open_scopes)
+			(*scope)[std::size_t(counter)] += value;
 	}
 
-	inline GLsizei Texture::array_size() const
+	inline void Instrumentation::next_frame()
 	{
-		return m_array_size;
+		impl::InstrumentationState& state = impl::instrumentation_state();
+		PICOGL_ASSERT(state.m_open_scopes.empty());
+		state.m_last_frame = state.m_frame;
+		state.m_frame = {};
+		state.m_last_scopes.swap(state.m_scopes);
+		state.m_scopes.clear();
 	}
 
-	inline GLsizei Texture::sample_count() const
+	inline const Instrumentation::Counters& Instrumentation::get_frame()
 	{
-		return m_sample_count;
+		return impl::instrumentation_state().m_frame;
 	}
 
-	inline Texture& Texture::bind()
+	inline const Instrumentation::Counters& Instrumentation::get_last_frame()
 	{
-		glBindTexture(m_target, m_gl);
-		return *this;
+		return impl::instrumentation_state().m_last_frame;
 	}
 
-	inline const Texture& Texture::bind() const
+	inline const std::map<std::string, Instrumentation::Counters>& Instrumentation::get_last_frame_scopes()
 	{
-		glBindTexture(m_target, m_gl);
-		return *this;
+		return impl::instrumentation_state().m_last_scopes;
 	}
 
-	inline Texture& Texture::set_swizzling(const std::array<GLint, 4>& swizzle_mask)
+	inline void Instrumentation::begin_scope(const std::string& name)
 	{
-		bind();
-		glTexParameteriv(m_target, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask.data());
-		return *this;
+		// Map nodes are stable, a scope opened twice in a frame accumulates.
+		impl::InstrumentationState& state = impl::instrumentation_state();
+		state.m_open_scopes.push_back(&state.m_scopes[name]);
 	}
 
-	inline Texture& Texture::set_wrapping(const GLenum s, const GLenum t, const GLenum r)
+	inline void Instrumentation::end_scope()
 	{
-		bind();
-		glTexParameteri(m_target, GL_TEXTURE_WRAP_S, s);
-		glTexParameteri(m_target, GL_TEXTURE_WRAP_T, t);
-		if (m_depth > 1)
-			glTexParameteri(m_target, GL_TEXTURE_WRAP_R, r);
-		return *this;
+		impl::InstrumentationState& state = impl::instrumentation_state();
+		PICOGL_ASSERT(!state.m_open_scopes.empty());
+		state.m_open_scopes.pop_back();
 	}
 
-	inline Texture& Texture::set_filtering(const GLenum mag_filer, const GLenum min_filter)
+	inline std::string Instrumentation::to_json()
 	{
-		bind();
-		glTexParameteri(m_target, GL_TEXTURE_MAG_FILTER, mag_filer);
-		glTexParameteri(m_target, GL_TEXTURE_MIN_FILTER, min_filter);
-		return *this;
+		const auto write_counters = [](std::string& json, const Counters& counters) {
+			json += '{';
+			for (std::size_t c = 0; c < counters.size(); ++c) {
+				json += c ? ",\"" : "\"";
+				json += get_name(Counter(c));
+				json += "\":" + std::to_string(counters[c]);
+			}
+			json += '}';
+		};
+
+		const impl::InstrumentationState& state = impl::instrumentation_state();
+		std::string json = "{\"frame\":";
+		write_counters(json, state.m_last_frame);
+		json += ",\"scopes\":{";
+		for (const auto& [name, counters] : state.m_last_scopes) {
+			if (json.back() != '{')
+				json += ',';
+			json += '"';
+			for (const char c : name) {
+				if (c == '"' || c == '\\')
+					json += '\\';
+				json += c;
+			}
+			json += "\":";
+			write_counters(json, counters);
+		}
+		json += "}}";
+		return json;
 	}
 
-	inline Texture& Texture::set_alignment(const GLint pack, const GLint unpack)
+	inline void set_enabled(const GLenum capability, const bool enabled)
 	{
-		bind();
-		glPixelStorei(GL_PACK_ALIGNMENT, pack);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, unpack);
-		return *this;
+		StateCache* cache = StateCache::get_current();
+		if (cache && !cache->update_capability(capability, enabled))
+			return;
+
+		PICOGL_INSTRUMENT_CALL(StateChanges, 1);
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
 	}
 
-	inline Texture& Texture::set_border_color(const std::array<float, 4>& rgba)
+	inline Fence Fence::make()
 	{
-		bind();
-		glTexParameterfv(m_target, GL_TEXTURE_BORDER_COLOR, rgba.data());
-		return *this;
+		Fence fence;
+		fence.m_sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		return fence;
 	}
 
-	inline Texture& Texture::upload_data(const void* data, GLuint level, GLuint layer, GLenum face)
+	inline Fence::Fence() = default;
+
+	inline Fence::Fence(Fence&& rhs) noexcept
 	{
-		bind();
-		switch (m_target)
-		{
-		case GL_TEXTURE_1D:
-			glTexSubImage1D(m_target, level, 0, m_width, m_format, m_type, data);
-			break;
-		case GL_TEXTURE_1D_ARRAY:
-			glTexSubImage2D(m_target, level, 0, layer, m_width, 1, m_format, m_type, data);
-			break;
-		case GL_TEXTURE_2D:
-			glTexSubImage2D(m_target, level, 0, 0, m_width, m_height, m_format, m_type, data);
-			break;
-		case GL_TEXTURE_CUBE_MAP:
-			glTexSubImage2D(face, level, 0, 0, m_width, m_height, m_format, m_type, data);
-			break;
-		case GL_TEXTURE_2D_ARRAY:
-			glTexSubImage3D(m_target, level, 0, 0, layer, m_width, m_height, 1, m_format, m_type, data);
-			break;
-		case GL_TEXTURE_CUBE_MAP_ARRAY:
-			glTexSubImage3D(face, level, 0, 0, layer, m_width, m_height, 1, m_format, m_type, data);
-			break;
-		case GL_TEXTURE_3D:
-			glTexSubImage3D(m_target, level, 0, 0, 0, m_width, m_height, m_depth, m_format, m_type, data);
-			break;
-		default:
-			break;
-		}
-		return *this;
+		std::swap(m_sync, rhs.m_sync);
 	}
 
-	inline void Texture::bind_as_sampler(const GLuint slot) const
+	inline Fence& Fence::operator=(Fence&& rhs) noexcept
 	{
-		PICOGL_ASSERT(slot >= GL_TEXTURE0);
-		bind();
-		glActiveTexture(slot);
+		std::swap(m_sync, rhs.m_sync);
+		return *this;
 	}
 
-	inline void Texture::bind_as_image(const GLuint unit, const GLint level, const GLint layer, const GLenum access) const
+	inline Fence::~Fence()
 	{
-		glBindImageTexture(unit, m_gl, level, (m_array_size > 1), layer, access, m_internal_format);
+		if (m_sync)
+			glDeleteSync(m_sync);
 	}
 
-	inline Texture::operator GLuint() const
+	inline bool Fence::signaled() const
 	{
-		return m_gl;
+		return wait(0);
 	}
 
-	inline GLenum Texture::get_format() const
+	inline bool Fence::wait(const GLuint64 timeout_ns) const
 	{
-		return m_format;
+		if (!m_sync)
+			return true;
+
+		// Flush so that the fence is guaranteed to eventually signal.
+		const GLenum status = glClientWaitSync(m_sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+		return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
 	}
 
-	inline GLenum Texture::get_target() const
+	inline Fence::operator GLsync() const
 	{
-		return m_target;
+		return m_sync;
 	}
 
-	inline GLenum Texture::get_type() const
+	inline FenceRing FenceRing::make(const GLsizei frame_count)
 	{
-		return m_type;
+		PICOGL_ASSERT(frame_count > 0);
+		FenceRing ring;
+		ring.m_fences.resize(frame_count);
+		return ring;
 	}
 
-	inline GLenum Texture::get_internal_format() const
+	inline bool FenceRing::next_frame(const GLuint64 timeout_ns)
 	{
-		return m_internal_format;
+		if (m_fences.empty())
+			return true;
+
+		m_fences[m_frame] = Fence::make();
+		m_frame = (m_frame + 1) % frame_count();
+
+		Fence& fence = m_fences[m_frame];
+		if (!fence.wait(timeout_ns))
+			return false;
+
+		fence = Fence();
+		return true;
 	}
 
-	inline GLsizei Texture::width() const
+	inline GLsizei FenceRing::frame_index() const
 	{
-		return m_width;
+		return m_frame;
 	}
 
-	inline GLsizei Texture::height() const
+	inline GLsizei FenceRing::frame_count() const
 	{
-		return m_height;
+		return GLsizei(m_fences.size());
 	}
 
-	inline GLsizei Texture::depth() const
+	inline Buffer Buffer::make(const GLenum target, const GLsizeiptr size, const void* data, const GLenum usage)
 	{
-		return m_depth;
+		Buffer buffer;
+		buffer.m_gl = impl::GLObject<impl::GLObjectType::Buffer>::make();
+		buffer.m_target = target;
+		buffer.m_size = size;
+#if PICOGL_USE_DSA
+		if (data) {
+			PICOGL_INSTRUMENT_UPLOAD(Buffer, size);
+			glNamedBufferData(buffer.m_gl, size, data, usage);
+		} else
+			glNamedBufferData(buffer.m_gl, size, nullptr, usage);
+#else
+		buffer.bind();
+		if (data) {
+			PICOGL_INSTRUMENT_UPLOAD(Buffer, size);
+			glBufferData(target, size, data, usage);
+		} else
+			glBufferData(target, size, nullptr, usage);
+#endif
+		impl::MemoryRegistry::get().allocate(impl::GLObjectType::Buffer, buffer.m_gl, size);
+		return buffer;
 	}
 
-	inline void Texture::make(
-		const GLenum target,
-		const GLenum internal_format,
-		const GLsizei array_size,
-		const GLsizei sample_count,
-		const GLsizei width,
-		const GLsizei height,
-		const GLsizei depth,
-		const void* data,
-		const Options opts)
+	inline void Buffer::copy_to(Buffer& dst, const GLintptr to) const
 	{
-		const impl::PixelInfo pixel_info = impl::get_pixel_info(internal_format);
+		copy_to(dst, to, 0, m_size);
+	}
 
-		m_gl = impl::GLObject<impl::GLObjectType::Texture>::make();
-		m_target = target;
-		m_internal_format = internal_format;
-		m_format = pixel_info.m_format;
-		m_type = pixel_info.m_type;
-		m_array_size = array_size;
-		m_sample_count = sample_count;
-		m_width = width;
-		m_height = height;
-		m_depth = depth;
-		m_opts = opts;
+	inline void Buffer::copy_to(Buffer& dst, const GLintptr to, const GLintptr from, const GLsizeiptr size) const
+	{
+#if PICOGL_USE_DSA
+		glCopyNamedBufferSubData(m_gl, dst.m_gl, from, to, size);
+#else
+		bind(GL_COPY_READ_BUFFER);
+		dst.bind(GL_COPY_WRITE_BUFFER);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from, to, size);
+#endif
+	}
 
-		bind();
+	inline Buffer::operator GLuint() const
+	{
+		return m_gl;
+	}
 
-		if (bool(m_opts & Options::AutomaticAlignment))
-		{
-			if ((pixel_info.m_scalar_sizeof * m_width) % 4 != 0) {
-				glPixelStorei(GL_PACK_ALIGNMENT, 1);
-				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			}
-		}
+	inline void Buffer::bind() const
+	{
+		bind(m_target);
+	}
 
-		const GLboolean fixed_locations = bool(m_opts & Options::FixedSampleLocations);
+	inline void Buffer::bind(const GLenum target) const
+	{
+		impl::bind_buffer(target, m_gl);
+	}
+
+	inline void Buffer::bind_as_ssbo(const GLuint index) const
+	{
+		impl::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, index, m_gl);
+	}
+
+	inline void Buffer::upload_data(const void* data, const GLsizeiptr size, const GLintptr offset)
+	{
+		PICOGL_INSTRUMENT_UPLOAD(Buffer, size ? size : m_size);
+#if PICOGL_USE_DSA
+		glNamedBufferSubData(m_gl, offset, size ? size : m_size, data);
+#else
+		bind();
+		glBufferSubData(m_target, offset, size ? size : m_size, data);
+#endif
+	}
+
+	inline GLsizeiptr Buffer::get_size() const
+	{
+		return m_size;
+	}
+
+	inline Buffer Buffer::make_persistent(const GLenum target, const GLsizeiptr size, const GLbitfield flags)
+	{
+		constexpr GLbitfield map_flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		Buffer buffer;
+		buffer.m_gl = impl::GLObject<impl::GLObjectType::Buffer>::make();
+		buffer.m_target = target;
+		buffer.m_size = size;
+#if PICOGL_USE_DSA
+		glNamedBufferStorage(buffer.m_gl, size, nullptr, flags);
+		buffer.m_mapped_data = glMapNamedBufferRange(buffer.m_gl, 0, size, flags & map_flags);
+#else
+		buffer.bind();
+		glBufferStorage(target, size, nullptr, flags);
+		buffer.m_mapped_data = glMapBufferRange(target, 0, size, flags & map_flags);
+#endif
+		PICOGL_ASSERT(buffer.m_mapped_data);
+		impl::MemoryRegistry::get().allocate(impl::GLObjectType::Buffer, buffer.m_gl, size);
+		return buffer;
+	}
+
+	inline void* Buffer::get_mapped_data() const
+	{
+		return m_mapped_data;
+	}
+
+	inline void Buffer::set_label(const std::string& label) const
+	{
+		MemoryStats::set_label(impl::GLObjectType::Buffer, m_gl, label);
+	}
+
+	inline void* Buffer::map(const GLbitfield access, const GLintptr offset, const GLsizeiptr size)
+	{
+		PICOGL_ASSERT(!m_mapped_data);
+#if PICOGL_USE_DSA
+		return glMapNamedBufferRange(m_gl, offset, size ? size : m_size - offset, access);
+#else
+		bind();
+		return glMapBufferRange(m_target, offset, size ? size : m_size - offset, access);
+#endif
+	}
+
+	inline void Buffer::unmap()
+	{
+#if PICOGL_USE_DSA
+		glUnmapNamedBuffer(m_gl);
+#else
+		bind();
+		glUnmapBuffer(m_target);
+#endif
+	}
+
+	namespace impl
+	{
+		inline BufferPool::BufferPool(const GLenum target, const GLbitfield flags, const std::size_t max_pooled_count)
+			: m_target{ target }, m_flags{ flags }, m_max_pooled_count{ max_pooled_count }
+		{
+		}
+
+		inline Buffer BufferPool::acquire(const GLsizeiptr size)
+		{
+			auto best = m_buffers.end();
+			for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it)
+				if (it->get_size() >= size && (best == m_buffers.end() || it->get_size() < best->get_size()))
+					best = it;
+
+			if (best == m_buffers.end())
+				return Buffer::make_persistent(m_target, size, m_flags);
+
+			Buffer buffer = std::move(*best);
+			m_buffers.erase(best);
+			return buffer;
+		}
+
+		inline void BufferPool::release(Buffer&& buffer)
+		{
+			if (buffer && m_buffers.size() < m_max_pooled_count)
+				m_buffers.push_back(std::move(buffer));
+		}
+	}
+
+	inline void StreamBuffer::Range::bind(const GLenum target, const GLuint index) const
+	{
+		impl::bind_buffer_range(target, index, m_buffer, m_offset, m_size);
+	}
+
+	inline void StreamBuffer::Range::bind(const GLenum target) const
+	{
+		impl::bind_buffer(target, m_buffer);
+	}
+
+	inline StreamBuffer StreamBuffer::make(const GLsizeiptr frame_size, const GLsizei frame_count)
+	{
+		PICOGL_ASSERT(frame_size > 0 && frame_count > 0);
+
+		GLint ubo_alignment = 1, ssbo_alignment = 1;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment);
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo_alignment);
+
+		StreamBuffer stream;
+		stream.m_alignment = std::max({ GLsizeiptr(4), GLsizeiptr(ubo_alignment), GLsizeiptr(ssbo_alignment) });
+		stream.m_frame_size = ((frame_size + stream.m_alignment - 1) / stream.m_alignment) * stream.m_alignment;
+		stream.m_fences = FenceRing::make(frame_count);
+		stream.m_buffer = Buffer::make_persistent(GL_SHADER_STORAGE_BUFFER, stream.m_frame_size * frame_count);
+		return stream;
+	}
+
+	inline StreamBuffer::Range StreamBuffer::allocate(const GLsizeiptr size)
+	{
+		const GLsizeiptr offset = ((m_head + m_alignment - 1) / m_alignment) * m_alignment;
+		if (!m_buffer || offset + size > m_frame_size)
+			return {};
+
+		m_head = offset + size;
+
+		Range range;
+		range.m_buffer = m_buffer;
+		range.m_offset = m_fences.frame_index() * m_frame_size + offset;
+		range.m_size = size;
+		range.m_data = static_cast<char*>(m_buffer.get_mapped_data()) + range.m_offset;
+		return range;
+	}
+
+	inline void StreamBuffer::next_frame()
+	{
+		m_fences.next_frame();
+		m_head = 0;
+	}
+
+	inline StreamBuffer::operator GLuint() const
+	{
+		return m_buffer;
+	}
+
+	inline GLsizeiptr StreamBuffer::frame_size() const
+	{
+		return m_frame_size;
+	}
+
+	inline GLsizei StreamBuffer::frame_count() const
+	{
+		return m_fences.frame_count();
+	}
+
+	inline Shader Shader::make(const GLenum type, const std::string& code)
+	{
+		Shader shader = make_async(type, code);
+		shader.finish();
+		return shader;
+	}
+
+	inline Shader Shader::make_async(const GLenum type, const std::string& code)
+	{
+		impl::parallel_shader_compile();
+
+		Shader shader;
+		shader.m_gl = impl::GLObject<impl::GLObjectType::Shader>::make(type);
+		shader.m_type = type;
+		shader.m_pending = true;
+
+		const char* code_ptr = code.c_str();
+		glShaderSource(shader, 1, &code_ptr, NULL);
+		glCompileShader(shader);
+
+		return shader;
+	}
+
+	inline bool Shader::ready() const
+	{
+#ifdef GL_KHR_parallel_shader_compile
+		if (m_pending && impl::parallel_shader_compile()) {
+			GLint completed = GL_FALSE;
+			glGetShaderiv(m_gl, GL_COMPLETION_STATUS_KHR, &completed);
+			return completed;
+		}
+#endif
+		return true;
+	}
+
+	inline Shader& Shader::finish()
+	{
+		if (!m_pending)
+			return *this;
+
+		m_pending = false;
+		m_log = impl::get_compile_log(m_gl);
+		return *this;
+	}
+
+	inline bool Shader::compiled() const
+	{
+		return m_gl && !m_pending && m_log.empty();
+	}
+
+	inline const std::string& Shader::get_log() const
+	{
+		return m_log;
+	}
+
+	inline Shader::operator GLuint() const
+	{
+		return m_gl;
+	}
+
+	inline Program Program::make(const std::vector<std::reference_wrapper<const Shader>>& shaders, const bool retrievable_binary)
+	{
+		Program program = make_async(shaders, retrievable_binary);
+		program.finish();
+		return program;
+	}
+
+	inline Program Program::make_async(const std::vector<std::reference_wrapper<const Shader>>& shaders, const bool retrievable_binary)
+	{
+		impl::parallel_shader_compile();
+
+		Program program;
+		program.m_gl = impl::GLObject<impl::GLObjectType::Program>::make();
+		program.m_pending = true;
+
+		for (const auto& shader : shaders)
+			glAttachShader(program, shader.get());
+
+		if (retrievable_binary)
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+		glLinkProgram(program.m_gl);
+
+		// Shaders stay attached until finish, which reads their compile logs even if the Shader objects are gone.
+		return program;
+	}
+
+	inline bool Program::ready() const
+	{
+#ifdef GL_KHR_parallel_shader_compile
+		if (m_pending && impl::parallel_shader_compile()) {
+			GLint completed = GL_FALSE;
+			glGetProgramiv(m_gl, GL_COMPLETION_STATUS_KHR, &completed);
+			return completed;
+		}
+#endif
+		return true;
+	}
+
+	inline Program& Program::finish()
+	{
+		if (!m_pending)
+			return *this;
+
+		m_pending = false;
+		const bool linked = check_link_status();
+
+		GLint shader_count = 0;
+		glGetProgramiv(m_gl, GL_ATTACHED_SHADERS, &shader_count);
+		std::vector<GLuint> shaders(static_cast<std::size_t>(shader_count));
+		if (shader_count)
+			glGetAttachedShaders(m_gl, shader_count, NULL, shaders.data());
+		for (const GLuint shader : shaders) {
+			if (!linked) {
+				const std::string compile_log = impl::get_compile_log(shader);
+				if (!compile_log.empty())
+					m_log += "\n" + impl::get_shader_type_str(shader) + ": " + compile_log;
+			}
+			glDetachShader(m_gl, shader);
+		}
+
+		if (linked)
+			reflect();
+		return *this;
+	}
+
+	inline Program Program::make_from_binary(const GLenum format, const void* binary, const GLsizei size)
+	{
+		Program program;
+		program.m_gl = impl::GLObject<impl::GLObjectType::Program>::make();
+
+		glProgramBinary(program, format, binary, size);
+
+		if (program.check_link_status())
+			program.reflect();
+
+		return program;
+	}
+
+	inline std::vector<char> Program::get_binary(GLenum& format) const
+	{
+		GLint binary_size = 0;
+		glGetProgramiv(m_gl, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+
+		std::vector<char> binary(static_cast<std::size_t>(binary_size));
+		if (binary_size > 0)
+			glGetProgramBinary(m_gl, binary_size, NULL, &format, binary.data());
+
+		return binary;
+	}
+
+	inline bool Program::check_link_status()
+	{
+		GLint log_length, link_status = GL_FALSE;
+		glGetProgramiv(m_gl, GL_LINK_STATUS, &link_status);
+		glGetProgramiv(m_gl, GL_INFO_LOG_LENGTH, &log_length);
+		if (!link_status) {
+			m_log.assign(static_cast<std::size_t>(log_length) + 1, '\0');
+			glGetProgramInfoLog(m_gl, log_length, NULL, m_log.data());
+			// Trimmed so that compile logs can be appended, never empty since it flags the failure.
+			m_log.resize(std::strlen(m_log.c_str()));
+			if (m_log.empty())
+				m_log = "link failed";
+		}
+		return link_status;
+	}
+
+	inline Program::operator GLuint() const
+	{
+		return m_gl;
+	}
+
+	inline bool Program::linked() const
+	{
+		return m_gl && !m_pending && m_log.empty();
+	}
+
+	inline const std::string& Program::get_log() const
+	{
+		return m_log;
+	}
+
+	inline void Program::use() const
+	{
+		impl::use_program(m_gl);
+	}
+
+	template<typename glUniformFunc, typename ...Args>
+	inline void Program::set_uniform(const char* name, glUniformFunc&& f, Args && ...args) const
+	{
+		const UniformHandle handle = get_uniform_handle(name);
+		if (handle != InvalidUniform)
+			m_uniforms[handle].m_value_set = false;
+		const GLint location = handle != InvalidUniform ? m_uniforms[handle].m_location : glGetUniformLocation(m_gl, name);
+		f(location, std::forward<Args>(args)...);
+	}
+
+	inline Program::UniformHandle Program::get_uniform_handle(const char* name) const
+	{
+		PICOGL_ASSERT(!m_pending);
+		const auto it = std::lower_bound(m_uniforms.begin(), m_uniforms.end(), name, [](const Uniform& uniform, const char* name) {
+			return std::strcmp(uniform.m_name.c_str(), name) < 0;
+			});
+		if (it == m_uniforms.end() || it->m_name != name)
+			return InvalidUniform;
+		return static_cast<UniformHandle>(it - m_uniforms.begin());
+	}
+
+	inline GLint Program::get_uniform_location(const char* name) const
+	{
+		const UniformHandle handle = get_uniform_handle(name);
+		return handle != InvalidUniform ? m_uniforms[handle].m_location : glGetUniformLocation(m_gl, name);
+	}
+
+	inline const std::vector<Program::Uniform>& Program::get_uniforms() const
+	{
+		return m_uniforms;
+	}
+
+	inline const std::vector<Program::Block>& Program::get_uniform_blocks() const
+	{
+		return m_uniform_blocks;
+	}
+
+	inline const std::vector<Program::Block>& Program::get_storage_blocks() const
+	{
+		return m_storage_blocks;
+	}
+
+	inline void Program::reflect()
+	{
+		GLint uniform_count = 0, max_name_length = 0;
+		glGetProgramInterfaceiv(m_gl, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniform_count);
+		glGetProgramInterfaceiv(m_gl, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_name_length);
+
+		std::vector<char> name(static_cast<std::size_t>(max_name_length) + 1);
+		auto get_name = [&](const GLenum interface, const GLuint index) {
+			GLsizei length = 0;
+			glGetProgramResourceName(m_gl, interface, index, GLsizei(name.size()), &length, name.data());
+			std::string str(name.data(), length);
+			// Arrays are reported as "name[0]", strip the suffix so they can be found by their base name.
+			if (str.size() > 3 && str.compare(str.size() - 3, 3, "[0]") == 0)
+				str.resize(str.size() - 3);
+			return str;
+		};
+
+		constexpr std::array<GLenum, 4> uniform_props = { GL_BLOCK_INDEX, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE };
+		m_uniforms.clear();
+		for (GLint index = 0; index < uniform_count; ++index) {
+			std::array<GLint, uniform_props.size()> values = {};
+			glGetProgramResourceiv(m_gl, GL_UNIFORM, index, GLsizei(uniform_props.size()), uniform_props.data(), GLsizei(values.size()), nullptr, values.data());
+			if (values[0] != -1 || values[2] == -1)
+				continue;
+
+			Uniform uniform;
+			uniform.m_name = get_name(GL_UNIFORM, index);
+			uniform.m_type = values[1];
+			uniform.m_location = values[2];
+			uniform.m_array_size = values[3];
+			uniform.m_value_sizeof = impl::get_uniform_sizeof(uniform.m_type);
+			m_uniforms.push_back(std::move(uniform));
+		}
+
+		std::sort(m_uniforms.begin(), m_uniforms.end(), [](const Uniform& a, const Uniform& b) {
+			return a.m_name < b.m_name;
+			});
+
+		GLuint values_sizeof = 0;
+		for (Uniform& uniform : m_uniforms) {
+			uniform.m_value_offset = values_sizeof;
+			values_sizeof += uniform.m_value_sizeof * uniform.m_array_size;
+		}
+		m_uniform_values.assign(values_sizeof, 0);
+
+		auto reflect_blocks = [&](const GLenum interface, std::vector<Block>& blocks) {
+			GLint block_count = 0, max_block_name_length = 0;
+			glGetProgramInterfaceiv(m_gl, interface, GL_ACTIVE_RESOURCES, &block_count);
+			glGetProgramInterfaceiv(m_gl, interface, GL_MAX_NAME_LENGTH, &max_block_name_length);
+			name.resize(std::max(name.size(), static_cast<std::size_t>(max_block_name_length) + 1));
+
+			constexpr std::array<GLenum, 2> block_props = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+			blocks.clear();
+			for (GLint index = 0; index < block_count; ++index) {
+				std::array<GLint, block_props.size()> values = {};
+				glGetProgramResourceiv(m_gl, interface, index, GLsizei(block_props.size()), block_props.data(), GLsizei(values.size()), nullptr, values.data());
+
+				Block block;
+				block.m_name = get_name(interface, index);
+				block.m_index = index;
+				block.m_binding = values[0];
+				block.m_data_size = values[1];
+				blocks.push_back(std::move(block));
+			}
+		};
+
+		reflect_blocks(GL_UNIFORM_BLOCK, m_uniform_blocks);
+		reflect_blocks(GL_SHADER_STORAGE_BLOCK, m_storage_blocks);
+	}
+
+	inline void Program::set_value(const UniformHandle handle, const void* data, const GLuint data_sizeof, const GLsizei count)
+	{
+		if (handle == InvalidUniform)
+			return;
+
+		Uniform& uniform = m_uniforms[handle];
+		PICOGL_ASSERT(data_sizeof == uniform.m_value_sizeof);
+		PICOGL_ASSERT(count <= uniform.m_array_size);
+
+		const std::size_t size = static_cast<std::size_t>(data_sizeof) * count;
+		char* value = m_uniform_values.data() + uniform.m_value_offset;
+		if (uniform.m_value_set && std::memcmp(value, data, size) == 0)
+			return;
+
+		std::memcpy(value, data, size);
+		uniform.m_value_set = (count == uniform.m_array_size);
+		impl::upload_uniform(m_gl, uniform.m_location, uniform.m_type, count, data);
+	}
+
+	inline bool Sampler::Parameters::operator==(const Parameters& rhs) const
+	{
+		return m_mag_filter == rhs.m_mag_filter
+			&& m_min_filter == rhs.m_min_filter
+			&& m_wrapping == rhs.m_wrapping
+			&& m_border_color == rhs.m_border_color
+			&& m_min_lod == rhs.m_min_lod
+			&& m_max_lod == rhs.m_max_lod
+			&& m_compare_mode == rhs.m_compare_mode
+			&& m_compare_func == rhs.m_compare_func;
+	}
+
+	inline Sampler Sampler::make(const Parameters& parameters)
+	{
+		Sampler sampler;
+		sampler.m_gl = impl::GLObject<impl::GLObjectType::Sampler>::make();
+		sampler.m_parameters = parameters;
+
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, parameters.m_mag_filter);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, parameters.m_min_filter);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, parameters.m_wrapping[0]);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, parameters.m_wrapping[1]);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, parameters.m_wrapping[2]);
+		glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, parameters.m_border_color.data());
+		glSamplerParameterf(sampler, GL_TEXTURE_MIN_LOD, parameters.m_min_lod);
+		glSamplerParameterf(sampler, GL_TEXTURE_MAX_LOD, parameters.m_max_lod);
+		glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_MODE, parameters.m_compare_mode);
+		glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_FUNC, parameters.m_compare_func);
+
+		return sampler;
+	}
+
+	inline void Sampler::bind(const GLuint unit) const
+	{
+		impl::bind_sampler(unit, m_gl);
+	}
+
+	inline const Sampler::Parameters& Sampler::parameters() const
+	{
+		return m_parameters;
+	}
+
+	inline Sampler::operator GLuint() const
+	{
+		return m_gl;
+	}
+
+	inline SamplerCache SamplerCache::make(const std::size_t capacity)
+	{
+		PICOGL_ASSERT(capacity > 0);
+		SamplerCache cache;
+		cache.m_capacity = capacity;
+		return cache;
+	}
+
+	inline const Sampler& SamplerCache::get(const Sampler::Parameters& parameters)
+	{
+		for (auto it = m_samplers.begin(); it != m_samplers.end(); ++it) {
+			if (it->parameters() == parameters) {
+				m_samplers.splice(m_samplers.begin(), m_samplers, it);
+				return m_samplers.front();
+			}
+		}
+
+		if (m_samplers.size() == m_capacity)
+			m_samplers.pop_back();
+		m_samplers.push_front(Sampler::make(parameters));
+		return m_samplers.front();
+	}
+
+	inline std::size_t SamplerCache::size() const
+	{
+		return m_samplers.size();
+	}
+
+	inline Texture Texture::make_1d(const GLenum internal_format, const GLsizei width, const GLsizei array_size, const void* data, const Options opts)
+	{
+		Texture texture;
+		const GLenum target = (array_size > 1 ? GL_TEXTURE_1D_ARRAY : GL_TEXTURE_1D);
+		texture.make(target, internal_format, array_size, 1, width, 0, 0, data, opts);
+		return texture;
+	}
+
+	inline Texture Texture::make_2d(const GLenum internal_format, const GLsizei width, const GLsizei height, const GLsizei array_size, const GLsizei sample_count, const void* data, const Options opts)
+	{
+		Texture texture;
+		const GLenum target = sample_count > 1 ?
+			(array_size > 1 ? GL_TEXTURE_2D_MULTISAMPLE_ARRAY : GL_TEXTURE_2D_MULTISAMPLE) :
+			(array_size > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
+		texture.make(target, internal_format, array_size, sample_count, width, height, 0, data, opts);
+		return texture;
+	}
+
+	inline Texture Texture::make_3d(const GLenum internal_format, const GLsizei width, const GLsizei height, const GLsizei depth, const void* data, const Options opts)
+	{
+		Texture texture;
+		texture.make(GL_TEXTURE_3D, internal_format, 1, 1, width, height, depth, data, opts);
+		return texture;
+	}
+
+	inline Texture Texture::make_cubemap(const GLenum internal_format, const GLsizei width, const GLsizei height, const GLsizei array_size, const Options opts)
+	{
+		Texture texture;
+		const GLenum target = (array_size > 1 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP);
+		texture.make(target, internal_format, array_size, 1, width, height, 0, nullptr, opts);
+		return texture;
+	}
+
+	inline GLsizei Texture::array_size() const
+	{
+		return m_array_size;
+	}
+
+	inline GLsizei Texture::sample_count() const
+	{
+		return m_sample_count;
+	}
+
+	inline Texture& Texture::bind()
+	{
+		impl::bind_texture(m_target, m_gl);
+		return *this;
+	}
+
+	inline const Texture& Texture::bind() const
+	{
+		impl::bind_texture(m_target, m_gl);
+		return *this;
+	}
+
+	inline Texture& Texture::set_swizzling(const std::array<GLint, 4>& swizzle_mask)
+	{
+		if (impl::skip_unchanged(m_swizzle, swizzle_mask))
+			return *this;
+
+#if PICOGL_USE_DSA
+		glTextureParameteriv(m_gl, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask.data());
+#else
+		bind();
+		glTexParameteriv(m_target, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask.data());
+#endif
+		return *this;
+	}
+
+	inline Texture& Texture::set_wrapping(const GLenum s, const GLenum t, const GLenum r)
+	{
+		if (impl::skip_unchanged(m_wrapping, { s, t, r }))
+			return *this;
+
+#if PICOGL_USE_DSA
+		glTextureParameteri(m_gl, GL_TEXTURE_WRAP_S, s);
+		glTextureParameteri(m_gl, GL_TEXTURE_WRAP_T, t);
+		if (m_depth > 1)
+			glTextureParameteri(m_gl, GL_TEXTURE_WRAP_R, r);
+#else
+		bind();
+		glTexParameteri(m_target, GL_TEXTURE_WRAP_S, s);
+		glTexParameteri(m_target, GL_TEXTURE_WRAP_T, t);
+		if (m_depth > 1)
+			glTexParameteri(m_target, GL_TEXTURE_WRAP_R, r);
+#endif
+		return *this;
+	}
+
+	inline Texture& Texture::set_filtering(const GLenum mag_filer, const GLenum min_filter)
+	{
+		if (impl::skip_unchanged(m_filtering, { mag_filer, min_filter }))
+			return *this;
+
+#if PICOGL_USE_DSA
+		glTextureParameteri(m_gl, GL_TEXTURE_MAG_FILTER, mag_filer);
+		glTextureParameteri(m_gl, GL_TEXTURE_MIN_FILTER, min_filter);
+#else
+		bind();
+		glTexParameteri(m_target, GL_TEXTURE_MAG_FILTER, mag_filer);
+		glTexParameteri(m_target, GL_TEXTURE_MIN_FILTER, min_filter);
+#endif
+		return *this;
+	}
+
+	inline Texture& Texture::set_alignment(const GLint pack, const GLint unpack)
+	{
+		glPixelStorei(GL_PACK_ALIGNMENT, pack);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, unpack);
+		return *this;
+	}
+
+	inline Texture& Texture::set_border_color(const std::array<float, 4>& rgba)
+	{
+		if (impl::skip_unchanged(m_border_color, rgba))
+			return *this;
+
+#if PICOGL_USE_DSA
+		glTextureParameterfv(m_gl, GL_TEXTURE_BORDER_COLOR, rgba.data());
+#else
+		bind();
+		glTexParameterfv(m_target, GL_TEXTURE_BORDER_COLOR, rgba.data());
+#endif
+		return *this;
+	}
+
+	inline Texture& Texture::upload_data(const void* data, GLuint level, GLuint layer, GLenum face)
+	{
+		PICOGL_INSTRUMENT_UPLOAD(Texture, upload_size());
+		// Cube map faces are addressed as layers, in the GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order.
+		const GLint face_index = face ? static_cast<GLint>(face - GL_TEXTURE_CUBE_MAP_POSITIVE_X) : 0;
+#if PICOGL_USE_DSA
+		switch (m_target)
+		{
+		case GL_TEXTURE_1D:
+			glTextureSubImage1D(m_gl, level, 0, m_width, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_1D_ARRAY:
+			glTextureSubImage2D(m_gl, level, 0, layer, m_width, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_2D:
+			glTextureSubImage2D(m_gl, level, 0, 0, m_width, m_height, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_CUBE_MAP:
+			glTextureSubImage3D(m_gl, level, 0, 0, face_index, m_width, m_height, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_2D_ARRAY:
+			glTextureSubImage3D(m_gl, level, 0, 0, layer, m_width, m_height, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_CUBE_MAP_ARRAY:
+			glTextureSubImage3D(m_gl, level, 0, 0, 6 * layer + face_index, m_width, m_height, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_3D:
+			glTextureSubImage3D(m_gl, level, 0, 0, 0, m_width, m_height, m_depth, m_format, m_type, data);
+			break;
+		default:
+			break;
+		}
+#else
+		bind();
+		switch (m_target)
+		{
+		case GL_TEXTURE_1D:
+			glTexSubImage1D(m_target, level, 0, m_width, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_1D_ARRAY:
+			glTexSubImage2D(m_target, level, 0, layer, m_width, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_2D:
+			glTexSubImage2D(m_target, level, 0, 0, m_width, m_height, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_CUBE_MAP:
+			glTexSubImage2D(face, level, 0, 0, m_width, m_height, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_2D_ARRAY:
+			glTexSubImage3D(m_target, level, 0, 0, layer, m_width, m_height, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_CUBE_MAP_ARRAY:
+			glTexSubImage3D(m_target, level, 0, 0, 6 * layer + face_index, m_width, m_height, 1, m_format, m_type, data);
+			break;
+		case GL_TEXTURE_3D:
+			glTexSubImage3D(m_target, level, 0, 0, 0, m_width, m_height, m_depth, m_format, m_type, data);
+			break;
+		default:
+			break;
+		}
+#endif
+		return *this;
+	}
+
+	inline Texture& Texture::upload_data(UploadPool::Staging&& staging, GLuint level, GLuint layer, GLenum face)
+	{
+		const UploadPool::Staging consumed = std::move(staging);
+		PICOGL_ASSERT(consumed);
+
+		(*consumed.m_slots)[consumed.m_slot].m_buffer.bind(GL_PIXEL_UNPACK_BUFFER);
+		upload_data(nullptr, level, layer, face);
+		impl::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return *this;
+	}
+
+	inline void Texture::bind_as_sampler(const GLuint slot, const Sampler* sampler) const
+	{
+		PICOGL_ASSERT(slot >= GL_TEXTURE0);
+		impl::bind_sampler(slot - GL_TEXTURE0, sampler ? GLuint(*sampler) : 0);
+#if PICOGL_USE_DSA
+		impl::bind_texture_unit(slot - GL_TEXTURE0, m_target, m_gl);
+#else
+		impl::active_texture(slot);
+		bind();
+#endif
+	}
+
+	inline void Texture::bind_as_image(const GLuint unit, const GLint level, const GLint layer, const GLenum access) const
+	{
+		glBindImageTexture(unit, m_gl, level, (m_array_size > 1), layer, access, m_internal_format);
+	}
+
+	inline Texture::operator GLuint() const
+	{
+		return m_gl;
+	}
+
+	inline GLenum Texture::get_format() const
+	{
+		return m_format;
+	}
+
+	inline GLenum Texture::get_target() const
+	{
+		return m_target;
+	}
+
+	inline GLenum Texture::get_type() const
+	{
+		return m_type;
+	}
+
+	inline GLenum Texture::get_internal_format() const
+	{
+		return m_internal_format;
+	}
+
+	inline GLsizei Texture::width() const
+	{
+		return m_width;
+	}
+
+	inline GLsizei Texture::height() const
+	{
+		return m_height;
+	}
+
+	inline GLsizei Texture::depth() const
+	{
+		return m_depth;
+	}
+
+	inline void Texture::make(
+		const GLenum target,
+		const GLenum internal_format,
+		const GLsizei array_size,
+		const GLsizei sample_count,
+		const GLsizei width,
+		const GLsizei height,
+		const GLsizei depth,
+		const void* data,
+		const Options opts)
+	{
+		const impl::PixelInfo pixel_info = impl::get_pixel_info(internal_format);
+
+		m_gl = impl::GLObject<impl::GLObjectType::Texture>::make(target);
+		m_target = target;
+		m_internal_format = internal_format;
+		m_format = pixel_info.m_format;
+		m_type = pixel_info.m_type;
+		m_array_size = array_size;
+		m_sample_count = sample_count;
+		m_width = width;
+		m_height = height;
+		m_depth = depth;
+		m_opts = opts;
+
+		if (bool(m_opts & Options::AutomaticAlignment))
+		{
+			if ((pixel_info.m_scalar_sizeof * m_width) % 4 != 0) {
+				glPixelStorei(GL_PACK_ALIGNMENT, 1);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			}
+		}
+
+		const GLboolean fixed_locations = bool(m_opts & Options::FixedSampleLocations);
 		const bool allocate_mipmap = bool(m_opts & Options::AllocateMipmap);
+#if PICOGL_USE_DSA
+		switch (m_target) {
+		case GL_TEXTURE_1D:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_1D() : 1;
+			glTextureStorage1D(m_gl, lod_count, m_internal_format, m_width);
+			if (data)
+				upload_data(data);
+			break;
+		}
+		case GL_TEXTURE_1D_ARRAY:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_1D() : 1;
+			glTextureStorage2D(m_gl, lod_count, m_internal_format, m_width, m_array_size);
+			break;
+		}
+		case GL_TEXTURE_2D:
+		case GL_TEXTURE_CUBE_MAP:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_2D() : 1;
+			glTextureStorage2D(m_gl, lod_count, m_internal_format, m_width, m_height);
+			if (data && m_target == GL_TEXTURE_2D)
+				upload_data(data);
+			break;
+		}
+		case GL_TEXTURE_2D_MULTISAMPLE:
+		{
+			glTextureStorage2DMultisample(m_gl, m_sample_count, m_internal_format, m_width, m_height, fixed_locations);
+			break;
+		}
+		case GL_TEXTURE_2D_ARRAY:
+		case GL_TEXTURE_CUBE_MAP_ARRAY:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_2D() : 1;
+			glTextureStorage3D(m_gl, lod_count, m_internal_format, m_width, m_height, m_array_size * (m_target == GL_TEXTURE_CUBE_MAP_ARRAY ? 6 : 1));
+			break;
+		}
+		case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+		{
+			glTextureStorage3DMultisample(m_gl, m_sample_count, m_internal_format, m_width, m_height, m_array_size, fixed_locations);
+			break;
+		}
+		case GL_TEXTURE_3D:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_3D() : 1;
+			glTextureStorage3D(m_gl, lod_count, m_internal_format, m_width, m_height, m_depth);
+			if (data)
+				upload_data(data);
+			break;
+		}
+		default:
+			PICOGL_ASSERT(false);
+			break;
+		}
+
+		if (bool(opts & Options::GenerateMipmap))
+			glGenerateTextureMipmap(m_gl);
+#else
+		bind();
+
+		switch (m_target) {
+		case GL_TEXTURE_1D:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_1D() : 1;
+			glTexStorage1D(m_target, lod_count, m_internal_format, m_width);
+			if (data) {
+				PICOGL_INSTRUMENT_UPLOAD(Texture, upload_size());
+				glTexSubImage1D(m_target, 0, 0, m_width, m_format, m_type, data);
+			}
+			break;
+		}
+		case GL_TEXTURE_1D_ARRAY:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_1D() : 1;
+			glTexStorage2D(m_target, lod_count, m_internal_format, m_width, m_array_size);
+			break;
+		}
+		case GL_TEXTURE_2D:
+		case GL_TEXTURE_CUBE_MAP:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_2D() : 1;
+			glTexStorage2D(m_target, lod_count, m_internal_format, m_width, m_height);
+			if (data) {
+				PICOGL_INSTRUMENT_UPLOAD(Texture, upload_size());
+				glTexSubImage2D(m_target, 0, 0, 0, m_width, m_height, m_format, m_type, data);
+			}
+			break;
+		}
+		case GL_TEXTURE_2D_MULTISAMPLE:
+		{
+			glTexStorage2DMultisample(m_target, m_sample_count, m_internal_format, m_width, m_height, fixed_locations);
+			break;
+		}
+		case GL_TEXTURE_2D_ARRAY:
+		case GL_TEXTURE_CUBE_MAP_ARRAY:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_2D() : 1;
+			glTexStorage3D(m_target, lod_count, m_internal_format, m_width, m_height, m_array_size * (m_target == GL_TEXTURE_CUBE_MAP_ARRAY ? 6 : 1));
+			break;
+		}
+		case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+		{
+			glTexStorage3DMultisample(m_target, m_sample_count, m_internal_format, m_width, m_height, m_array_size, fixed_locations);
+			break;
+		}
+		case GL_TEXTURE_3D:
+		{
+			const GLsizei lod_count = allocate_mipmap ? lod_count_3D() : 1;
+			glTexStorage3D(m_target, lod_count, m_internal_format, m_width, m_height, m_depth);
+			if (data) {
+				PICOGL_INSTRUMENT_UPLOAD(Texture, upload_size());
+				glTexSubImage3D(m_target, 0, 0, 0, 0, m_width, m_height, m_depth, m_format, m_type, data);
+			}
+			break;
+		}
+		default:
+			PICOGL_ASSERT(false);
+			break;
+		}
+
+		if (bool(opts & Options::GenerateMipmap))
+			glGenerateMipmap(m_target);
+#endif
+		impl::MemoryRegistry::get().allocate(impl::GLObjectType::Texture, m_gl, storage_size());
+
+		std::string str;
+		gl_debug(str);
+	}
+
+	inline GLsizei Texture::lod_count_1D() const
+	{
+		return static_cast<GLsizei>(std::floor(std::log2(m_width))) + 1;
+	}
+
+	inline GLsizei Texture::lod_count_2D() const
+	{
+		return static_cast<GLsizei>(std::floor(std::log2(std::max(m_width, m_height)))) + 1;
+	}
+
+	inline GLsizei Texture::lod_count_3D() const
+	{
+		return static_cast<GLsizei>(std::floor(std::log2(std::max({ m_width, m_height, m_depth })))) + 1;
+	}
+
+	inline GLsizeiptr Texture::storage_size() const
+	{
+		GLsizei lod_count = 1;
+		GLsizeiptr layer_count = m_array_size;
+		bool has_height = true;
+		bool has_depth = false;
 		switch (m_target) {
 		case GL_TEXTURE_1D:
+		case GL_TEXTURE_1D_ARRAY:
+			lod_count = lod_count_1D();
+			has_height = false;
+			break;
+		case GL_TEXTURE_CUBE_MAP:
+		case GL_TEXTURE_CUBE_MAP_ARRAY:
+			// Six faces per layer, as allocated by make() with and without DSA.
+			lod_count = lod_count_2D();
+			layer_count *= 6;
+			break;
+		case GL_TEXTURE_3D:
+			lod_count = lod_count_3D();
+			has_depth = true;
+			break;
+		default:
+			lod_count = lod_count_2D();
+			break;
+		}
+		if (!bool(m_opts & Options::AllocateMipmap) || m_sample_count > 1)
+			lod_count = 1;
+
+		GLsizeiptr texel_count = 0;
+		for (GLsizei lod = 0; lod < lod_count; ++lod)
+			texel_count += GLsizeiptr(std::max(m_width >> lod, 1))
+				* (has_height ? std::max(m_height >> lod, 1) : 1)
+				* (has_depth ? std::max(m_depth >> lod, 1) : 1);
+
+		const impl::PixelInfo pixel_info = impl::get_pixel_info(m_internal_format);
+		return texel_count * layer_count * m_sample_count * pixel_info.m_channel_count * pixel_info.m_scalar_sizeof;
+	}
+
+	inline GLsizeiptr Texture::upload_size() const
+	{
+		const bool has_height = m_target != GL_TEXTURE_1D && m_target != GL_TEXTURE_1D_ARRAY;
+		const bool has_depth = m_target == GL_TEXTURE_3D;
+		const impl::PixelInfo pixel_info = impl::get_pixel_info(m_internal_format);
+		return GLsizeiptr(m_width) * (has_height ? m_height : 1) * (has_depth ? m_depth : 1) * pixel_info.m_channel_count * pixel_info.m_scalar_sizeof;
+	}
+
+	inline Texture& Texture::set_label(const std::string& label)
+	{
+		MemoryStats::set_label(impl::GLObjectType::Texture, m_gl, label);
+		return *this;
+	}
+
+	inline void Texture::generate_mipmap() const
+	{
+#if PICOGL_USE_DSA
+		glGenerateTextureMipmap(m_gl);
+#else
+		bind();
+		glGenerateMipmap(m_target);
+#endif
+	}
+
+	inline UploadPool UploadPool::make(const GLsizei slot_count)
+	{
+		PICOGL_ASSERT(slot_count > 0);
+		UploadPool pool;
+		pool.m_slots = std::make_shared<std::vector<Slot>>(slot_count);
+		return pool;
+	}
+
+	inline UploadPool::Staging UploadPool::acquire(const GLsizeiptr size)
+	{
+		PICOGL_ASSERT(m_slots && size > 0);
+
+		Slot& slot = (*m_slots)[m_next];
+		PICOGL_ASSERT(!slot.m_acquired);
+		slot.m_fence.wait();
+		slot.m_fence = Fence();
+		if (!slot.m_buffer || slot.m_buffer.get_size() < size)
+			slot.m_buffer = Buffer::make_persistent(GL_PIXEL_UNPACK_BUFFER, size);
+		slot.m_acquired = true;
+
+		Staging staging;
+		staging.m_slots = m_slots;
+		staging.m_slot = m_next;
+		staging.m_data = slot.m_buffer.get_mapped_data();
+		staging.m_size = size;
+
+		m_next = (m_next + 1) % m_slots->size();
+		return staging;
+	}
+
+	inline UploadPool::Staging UploadPool::acquire(const Texture& texture)
+	{
+		const impl::PixelInfo pixel_info = impl::get_pixel_info(texture.get_internal_format());
+
+		GLint alignment = 4;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+		const GLsizeiptr row_size = GLsizeiptr(texture.width()) * pixel_info.m_channel_count * pixel_info.m_scalar_sizeof;
+		const GLsizeiptr row_stride = ((row_size + alignment - 1) / alignment) * alignment;
+
+		GLsizeiptr row_count = 1;
+		switch (texture.get_target())
+		{
+		case GL_TEXTURE_1D:
+		case GL_TEXTURE_1D_ARRAY:
+			break;
+		case GL_TEXTURE_3D:
+			row_count = GLsizeiptr(texture.height()) * texture.depth();
+			break;
+		default:
+			row_count = texture.height();
+			break;
+		}
+
+		Staging staging = acquire(row_stride * row_count);
+		staging.m_row_stride = row_stride;
+		return staging;
+	}
+
+	inline UploadPool::Staging::Staging() = default;
+
+	inline UploadPool::Staging::Staging(Staging&& rhs) noexcept
+	{
+		*this = std::move(rhs);
+	}
+
+	inline UploadPool::Staging& UploadPool::Staging::operator=(Staging&& rhs) noexcept
+	{
+		std::swap(m_slots, rhs.m_slots);
+		std::swap(m_slot, rhs.m_slot);
+		std::swap(m_data, rhs.m_data);
+		std::swap(m_size, rhs.m_size);
+		std::swap(m_row_stride, rhs.m_row_stride);
+		return *this;
+	}
+
+	inline UploadPool::Staging::~Staging()
+	{
+		if (!m_slots)
+			return;
+
+		// Fenced even if never uploaded, the next acquire of this slot then only waits on prior work.
+		Slot& slot = (*m_slots)[m_slot];
+		slot.m_fence = Fence::make();
+		slot.m_acquired = false;
+	}
+
+	inline void* UploadPool::Staging::data() const
+	{
+		return m_data;
+	}
+
+	inline GLsizeiptr UploadPool::Staging::size() const
+	{
+		return m_size;
+	}
+
+	inline GLsizeiptr UploadPool::Staging::row_stride() const
+	{
+		return m_row_stride;
+	}
+
+	inline UploadPool::Staging::operator bool() const
+	{
+		return m_data != nullptr;
+	}
+
+	inline Framebuffer Framebuffer::make(const GLsizei width, const GLsizei height, const GLsizei sample_count)
+	{
+		Framebuffer framebuffer;
+		framebuffer.m_gl = impl::GLObject<impl::GLObjectType::Framebuffer>::make();
+		framebuffer.m_sample_count = sample_count;
+		framebuffer.m_width = width;
+		framebuffer.m_height = height;
+		return framebuffer;
+	}
+
+	inline Framebuffer Framebuffer::get_default(const GLsizei width, const GLsizei height, const GLsizei sample_count)
+	{
+		Framebuffer fb;
+		fb.m_sample_count = sample_count;
+		fb.m_width = width;
+		fb.m_height = height;
+		return fb;
+	}
+
+	inline Framebuffer& Framebuffer::set_depth_attachment(const GLenum format, const bool sampleable)
+	{
+		if (sampleable) {
+			m_depth_attachment = {};
+			m_depth_texture = Texture::make_2d(format, m_width, m_height, 1, m_sample_count, nullptr,
+				Texture::Options::FixedSampleLocations | Texture::Options::AutomaticAlignment);
+			// Depth is fetched texel by texel, the default mipmap filtering would leave the texture incomplete.
+			if (m_sample_count == 1)
+				m_depth_texture.set_filtering(GL_NEAREST, GL_NEAREST);
+#if PICOGL_USE_DSA
+			glNamedFramebufferTexture(m_gl, GL_DEPTH_ATTACHMENT, m_depth_texture, 0);
+#else
+			bind();
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth_texture.get_target(), m_depth_texture, 0);
+#endif
+			return *this;
+		}
+
+		m_depth_texture = {};
+		m_depth_attachment = impl::GLObject<impl::GLObjectType::RenderBuffer>::make();
+#if PICOGL_USE_DSA
+		if (m_sample_count > 1)
+			glNamedRenderbufferStorageMultisample(m_depth_attachment, m_sample_count, format, m_width, m_height);
+		else
+			glNamedRenderbufferStorage(m_depth_attachment, format, m_width, m_height);
+
+		glNamedFramebufferRenderbuffer(m_gl, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_attachment);
+#else
+		glBindRenderbuffer(GL_RENDERBUFFER, m_depth_attachment);
+		if (m_sample_count > 1)
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_sample_count, format, m_width, m_height);
+		else
+			glRenderbufferStorage(GL_RENDERBUFFER, format, m_width, m_height);
+
+		bind();
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_attachment);
+#endif
+		const impl::PixelInfo pixel_info = impl::get_pixel_info(format);
+		impl::MemoryRegistry::get().allocate(impl::GLObjectType::RenderBuffer, m_depth_attachment,
+			GLsizeiptr(m_width) * m_height * m_sample_count * pixel_info.m_channel_count * pixel_info.m_scalar_sizeof);
+		return *this;
+	}
+
+	inline Framebuffer& Framebuffer::add_color_attachment(const GLenum internal_format, const GLenum target, Texture::Options options)
+	{
+		const GLenum attachment_index = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(m_color_attachments.size());
+		if (m_depth_attachment || m_depth_texture)
+			options = options | Texture::Options::FixedSampleLocations | Texture::Options::AutomaticAlignment;
+
+		m_attachments.push_back(attachment_index);
+		switch (target)
 		{
-			const GLsizei lod_count = allocate_mipmap ? lod_count_1D() : 1;
-			glTexStorage1D(m_target, lod_count, m_internal_format, m_width);
-			if (data)
-				glTexSubImage1D(m_target, 0, 0, m_width, m_format, m_type, data);
+		default:
+		case GL_TEXTURE_2D:
+			m_color_attachments.push_back(Texture::make_2d(internal_format, m_width, m_height, 1, m_sample_count, nullptr, options));
 			break;
+		case GL_TEXTURE_CUBE_MAP:
+			m_color_attachments.push_back(Texture::make_cubemap(internal_format, m_width, m_height, 1, options));
+			break;
+		}
+
+		const Texture& attachment = m_color_attachments.back();
+#if PICOGL_USE_DSA
+		glNamedFramebufferTexture(m_gl, attachment_index, attachment, 0);
+#else
+		bind();
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment_index, attachment.get_target(), attachment, 0);
+#endif
+		return *this;
+	}
+
+	inline void Framebuffer::bind(const GLenum target) const
+	{
+		impl::bind_framebuffer(target, m_gl);
+	}
+
+	inline void Framebuffer::bind_read(const GLenum attachment) const
+	{
+		//PICOGL_ASSERT(attachment >= GL_COLOR_ATTACHMENT0);
+		bind(GL_READ_FRAMEBUFFER);
+		glReadBuffer(attachment);
+	}
+
+	inline void Framebuffer::bind_draw(const GLenum attachment) const
+	{
+		PICOGL_ASSERT(attachment >= GL_COLOR_ATTACHMENT0);
+		bind(GL_DRAW_FRAMEBUFFER);
+		if (m_gl)
+			glDrawBuffers(1, &attachment);
+	}
+
+	inline void Framebuffer::bind_draw() const
+	{
+		bind(GL_DRAW_FRAMEBUFFER);
+		if (m_gl) {
+			PICOGL_ASSERT(!m_attachments.empty());
+			glDrawBuffers(static_cast<GLsizei>(m_attachments.size()), m_attachments.data());
+		}
+	}
+
+	inline void Framebuffer::clear(const std::array<float, 4>& rgba, GLenum mask) const
+	{
+		bind_draw();
+		glClearColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+		glClear(mask);
+	}
+
+	inline void Framebuffer::readback(void* dst, GLint x, GLint y, GLsizei width, GLsizei height, GLenum attach_from) const
+	{
+		bind_read(attach_from);
+		const Texture& attachment = m_color_attachments[attach_from - GL_COLOR_ATTACHMENT0];
+		glReadPixels(x, y, width, height, attachment.get_format(), attachment.get_type(), dst);
+	}
+
+	inline void Framebuffer::readback(void* dst, GLenum attach_from) const
+	{
+		readback(dst, 0, 0, m_width, m_height, attach_from);
+	}
+
+	inline Framebuffer::Readback Framebuffer::readback_async(GLint x, GLint y, GLsizei width, GLsizei height, GLenum attach_from) const
+	{
+		PICOGL_ASSERT(attach_from >= GL_COLOR_ATTACHMENT0 && attach_from - GL_COLOR_ATTACHMENT0 < m_color_attachments.size());
+		PICOGL_ASSERT(x >= 0 && y >= 0 && x + width <= m_width && y + height <= m_height);
+		const Texture& attachment = m_color_attachments[attach_from - GL_COLOR_ATTACHMENT0];
+		const impl::PixelInfo pixel_info = impl::get_pixel_info(attachment.get_internal_format());
+
+		GLint alignment = 4;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+		const GLsizeiptr row_size = GLsizeiptr(width) * pixel_info.m_channel_count * pixel_info.m_scalar_sizeof;
+		const GLsizeiptr aligned_row_size = ((row_size + alignment - 1) / alignment) * alignment;
+
+		if (!m_readback_pool)
+			m_readback_pool = std::make_shared<impl::BufferPool>(GL_PIXEL_PACK_BUFFER,
+				GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_CLIENT_STORAGE_BIT);
+
+		Readback readback;
+		readback.m_pool = m_readback_pool;
+		readback.m_buffer = m_readback_pool->acquire(aligned_row_size * height);
+		readback.m_width = width;
+		readback.m_height = height;
+
+		bind_read(attach_from);
+		readback.m_buffer.bind(GL_PIXEL_PACK_BUFFER);
+		glReadPixels(x, y, width, height, attachment.get_format(), attachment.get_type(), nullptr);
+		impl::bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+		readback.m_fence = Fence::make();
+
+		return readback;
+	}
+
+	inline Framebuffer::Readback::Readback() = default;
+
+	inline Framebuffer::Readback::Readback(Readback&& rhs) noexcept
+	{
+		*this = std::move(rhs);
+	}
+
+	inline Framebuffer::Readback& Framebuffer::Readback::operator=(Readback&& rhs) noexcept
+	{
+		std::swap(m_pool, rhs.m_pool);
+		std::swap(m_buffer, rhs.m_buffer);
+		std::swap(m_fence, rhs.m_fence);
+		std::swap(m_width, rhs.m_width);
+		std::swap(m_height, rhs.m_height);
+		return *this;
+	}
+
+	inline Framebuffer::Readback::~Readback()
+	{
+		if (m_pool)
+			m_pool->release(std::move(m_buffer));
+	}
+
+	inline bool Framebuffer::Readback::ready() const
+	{
+		return m_buffer && m_fence.signaled();
+	}
+
+	inline const void* Framebuffer::Readback::map() const
+	{
+		m_fence.wait();
+		return m_buffer.get_mapped_data();
+	}
+
+	inline GLsizei Framebuffer::Readback::width() const
+	{
+		return m_width;
+	}
+
+	inline GLsizei Framebuffer::Readback::height() const
+	{
+		return m_height;
+	}
+
+	inline Framebuffer::Readback::operator bool() const
+	{
+		return m_buffer;
+	}
+
+	inline void Framebuffer::blit_to(Framebuffer& to, const GLenum attachment_to, const GLenum filter, const GLenum attachment_from) const
+	{
+		blit_to(to, 0, 0, to.m_width, to.m_height, attachment_to, filter, 0, 0, m_width, m_height, attachment_from);
+	}
+
+	inline void Framebuffer::blit_to(Framebuffer& to, GLint to_x, GLint to_y, GLint to_w, GLint to_h, const GLenum attachment_to, const GLenum filter, GLint from_x, GLint from_y, GLint from_w, GLint from_h, const GLenum attachment_from) const
+	{
+#if PICOGL_USE_DSA
+		glNamedFramebufferReadBuffer(m_gl, attachment_from);
+		if (to.m_gl)
+			glNamedFramebufferDrawBuffers(to.m_gl, 1, &attachment_to);
+		glBlitNamedFramebuffer(m_gl, to.m_gl, from_x, from_y, from_w, from_h, to_x, to_y, to_w, to_h, GL_COLOR_BUFFER_BIT, filter);
+#else
+		bind_read(attachment_from);
+		to.bind_draw(attachment_to);
+		glBlitFramebuffer(from_x, from_y, from_w, from_h, to_x, to_y, to_w, to_h, GL_COLOR_BUFFER_BIT, filter);
+#endif
+	}
+
+	inline void Framebuffer::blit_depth_to(Framebuffer& to) const
+	{
+#if PICOGL_USE_DSA
+		glBlitNamedFramebuffer(m_gl, to.m_gl, 0, 0, m_width, m_height, 0, 0, to.m_width, to.m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+#else
+		bind(GL_READ_FRAMEBUFFER);
+		to.bind(GL_DRAW_FRAMEBUFFER);
+		glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, to.m_width, to.m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+#endif
+	}
+
+	inline GLsizei Framebuffer::sample_count() const
+	{
+		return m_sample_count;
+	}
+
+	inline GLsizei Framebuffer::width() const
+	{
+		return m_width;
+	}
+
+	inline GLsizei Framebuffer::height() const
+	{
+		return m_height;
+	}
+
+	inline const std::vector<Texture>& Framebuffer::color_attachments() const
+	{
+		return m_color_attachments;
+	}
+
+	inline const Texture& Framebuffer::depth_texture() const
+	{
+		PICOGL_ASSERT(m_depth_texture);
+		return m_depth_texture;
+	}
+
+	inline GLuint Framebuffer::depth_handle() const
+	{
+		return m_depth_texture ? GLuint(m_depth_texture) : GLuint(m_depth_attachment);
+	}
+
+	inline Framebuffer::operator GLuint() const
+	{
+		return m_gl;
+	}
+
+	inline Mesh Mesh::make()
+	{
+		Mesh mesh;
+		mesh.m_vao = impl::GLObject<impl::GLObjectType::VertexArray>::make();
+		return mesh;
+	}
+
+	inline Mesh Mesh::combine(const std::vector<std::reference_wrapper<const Mesh>>& meshes)
+	{
+		PICOGL_ASSERT(meshes.size() > 0);
+		const GLuint attribute_count = GLuint(meshes.front().get().m_vertex_attributes.size());
+		PICOGL_ASSERT(attribute_count > 0);
+
+		Mesh dst = Mesh::make();
+
+		std::size_t total_submesh_count = 0;
+		std::size_t total_instance_count = 0;
+		GLsizeiptr vertex_buffer_size = 0;
+		GLsizeiptr total_index_count = 0;
+
+		for (const auto& mesh_ref : meshes) {
+			const Mesh& mesh = mesh_ref.get();
+
+			total_submesh_count += mesh.m_submeshes.size();
+			dst.m_vertex_count += mesh.m_vertex_count;
+			vertex_buffer_size += mesh.m_vertex_buffer.get_size();
+
+			dst.m_index_count += mesh.m_index_count;
+			total_index_count += mesh.get_total_index_count();
+
+			total_instance_count += mesh.m_instances_count.size();
+
+			if (!dst.m_primitive_type)
+				dst.m_primitive_type = mesh.m_primitive_type;
+			else
+				PICOGL_ASSERT(dst.m_primitive_type == mesh.m_primitive_type);
+
+			// Indices stay relative to each mesh vertices, the widest type holds them all.
+			if (!dst.m_indice_type || impl::get_scalar_sizeof(mesh.m_indice_type) > impl::get_scalar_sizeof(dst.m_indice_type))
+				dst.m_indice_type = mesh.m_indice_type;
+
+			// Vertex buffers are copied as is, layouts must match.
+			PICOGL_ASSERT(mesh.has_same_layout(meshes.front().get()));
+		}
+
+		dst.m_index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, total_index_count * impl::get_scalar_sizeof(dst.m_indice_type));
+		dst.m_vertex_buffer = Buffer::make(GL_ARRAY_BUFFER, vertex_buffer_size);
+
+		GLsizei attributes_sizeof = 0;
+		for (const Mesh::VertexAttribute& attribute : meshes.front().get().m_vertex_attributes)
+			attributes_sizeof += impl::get_attribute_sizeof(attribute.m_type, attribute.m_channel_count);
+
+		// Setup attribs pointers.
+#if PICOGL_USE_DSA
+		glVertexArrayElementBuffer(dst.m_vao, dst.m_index_buffer);
+		glVertexArrayVertexBuffer(dst.m_vao, 0, dst.m_vertex_buffer, 0, attributes_sizeof);
+#else
+		impl::bind_vertex_array(dst.m_vao);
+		dst.m_vertex_buffer.bind();
+#endif
+
+		GLsizeiptr attribute_offset = 0;
+		for (GLuint index = 0; index < attribute_count; ++index) {
+			const Mesh::VertexAttribute& attribute = meshes.front().get().m_vertex_attributes[index];
+			dst.setup_attribute_pointer(index, 0, attribute_offset, attributes_sizeof, attribute);
+			attribute_offset += impl::get_attribute_sizeof(attribute.m_type, attribute.m_channel_count);
 		}
-		case GL_TEXTURE_1D_ARRAY:
-		{
-			const GLsizei lod_count = allocate_mipmap ? lod_count_1D() : 1;
-			glTexStorage2D(m_target, lod_count, m_internal_format, m_width, m_array_size);
-			break;
+
+		// Combine submeshes and gpu-copy buffers.
+		GLsizeiptr dst_vertex_size_offset = 0;
+		GLsizei index_offset = 0;
+		GLsizei index_count = 0;
+		std::size_t global_submesh_id = 0;
+		dst.m_instances_count.resize(total_instance_count);
+		dst.m_submeshes.resize(total_submesh_count);
+		for (const auto& mesh_ref : meshes) {
+			const Mesh& mesh = mesh_ref.get();
+
+			std::size_t local_submesh_id = 0;
+			for (const SubMesh& src_submesh : mesh.m_submeshes)
+			{
+				SubMesh& submesh = dst.m_submeshes[global_submesh_id];
+				submesh.m_first_index = index_count + src_submesh.m_first_index;
+				submesh.m_index_count = src_submesh.m_index_count;
+				submesh.m_indice_offset = src_submesh.m_indice_offset + index_offset;
+				submesh.m_lods = src_submesh.m_lods;
+				for (LodRange& lod : submesh.m_lods)
+					lod.m_first_index += index_count;
+
+				dst.m_instances_count[global_submesh_id] = mesh.m_instances_count[local_submesh_id];
+				++local_submesh_id;
+				++global_submesh_id;
+			}
+
+			const GLsizeiptr mesh_index_count = mesh.get_total_index_count();
+			copy_indices(mesh.m_index_buffer, mesh.m_indice_type, 0, dst.m_index_buffer, dst.m_indice_type, index_count, mesh_index_count);
+
+			index_offset += mesh.m_vertex_count;
+			index_count += GLsizei(mesh_index_count);
+
+			mesh.m_vertex_buffer.copy_to(dst.m_vertex_buffer, dst_vertex_size_offset);
+			dst_vertex_size_offset += mesh.m_vertex_buffer.get_size();
 		}
-		case GL_TEXTURE_2D:
-		case GL_TEXTURE_CUBE_MAP:
+
+		dst.set_instances_count(dst.m_instances_count);
+		return dst;
+	}
+
+	inline Mesh& Mesh::set_vertex_attributes(const std::vector<VertexAttribute>& attributes, const Layout layout)
+	{
+		PICOGL_ASSERT(m_vao);
+		m_vertex_attributes = attributes;
+		m_layout = layout;
+		m_vertex_count = 0;
+
+		GLsizeiptr total_size = 0;
+		GLsizei attributes_sizeof = 0;
+		m_stream_offsets.clear();
+		for (const VertexAttribute& attribute : attributes)
 		{
-			const GLsizei lod_count = allocate_mipmap ? lod_count_2D() : 1;
-			glTexStorage2D(m_target, lod_count, m_internal_format, m_width, m_height);
-			if (data)
-				glTexSubImage2D(m_target, 0, 0, 0, m_width, m_height, m_format, m_type, data);
-			break;
+			PICOGL_ASSERT(attribute.m_size > 0);
+			const GLuint attribute_sizeof = impl::get_attribute_sizeof(attribute.m_type, attribute.m_channel_count);
+			PICOGL_ASSERT(attribute.m_size % attribute_sizeof == 0);
+
+			const GLsizei vertex_count = static_cast<GLsizei>(attribute.m_size / attribute_sizeof);
+			if (!m_vertex_count)
+				m_vertex_count = vertex_count;
+			else
+				PICOGL_ASSERT(vertex_count == m_vertex_count);
+
+			m_stream_offsets.push_back(total_size);
+			total_size += attribute.m_size;
+			attributes_sizeof += attribute_sizeof;
 		}
-		case GL_TEXTURE_2D_MULTISAMPLE:
+		m_vertex_buffer = Buffer::make(GL_ARRAY_BUFFER, total_size);
+
+#if !PICOGL_USE_DSA
+		impl::bind_vertex_array(m_vao);
+		m_vertex_buffer.bind();
+#endif
+		// Attributes are written straight into the mapped storage, no intermediate copy.
+		char* vertex_data = static_cast<char*>(m_vertex_buffer.map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		PICOGL_ASSERT(vertex_data);
+
+		GLsizeiptr interleaved_offset = 0;
+		for (GLuint index = 0; index < GLuint(attributes.size()); ++index)
 		{
-			glTexStorage2DMultisample(m_target, m_sample_count, m_internal_format, m_width, m_height, fixed_locations);
-			break;
+			const VertexAttribute& attribute = attributes[index];
+			const GLuint attribute_sizeof = impl::get_attribute_sizeof(attribute.m_type, attribute.m_channel_count);
+			if (layout == Layout::Interleaved) {
+				impl::copy_strided(vertex_data + interleaved_offset, attributes_sizeof, attribute.m_data, attribute_sizeof, m_vertex_count);
+				setup_attribute_pointer(index, 0, interleaved_offset, attributes_sizeof, attribute);
+				interleaved_offset += attribute_sizeof;
+			} else {
+				std::memcpy(vertex_data + m_stream_offsets[index], attribute.m_data, attribute.m_size);
+#if PICOGL_USE_DSA
+				glVertexArrayVertexBuffer(m_vao, index, m_vertex_buffer, m_stream_offsets[index], attribute_sizeof);
+				setup_attribute_pointer(index, index, 0, attribute_sizeof, attribute);
+#else
+				setup_attribute_pointer(index, index, m_stream_offsets[index], attribute_sizeof, attribute);
+#endif
+			}
 		}
-		case GL_TEXTURE_2D_ARRAY:
-		case GL_TEXTURE_CUBE_MAP_ARRAY:
-		{
-			const GLsizei lod_count = allocate_mipmap ? lod_count_2D() : 1;
-			glTexStorage3D(m_target, lod_count, m_internal_format, m_width, m_height, m_array_size);
-			break;
+		m_vertex_buffer.unmap();
+
+#if PICOGL_USE_DSA
+		if (layout == Layout::Interleaved)
+			glVertexArrayVertexBuffer(m_vao, 0, m_vertex_buffer, 0, attributes_sizeof);
+#endif
+		return *this;
+	}
+
+	inline Mesh& Mesh::update_vertex_attribute(const GLuint index, const VertexAttribute& attribute)
+	{
+		PICOGL_ASSERT(m_layout == Layout::Separate && index < m_vertex_attributes.size());
+		const VertexAttribute& current = m_vertex_attributes[index];
+		PICOGL_ASSERT(attribute.m_type == current.m_type && attribute.m_channel_count == current.m_channel_count
+			&& attribute.m_size == current.m_size);
+
+		void* stream = m_vertex_buffer.map(GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT, m_stream_offsets[index], attribute.m_size);
+		PICOGL_ASSERT(stream);
+		std::memcpy(stream, attribute.m_data, attribute.m_size);
+		m_vertex_buffer.unmap();
+
+		m_vertex_attributes[index].m_data = attribute.m_data;
+		return *this;
+	}
+
+	inline Mesh& Mesh::set_instances_count(const std::vector<GLuint>& instances_count)
+	{
+		PICOGL_ASSERT(instances_count.size() == get_submeshes_count());
+		m_instances_count = instances_count;
+		update_draws();
+		return *this;
+	}
+
+	inline Mesh& Mesh::set_lods(const std::vector<GLuint>& lods)
+	{
+		PICOGL_ASSERT(lods.size() == m_submeshes.size());
+		for (std::size_t i = 0; i < lods.size(); ++i)
+			PICOGL_ASSERT(lods[i] <= m_submeshes[i].m_lods.size());
+
+		if (lods == m_lods && m_indirect_draw_buffer)
+			return *this;
+
+		m_lods = lods;
+		update_draws();
+		return *this;
+	}
+
+	inline Mesh& Mesh::set_clusters(const std::vector<GLuint>& index_counts)
+	{
+		PICOGL_ASSERT(m_submeshes.size() == 1 && m_submeshes.front().m_lods.empty());
+
+		const SubMesh submesh = m_submeshes.front();
+		const GLuint instance_count = m_instances_count.front();
+		m_submeshes.clear();
+		GLuint first_index = submesh.m_first_index;
+		for (const GLuint index_count : index_counts) {
+			m_submeshes.push_back({ index_count, submesh.m_indice_offset, first_index, {} });
+			first_index += index_count;
 		}
-		case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
-		{
-			glTexStorage3DMultisample(m_target, m_sample_count, m_internal_format, m_width, m_height, m_array_size, fixed_locations);
-			break;
+		PICOGL_ASSERT(first_index == submesh.m_first_index + submesh.m_index_count);
+
+		m_instances_count.assign(m_submeshes.size(), instance_count);
+		m_lods.clear();
+		update_draws();
+		return *this;
+	}
+
+	inline void Mesh::update_draws()
+	{
+		std::vector<DrawElementsIndirectCommand> draws(m_submeshes.size());
+		std::size_t mesh_id = 0;
+		for (const SubMesh& submesh : m_submeshes) {
+			DrawElementsIndirectCommand& draw = draws[mesh_id];
+
+			const GLuint lod = m_lods.empty() ? 0 : m_lods[mesh_id];
+			draw.m_count = lod ? submesh.m_lods[lod - 1].m_index_count : submesh.m_index_count;
+			draw.m_instance_count = m_instances_count[mesh_id];
+			draw.m_first_index = lod ? submesh.m_lods[lod - 1].m_first_index : submesh.m_first_index;
+			draw.m_base_vertex = submesh.m_indice_offset;
+			draw.m_base_instance = 0;
+
+			++mesh_id;
 		}
-		case GL_TEXTURE_3D:
+
+		if (m_indirect_draw_buffer && m_indirect_draw_buffer.get_size() == impl::get_data_size(draws))
+			m_indirect_draw_buffer.upload_data(draws.data());
+		else
+			m_indirect_draw_buffer = Buffer::make(GL_DRAW_INDIRECT_BUFFER, draws);
+	}
+
+	inline GLsizeiptr Mesh::get_total_index_count() const
+	{
+		return m_index_buffer.get_size() / impl::get_scalar_sizeof(m_indice_type);
+	}
+
+	inline std::uint64_t Mesh::get_indirect_triangle_count(const GLenum primitive_type) const
+	{
+		std::uint64_t triangle_count = 0;
+		for (std::size_t mesh_id = 0; mesh_id < m_submeshes.size(); ++mesh_id) {
+			const SubMesh& submesh = m_submeshes[mesh_id];
+			const GLuint lod = m_lods.empty() ? 0 : m_lods[mesh_id];
+			const GLuint index_count = lod ? submesh.m_lods[lod - 1].m_index_count : submesh.m_index_count;
+			triangle_count += impl::get_triangle_count(primitive_type, index_count) * m_instances_count[mesh_id];
+		}
+		return triangle_count;
+	}
+
+	inline void Mesh::copy_indices(const Buffer& src, const GLenum src_type, const GLintptr from, Buffer& dst, const GLenum dst_type, const GLintptr to, const GLsizeiptr count)
+	{
+		const GLsizeiptr src_sizeof = impl::get_scalar_sizeof(src_type);
+		const GLsizeiptr dst_sizeof = impl::get_scalar_sizeof(dst_type);
+		if (src_type == dst_type) {
+			src.copy_to(dst, to * dst_sizeof, from * src_sizeof, count * src_sizeof);
+			return;
+		}
+		PICOGL_ASSERT(dst_sizeof > src_sizeof);
+
+		// Load time only, the source is staged so that it is not mapped while possibly in use.
+		Buffer staging = Buffer::make(GL_COPY_READ_BUFFER, count * src_sizeof, nullptr, GL_STREAM_READ);
+		src.copy_to(staging, 0, from * src_sizeof, count * src_sizeof);
+		std::vector<char> converted(count * dst_sizeof);
+		impl::convert_indices(staging.map(GL_MAP_READ_BIT), src_type, converted.data(), dst_type, count);
+		staging.unmap();
+		dst.upload_data(converted.data(), count * dst_sizeof, to * dst_sizeof);
+	}
+
+	inline void Mesh::setup_attribute_pointer(const GLuint index, const GLuint binding, const std::size_t offset, const GLsizei stride, const VertexAttribute& attribute)
+	{
+		// Integer types reach the shader as integers unless normalized, the other ones as floats.
+		bool integer = false;
+		switch (attribute.m_type)
 		{
-			const GLsizei lod_count = allocate_mipmap ? lod_count_3D() : 1;
-			glTexStorage3D(m_target, lod_count, m_internal_format, m_width, m_height, m_depth);
-			if (data)
-				glTexSubImage3D(m_target, 0, 0, 0, 0, m_width, m_height, m_depth, m_format, m_type, data);
+		case GL_FLOAT:
+		case GL_HALF_FLOAT:
+		case GL_UNSIGNED_INT_10F_11F_11F_REV:
+			break;
+		case GL_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+			PICOGL_ASSERT(attribute.m_channel_count == 4);
+			break;
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+		case GL_INT:
+		case GL_UNSIGNED_INT:
+			integer = !attribute.m_normalized;
 			break;
-		}
 		default:
 			PICOGL_ASSERT(false);
 			break;
 		}
 
-		if (bool(opts & Options::GenerateMipmap))
-			glGenerateMipmap(m_target);
+#if PICOGL_USE_DSA
+		// The vertex buffer and its stride are set on the binding by the caller.
+		(void)stride;
+		const GLuint relative_offset = static_cast<GLuint>(offset);
+		if (integer)
+			glVertexArrayAttribIFormat(m_vao, index, attribute.m_channel_count, attribute.m_type, relative_offset);
+		else
+			glVertexArrayAttribFormat(m_vao, index, attribute.m_channel_count, attribute.m_type, attribute.m_normalized, relative_offset);
 
-		std::string str;
-		gl_debug(str);
+		glVertexArrayAttribBinding(m_vao, index, binding);
+		glEnableVertexArrayAttrib(m_vao, index);
+#else
+		(void)binding;
+		if (integer)
+			glVertexAttribIPointer(index, attribute.m_channel_count, attribute.m_type, stride, ((char*)0) + offset);
+		else
+			glVertexAttribPointer(index, attribute.m_channel_count, attribute.m_type, attribute.m_normalized, stride, ((char*)0) + offset);
+
+		glEnableVertexAttribArray(index);
+#endif
 	}
 
-	inline GLsizei Texture::lod_count_1D() const
+	inline bool Mesh::has_same_layout(const Mesh& other) const
 	{
-		return static_cast<GLsizei>(std::floor(std::log2(m_width))) + 1;
+		if (m_layout != Layout::Interleaved || other.m_layout != Layout::Interleaved)
+			return false;
+		if (m_vertex_attributes.size() != other.m_vertex_attributes.size())
+			return false;
+		for (std::size_t i = 0; i < m_vertex_attributes.size(); ++i) {
+			const VertexAttribute& a = m_vertex_attributes[i];
+			const VertexAttribute& b = other.m_vertex_attributes[i];
+			if (a.m_type != b.m_type || a.m_channel_count != b.m_channel_count || a.m_normalized != b.m_normalized)
+				return false;
+		}
+		return true;
 	}
 
-	inline GLsizei Texture::lod_count_2D() const
+	inline void Mesh::draw() const
 	{
-		return static_cast<GLsizei>(std::floor(std::log2(std::max(m_width, m_height)))) + 1;
+		draw(m_primitive_type);
 	}
 
-	inline GLsizei Texture::lod_count_3D() const
+	inline void Mesh::draw(GLenum primitive_type) const
 	{
-		return static_cast<GLsizei>(std::floor(std::log2(std::max({ m_width, m_height, m_depth })))) + 1;
+		PICOGL_ASSERT(m_vao);
+		impl::bind_vertex_array(m_vao);
+		if (m_index_buffer) {
+#if !PICOGL_USE_DSA
+			m_index_buffer.bind();
+#endif
+			if (m_indirect_draw_buffer) {
+				m_indirect_draw_buffer.bind();
+				PICOGL_INSTRUMENT_DRAW(m_submeshes.size(), get_indirect_triangle_count(primitive_type));
+				glMultiDrawElementsIndirect(primitive_type, m_indice_type, 0, GLsizei(m_submeshes.size()), 0);
+			} else {
+				PICOGL_INSTRUMENT_DRAW(1, impl::get_triangle_count(primitive_type, m_index_count));
+				glDrawElements(primitive_type, m_index_count, m_indice_type, 0);
+			}
+		} else {
+			PICOGL_INSTRUMENT_DRAW(1, impl::get_triangle_count(primitive_type, m_index_count));
+			glDrawArrays(primitive_type, 0, m_index_count);
+		}
 	}
 
-	inline void Texture::generate_mipmap() const
+	inline void Mesh::draw(GLenum primitive_type, GLsizei force_vertex_count) const
 	{
-		bind();
-		glGenerateMipmap(m_target);
+		PICOGL_ASSERT(m_vao);
+		impl::bind_vertex_array(m_vao);
+		PICOGL_INSTRUMENT_DRAW(1, impl::get_triangle_count(primitive_type, force_vertex_count));
+		glDrawArrays(primitive_type, 0, force_vertex_count);
 	}
 
-	inline Framebuffer Framebuffer::make(const GLsizei width, const GLsizei height, const GLsizei sample_count)
+	inline Mesh::operator GLuint() const
 	{
-		Framebuffer framebuffer;
-		framebuffer.m_gl = impl::GLObject<impl::GLObjectType::Framebuffer>::make();
-		framebuffer.m_sample_count = sample_count;
-		framebuffer.m_width = width;
-		framebuffer.m_height = height;
-		return framebuffer;
+		return m_vao;
 	}
 
-	inline Framebuffer Framebuffer::get_default(const GLsizei width, const GLsizei height, const GLsizei sample_count)
+	inline GLsizei Mesh::get_vertex_sizeof() const
 	{
-		Framebuffer fb;
-		fb.m_sample_count = sample_count;
-		fb.m_width = width;
-		fb.m_height = height;
-		return fb;
+		GLsizei vertex_sizeof = 0;
+		for (const VertexAttribute& attribute : m_vertex_attributes)
+			vertex_sizeof += impl::get_attribute_sizeof(attribute.m_type, attribute.m_channel_count);
+		return vertex_sizeof;
 	}
 
-	inline Framebuffer& Framebuffer::set_depth_attachment(const GLenum format)
+	inline GLsizei Mesh::get_submeshes_count() const
 	{
-		m_depth_attachment = impl::GLObject<impl::GLObjectType::RenderBuffer>::make();
-		glBindRenderbuffer(GL_RENDERBUFFER, m_depth_attachment);
-		if (m_sample_count > 1)
-			glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_sample_count, format, m_width, m_height);
-		else
-			glRenderbufferStorage(GL_RENDERBUFFER, format, m_width, m_height);
+		return GLsizei(m_submeshes.size());
+	}
 
-		bind();
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_attachment);
-		return *this;
+	inline GLsizei Mesh::get_lod_count(const GLsizei submesh) const
+	{
+		PICOGL_ASSERT(submesh < get_submeshes_count());
+		return 1 + GLsizei(m_submeshes[submesh].m_lods.size());
 	}
 
-	inline Framebuffer& Framebuffer::add_color_attachment(const GLenum internal_format, const GLenum target, Texture::Options options)
+	inline GLenum Mesh::get_index_type() const
 	{
-		const GLenum attachment_index = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(m_color_attachments.size());
-		if (m_depth_attachment)
-			options = options | Texture::Options::FixedSampleLocations | Texture::Options::AutomaticAlignment;
+		return m_indice_type;
+	}
 
-		m_attachments.push_back(attachment_index);
-		switch (target)
+	inline const Buffer& Mesh::get_indirect_draw_buffer() const
+	{
+		return m_indirect_draw_buffer;
+	}
+
+	namespace impl
+	{
+		inline RangeAllocator::RangeAllocator(const GLsizeiptr capacity)
 		{
-		default:
-		case GL_TEXTURE_2D:
-			m_color_attachments.push_back(Texture::make_2d(internal_format, m_width, m_height, 1, m_sample_count, nullptr, options));
-			break;
-		case GL_TEXTURE_CUBE_MAP:
-			m_color_attachments.push_back(Texture::make_cubemap(internal_format, m_width, m_height, 1, options));
-			break;
+			grow(capacity);
 		}
 
-		bind();
-		const Texture& attachment = m_color_attachments.back();
-		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment_index, attachment.get_target(), attachment, 0);
-		return *this;
+		inline GLsizeiptr RangeAllocator::allocate(const GLsizeiptr size)
+		{
+			PICOGL_ASSERT(size > 0);
+			for (auto it = m_free_ranges.begin(); it != m_free_ranges.end(); ++it) {
+				if (it->second < size)
+					continue;
+
+				const GLsizeiptr offset = it->first;
+				const GLsizeiptr remaining = it->second - size;
+				m_free_ranges.erase(it);
+				if (remaining > 0)
+					m_free_ranges.emplace(offset + size, remaining);
+				return offset;
+			}
+			return Invalid;
+		}
+
+		inline void RangeAllocator::free(const GLsizeiptr offset, const GLsizeiptr size)
+		{
+			PICOGL_ASSERT(offset >= 0 && size > 0 && offset + size <= m_capacity);
+			auto it = m_free_ranges.emplace(offset, size).first;
+
+			const auto next = std::next(it);
+			if (next != m_free_ranges.end() && it->first + it->second == next->first) {
+				it->second += next->second;
+				m_free_ranges.erase(next);
+			}
+			if (it != m_free_ranges.begin()) {
+				const auto previous = std::prev(it);
+				if (previous->first + previous->second == it->first) {
+					previous->second += it->second;
+					m_free_ranges.erase(it);
+				}
+			}
+		}
+
+		inline void RangeAllocator::grow(const GLsizeiptr capacity)
+		{
+			PICOGL_ASSERT(capacity >= m_capacity);
+			const GLsizeiptr old_capacity = m_capacity;
+			m_capacity = capacity;
+			if (capacity > old_capacity)
+				free(old_capacity, capacity - old_capacity);
+		}
+
+		inline GLsizeiptr RangeAllocator::capacity() const
+		{
+			return m_capacity;
+		}
+	}
+
+	inline MeshPool MeshPool::make(const GLsizeiptr vertex_capacity, const GLsizeiptr index_capacity, const GLsizeiptr draw_capacity)
+	{
+		MeshPool pool;
+		pool.m_mesh = Mesh::make();
+		// Arenas are created by the first mesh, which sets the layout.
+		pool.m_vertex_ranges = impl::RangeAllocator(vertex_capacity);
+		pool.m_index_ranges = impl::RangeAllocator(index_capacity);
+		pool.m_draw_ranges = impl::RangeAllocator(draw_capacity);
+		return pool;
+	}
+
+	inline MeshPool::Handle MeshPool::add(const Mesh& mesh)
+	{
+		PICOGL_ASSERT(m_mesh.m_vao);
+		PICOGL_ASSERT(mesh.m_index_buffer && mesh.m_vertex_count > 0 && !mesh.m_submeshes.empty());
+
+		if (m_mesh.m_vertex_attributes.empty()) {
+			PICOGL_ASSERT(mesh.m_layout == Mesh::Layout::Interleaved);
+			m_mesh.m_vertex_attributes = mesh.m_vertex_attributes;
+			m_mesh.m_primitive_type = mesh.m_primitive_type;
+			m_mesh.m_indice_type = mesh.m_indice_type;
+			m_mesh.m_vertex_buffer = Buffer::make(GL_ARRAY_BUFFER, m_vertex_ranges.capacity() * m_mesh.get_vertex_sizeof());
+			m_mesh.m_index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, m_index_ranges.capacity() * impl::get_scalar_sizeof(m_mesh.m_indice_type));
+			m_draws.resize(m_draw_ranges.capacity());
+			m_draw_lods.resize(m_draw_ranges.capacity());
+			m_mesh.m_indirect_draw_buffer = Buffer::make(GL_DRAW_INDIRECT_BUFFER, m_draws);
+			attach_buffers();
+		} else {
+			PICOGL_ASSERT(m_mesh.has_same_layout(mesh));
+			PICOGL_ASSERT(m_mesh.m_primitive_type == mesh.m_primitive_type);
+			if (impl::get_scalar_sizeof(mesh.m_indice_type) > impl::get_scalar_sizeof(m_mesh.m_indice_type))
+				widen_indices(mesh.m_indice_type);
+		}
+
+		const GLsizeiptr vertex_sizeof = m_mesh.get_vertex_sizeof();
+		const GLsizeiptr index_sizeof = impl::get_scalar_sizeof(m_mesh.m_indice_type);
+
+		Entry entry;
+		entry.m_vertex_count = mesh.m_vertex_count;
+		entry.m_index_count = mesh.get_total_index_count();
+		entry.m_submeshes = mesh.m_submeshes;
+		entry.m_first_vertex = allocate(m_vertex_ranges, m_mesh.m_vertex_buffer, GL_ARRAY_BUFFER, entry.m_vertex_count, vertex_sizeof);
+		entry.m_first_index = allocate(m_index_ranges, m_mesh.m_index_buffer, GL_ELEMENT_ARRAY_BUFFER, entry.m_index_count, index_sizeof);
+		entry.m_first_draw = allocate_draws(GLsizeiptr(entry.m_submeshes.size()));
+
+		mesh.m_vertex_buffer.copy_to(m_mesh.m_vertex_buffer, entry.m_first_vertex * vertex_sizeof, 0, entry.m_vertex_count * vertex_sizeof);
+		Mesh::copy_indices(mesh.m_index_buffer, mesh.m_indice_type, 0, m_mesh.m_index_buffer, m_mesh.m_indice_type, entry.m_first_index, entry.m_index_count);
+		for (std::size_t i = 0; i < entry.m_submeshes.size(); ++i) {
+			const Mesh::SubMesh& submesh = entry.m_submeshes[i];
+			std::vector<Mesh::LodRange>& lods = m_draw_lods[entry.m_first_draw + i];
+			lods.assign(1, { submesh.m_first_index, submesh.m_index_count });
+			lods.insert(lods.end(), submesh.m_lods.begin(), submesh.m_lods.end());
+			for (Mesh::LodRange& lod : lods)
+				lod.m_first_index += GLuint(entry.m_first_index);
+		}
+		upload_draws(entry, mesh.m_instances_count);
+
+		Handle handle;
+		if (!m_free_handles.empty()) {
+			handle = m_free_handles.back();
+			m_free_handles.pop_back();
+			m_entries[handle] = std::move(entry);
+		} else {
+			handle = m_entries.size();
+			m_entries.push_back(std::move(entry));
+		}
+		return handle;
 	}
 
-	inline void Framebuffer::bind(const GLenum target) const
+	inline void MeshPool::remove(const Handle handle)
 	{
-		glBindFramebuffer(target, m_gl);
+		PICOGL_ASSERT(handle < m_entries.size() && m_entries[handle].m_first_draw != impl::RangeAllocator::Invalid);
+		Entry& entry = m_entries[handle];
+
+		// Empty draws keep the draw ids of the other meshes unchanged.
+		upload_draws(entry, std::vector<GLuint>(entry.m_submeshes.size(), 0));
+		for (std::size_t i = 0; i < entry.m_submeshes.size(); ++i)
+			m_draw_lods[entry.m_first_draw + i].clear();
+
+		m_vertex_ranges.free(entry.m_first_vertex, entry.m_vertex_count);
+		m_index_ranges.free(entry.m_first_index, entry.m_index_count);
+		m_draw_ranges.free(entry.m_first_draw, GLsizeiptr(entry.m_submeshes.size()));
+		entry = {};
+		m_free_handles.push_back(handle);
 	}
 
-	inline void Framebuffer::bind_read(const GLenum attachment) const
+	inline void MeshPool::set_instances_count(const Handle handle, const std::vector<GLuint>& instances_count)
 	{
-		//PICOGL_ASSERT(attachment >= GL_COLOR_ATTACHMENT0);
-		bind(GL_READ_FRAMEBUFFER);
-		glReadBuffer(attachment);
+		PICOGL_ASSERT(handle < m_entries.size() && m_entries[handle].m_first_draw != impl::RangeAllocator::Invalid);
+		upload_draws(m_entries[handle], instances_count);
 	}
 
-	inline void Framebuffer::bind_draw(const GLenum attachment) const
+	inline void MeshPool::set_lods(const Handle handle, const std::vector<GLuint>& lods)
 	{
-		PICOGL_ASSERT(attachment >= GL_COLOR_ATTACHMENT0);
-		bind(GL_DRAW_FRAMEBUFFER);
-		if (m_gl)
-			glDrawBuffers(1, &attachment);
+		PICOGL_ASSERT(handle < m_entries.size() && m_entries[handle].m_first_draw != impl::RangeAllocator::Invalid);
+		Entry& entry = m_entries[handle];
+		PICOGL_ASSERT(lods.size() == entry.m_submeshes.size());
+		for (std::size_t i = 0; i < lods.size(); ++i)
+			PICOGL_ASSERT(lods[i] < m_draw_lods[entry.m_first_draw + i].size());
+
+		if (lods == entry.m_lods || (entry.m_lods.empty() && std::all_of(lods.begin(), lods.end(), [](const GLuint lod) { return lod == 0; })))
+			return;
+
+		entry.m_lods = lods;
+		std::vector<GLuint> instances_count(entry.m_submeshes.size());
+		for (std::size_t i = 0; i < instances_count.size(); ++i)
+			instances_count[i] = m_draws[entry.m_first_draw + i].m_instance_count;
+		upload_draws(entry, instances_count);
 	}
 
-	inline void Framebuffer::bind_draw() const
+	inline void MeshPool::draw() const
 	{
-		bind(GL_DRAW_FRAMEBUFFER);
-		if (m_gl) {
-			PICOGL_ASSERT(!m_attachments.empty());
-			glDrawBuffers(static_cast<GLsizei>(m_attachments.size()), m_attachments.data());
-		}
+		if (!m_draw_count)
+			return;
+
+		impl::bind_vertex_array(m_mesh.m_vao);
+#if !PICOGL_USE_DSA
+		m_mesh.m_index_buffer.bind();
+#endif
+		m_mesh.m_indirect_draw_buffer.bind();
+		PICOGL_INSTRUMENT_DRAW(m_draw_count, get_triangle_count());
+		glMultiDrawElementsIndirect(m_mesh.m_primitive_type, m_mesh.m_indice_type, 0, m_draw_count, 0);
 	}
 
-	inline void Framebuffer::clear(const std::array<float, 4>& rgba, GLenum mask) const
+	inline void MeshPool::draw_indirect(const Buffer& draws, const GLsizei max_draw_count, const Buffer* draw_count) const
 	{
-		bind_draw();
-		glClearColor(rgba[0], rgba[1], rgba[2], rgba[3]);
-		glClear(mask);
+		if (!max_draw_count)
+			return;
+
+		impl::bind_vertex_array(m_mesh.m_vao);
+#if !PICOGL_USE_DSA
+		m_mesh.m_index_buffer.bind();
+#endif
+		draws.bind(GL_DRAW_INDIRECT_BUFFER);
+		PICOGL_INSTRUMENT_DRAW(max_draw_count, 0);
+		if (draw_count) {
+			draw_count->bind(GL_PARAMETER_BUFFER);
+			glMultiDrawElementsIndirectCount(m_mesh.m_primitive_type, m_mesh.m_indice_type, 0, 0, max_draw_count, 0);
+		} else
+			glMultiDrawElementsIndirect(m_mesh.m_primitive_type, m_mesh.m_indice_type, 0, max_draw_count, 0);
 	}
 
-	inline void Framebuffer::readback(void* dst, GLint x, GLint y, GLsizei width, GLsizei height, GLenum attach_from) const
+	inline std::uint64_t MeshPool::get_triangle_count() const
 	{
-		bind_read(attach_from);
-		const Texture& attachment = m_color_attachments[attach_from - GL_COLOR_ATTACHMENT0];
-		glReadPixels(x, y, width, height, attachment.get_format(), attachment.get_type(), dst);
+		std::uint64_t triangle_count = 0;
+		for (GLsizei draw = 0; draw < m_draw_count; ++draw)
+			triangle_count += impl::get_triangle_count(m_mesh.m_primitive_type, m_draws[draw].m_count) * m_draws[draw].m_instance_count;
+		return triangle_count;
 	}
 
-	inline void Framebuffer::readback(void* dst, GLenum attach_from) const
+	inline const std::vector<Mesh::DrawElementsIndirectCommand>& MeshPool::get_draws() const
 	{
-		readback(dst, 0, 0, m_width, m_height, attach_from);
+		return m_draws;
 	}
 
-	inline void Framebuffer::blit_to(Framebuffer& to, const GLenum attachment_to, const GLenum filter, const GLenum attachment_from) const
+	inline const std::vector<Mesh::LodRange>& MeshPool::get_lods(const GLsizei draw) const
 	{
-		blit_to(to, 0, 0, to.m_width, to.m_height, attachment_to, filter, 0, 0, m_width, m_height, attachment_from);
+		PICOGL_ASSERT(draw < m_draw_count);
+		return m_draw_lods[draw];
 	}
 
-	inline void Framebuffer::blit_to(Framebuffer& to, GLint to_x, GLint to_y, GLint to_w, GLint to_h, const GLenum attachment_to, const GLenum filter, GLint from_x, GLint from_y, GLint from_w, GLint from_h, const GLenum attachment_from) const
+	inline GLsizei MeshPool::get_first_draw(const Handle handle) const
 	{
-		bind_read(attachment_from);
-		to.bind_draw(attachment_to);
-		glBlitFramebuffer(from_x, from_y, from_w, from_h, to_x, to_y, to_w, to_h, GL_COLOR_BUFFER_BIT, filter);
+		PICOGL_ASSERT(handle < m_entries.size());
+		return GLsizei(m_entries[handle].m_first_draw);
 	}
 
-	inline GLsizei Framebuffer::sample_count() const
+	inline GLsizei MeshPool::get_submeshes_count(const Handle handle) const
 	{
-		return m_sample_count;
+		PICOGL_ASSERT(handle < m_entries.size());
+		return GLsizei(m_entries[handle].m_submeshes.size());
 	}
 
-	inline GLsizei Framebuffer::width() const
+	inline GLsizei MeshPool::get_draw_count() const
 	{
-		return m_width;
+		return m_draw_count;
 	}
 
-	inline GLsizei Framebuffer::height() const
+	inline std::size_t MeshPool::get_mesh_count() const
 	{
-		return m_height;
+		return m_entries.size() - m_free_handles.size();
 	}
 
-	inline const std::vector<Texture>& Framebuffer::color_attachments() const
+	inline GLsizeiptr MeshPool::allocate(impl::RangeAllocator& allocator, Buffer& buffer, const GLenum target, const GLsizeiptr count, const GLsizeiptr element_sizeof)
 	{
-		return m_color_attachments;
+		GLsizeiptr offset = allocator.allocate(count);
+		if (offset != impl::RangeAllocator::Invalid)
+			return offset;
+
+		// Grow geometrically, only the previous content is copied over.
+		const GLsizeiptr capacity = std::max(2 * allocator.capacity(), allocator.capacity() + count);
+		Buffer grown = Buffer::make(target, capacity * element_sizeof);
+		buffer.copy_to(grown, 0);
+		buffer = std::move(grown);
+		allocator.grow(capacity);
+		attach_buffers();
+
+		offset = allocator.allocate(count);
+		PICOGL_ASSERT(offset != impl::RangeAllocator::Invalid);
+		return offset;
 	}
 
-	inline GLuint Framebuffer::depth_handle() const
+	inline GLsizeiptr MeshPool::allocate_draws(const GLsizeiptr count)
 	{
-		return m_depth_attachment;
+		GLsizeiptr offset = m_draw_ranges.allocate(count);
+		if (offset == impl::RangeAllocator::Invalid) {
+			const GLsizeiptr capacity = std::max(2 * m_draw_ranges.capacity(), m_draw_ranges.capacity() + count);
+			m_draw_ranges.grow(capacity);
+			m_draws.resize(capacity, {});
+			m_draw_lods.resize(capacity);
+			m_mesh.m_indirect_draw_buffer = Buffer::make(GL_DRAW_INDIRECT_BUFFER, m_draws);
+			offset = m_draw_ranges.allocate(count);
+			PICOGL_ASSERT(offset != impl::RangeAllocator::Invalid);
+		}
+		m_draw_count = std::max(m_draw_count, GLsizei(offset + count));
+		return offset;
 	}
 
-	inline Framebuffer::operator GLuint() const
+	inline void MeshPool::attach_buffers()
 	{
-		return m_gl;
+		const GLsizei vertex_sizeof = m_mesh.get_vertex_sizeof();
+#if PICOGL_USE_DSA
+		glVertexArrayElementBuffer(m_mesh.m_vao, m_mesh.m_index_buffer);
+		glVertexArrayVertexBuffer(m_mesh.m_vao, 0, m_mesh.m_vertex_buffer, 0, vertex_sizeof);
+#else
+		impl::bind_vertex_array(m_mesh.m_vao);
+		m_mesh.m_vertex_buffer.bind();
+#endif
+		GLsizeiptr offset = 0;
+		for (GLuint index = 0; index < GLuint(m_mesh.m_vertex_attributes.size()); ++index) {
+			const Mesh::VertexAttribute& attribute = m_mesh.m_vertex_attributes[index];
+			m_mesh.setup_attribute_pointer(index, 0, offset, vertex_sizeof, attribute);
+			offset += impl::get_attribute_sizeof(attribute.m_type, attribute.m_channel_count);
+		}
 	}
 
-	inline Mesh Mesh::make()
+	inline void MeshPool::widen_indices(const GLenum type)
 	{
-		Mesh mesh;
-		mesh.m_vao = impl::GLObject<impl::GLObjectType::VertexArray>::make();
-		return mesh;
+		Buffer widened = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, m_index_ranges.capacity() * impl::get_scalar_sizeof(type));
+		Mesh::copy_indices(m_mesh.m_index_buffer, m_mesh.m_indice_type, 0, widened, type, 0, m_index_ranges.capacity());
+		m_mesh.m_index_buffer = std::move(widened);
+		m_mesh.m_indice_type = type;
+		attach_buffers();
 	}
 
-	inline Mesh Mesh::combine(const std::vector<std::reference_wrapper<const Mesh>>& meshes)
+	inline void MeshPool::upload_draws(const Entry& entry, const std::vector<GLuint>& instances_count)
 	{
-		PICOGL_ASSERT(meshes.size() > 0);
-		const GLuint attribute_count = GLuint(meshes.front().get().m_vertex_attributes.size());
-		PICOGL_ASSERT(attribute_count > 0);
-
-		Mesh dst = Mesh::make();
-
-		std::size_t total_submesh_count = 0;
-		std::size_t total_instance_count = 0;
-		GLsizeiptr vertex_buffer_size = 0;
-		GLsizeiptr index_buffer_size = 0;
+		PICOGL_ASSERT(instances_count.size() == entry.m_submeshes.size());
+		for (std::size_t i = 0; i < entry.m_submeshes.size(); ++i) {
+			const Mesh::SubMesh& submesh = entry.m_submeshes[i];
+			const Mesh::LodRange& lod = m_draw_lods[entry.m_first_draw + i][entry.m_lods.empty() ? 0 : entry.m_lods[i]];
+			Mesh::DrawElementsIndirectCommand& draw = m_draws[entry.m_first_draw + i];
+			draw.m_count = lod.m_index_count;
+			draw.m_instance_count = instances_count[i];
+			draw.m_first_index = lod.m_first_index;
+			draw.m_base_vertex = GLuint(entry.m_first_vertex + submesh.m_indice_offset);
+			draw.m_base_instance = 0;
+		}
 
-		for (const auto& mesh_ref : meshes) {
-			const Mesh& mesh = mesh_ref.get();
+		const GLsizeiptr draw_sizeof = sizeof(Mesh::DrawElementsIndirectCommand);
+		m_mesh.m_indirect_draw_buffer.upload_data(&m_draws[entry.m_first_draw], GLsizeiptr(entry.m_submeshes.size()) * draw_sizeof, entry.m_first_draw * draw_sizeof);
+	}
 
-			total_submesh_count += mesh.m_submeshes.size();
-			dst.m_vertex_count += mesh.m_vertex_count;
-			vertex_buffer_size += mesh.m_vertex_buffer.get_size();
+	inline CommandList CommandList::make(const std::size_t capacity)
+	{
+		CommandList list;
+		list.m_arena.resize(capacity);
+		return list;
+	}
 
-			dst.m_index_count += mesh.m_index_count;
-			index_buffer_size += mesh.m_index_buffer.get_size();
+	inline void CommandList::use_program(Program& program)
+	{
+		record(Type::UseProgram, UseProgramCommand{ &program });
+	}
 
-			total_instance_count += mesh.m_instances_count.size();
+	inline void CommandList::bind_buffer_range(const GLenum target, const GLuint index, const Buffer& buffer, const GLintptr offset, const GLsizeiptr size)
+	{
+		record(Type::BindBufferRange, BindBufferRangeCommand{ target, index, GLuint(buffer), offset, size });
+	}
 
-			if (!dst.m_primitive_type)
-				dst.m_primitive_type = mesh.m_primitive_type;
-			else
-				PICOGL_ASSERT(dst.m_primitive_type == mesh.m_primitive_type);
+	inline void CommandList::bind_ssbo(const GLuint index, const Buffer& buffer, const GLintptr offset, const GLsizeiptr size)
+	{
+		bind_buffer_range(GL_SHADER_STORAGE_BUFFER, index, buffer, offset, size);
+	}
 
-			if (!dst.m_indice_type)
-				dst.m_indice_type = mesh.m_indice_type;
-			else
-				PICOGL_ASSERT(dst.m_indice_type == mesh.m_indice_type);
-		}
+	inline void CommandList::draw(const Mesh& mesh)
+	{
+		record(Type::DrawMesh, DrawMeshCommand{ &mesh, GLenum{}, true });
+	}
 
-		dst.m_index_buffer = Buffer::make(GL_ELEMENT_ARRAY_BUFFER, index_buffer_size);
-		dst.m_vertex_buffer = Buffer::make(GL_ARRAY_BUFFER, vertex_buffer_size);
+	inline void CommandList::draw(const Mesh& mesh, const GLenum primitive_type)
+	{
+		record(Type::DrawMesh, DrawMeshCommand{ &mesh, primitive_type, false });
+	}
 
-		// Setup attribs pointers.
-		glBindVertexArray(dst.m_vao);
-		dst.m_vertex_buffer.bind();
+	inline void CommandList::draw(const MeshPool& pool)
+	{
+		record(Type::DrawMeshPool, DrawMeshPoolCommand{ &pool, nullptr, nullptr, 0 });
+	}
 
-		GLsizei attributes_sizeof = 0;
-		for (const Mesh::VertexAttribute& attribute : meshes.front().get().m_vertex_attributes)
-			attributes_sizeof += attribute.m_channel_count * impl::get_scalar_sizeof(attribute.m_type);
+	inline void CommandList::draw_indirect(const MeshPool& pool, const Buffer& draws, const GLsizei max_draw_count, const Buffer* draw_count)
+	{
+		record(Type::DrawMeshPoolIndirect, DrawMeshPoolCommand{ &pool, &draws, draw_count, max_draw_count });
+	}
 
-		GLsizeiptr attribute_offset = 0;
-		for (GLuint index = 0; index < attribute_count; ++index) {
-			const Mesh::VertexAttribute& attribute = meshes.front().get().m_vertex_attributes[index];
-			dst.setup_attribute_pointer(index, attribute_offset, attributes_sizeof, attribute);
-			attribute_offset += attribute.m_channel_count * impl::get_scalar_sizeof(attribute.m_type);
-		}
+	inline void CommandList::replay() const
+	{
+		// Commands are copied out of the arena, which only guarantees Alignment.
+		const auto read = [](const char* data, auto& command) {
+			std::memcpy(&command, data, sizeof(command));
+		};
 
-		// Combine submeshes and gpu-copy buffers.
-		GLsizeiptr dst_index_size_offset = 0;
-		GLsizeiptr dst_vertex_size_offset = 0;
-		GLsizei index_offset = 0;
-		GLsizei index_count = 0;
-		std::size_t global_submesh_id = 0;
-		dst.m_instances_count.resize(total_instance_count);
-		dst.m_submeshes.resize(total_submesh_count);
-		for (const auto& mesh_ref : meshes) {
-			const Mesh& mesh = mesh_ref.get();
+		const std::size_t command_offset = (sizeof(Header) + Alignment - 1) & ~(Alignment - 1);
+		for (std::size_t offset = 0; offset < m_size;) {
+			const char* data = m_arena.data() + offset;
+			Header header;
+			read(data, header);
+			data += command_offset;
 
-			std::size_t local_submesh_id = 0;
-			for (const SubMesh& src_submesh : mesh.m_submeshes)
+			switch (header.m_type) {
+			case Type::UseProgram:
 			{
-				SubMesh& submesh = dst.m_submeshes[global_submesh_id];
-				submesh.m_first_index = index_count + src_submesh.m_first_index;
-				submesh.m_index_count = src_submesh.m_index_count;
-				submesh.m_indice_offset = src_submesh.m_indice_offset + index_offset;
-
-				dst.m_instances_count[global_submesh_id] = mesh.m_instances_count[local_submesh_id];
-				++local_submesh_id;
-				++global_submesh_id;
+				UseProgramCommand command;
+				read(data, command);
+				command.m_program->use();
+				break;
 			}
-
-			const GLsizeiptr indices_size = mesh.m_index_buffer.get_size();
-			mesh.m_index_buffer.copy_to(dst.m_index_buffer, dst_index_size_offset);
-
-			dst_index_size_offset += indices_size;
-			index_offset += mesh.m_vertex_count;
-			index_count += mesh.m_index_count;
-
-			mesh.m_vertex_buffer.copy_to(dst.m_vertex_buffer, dst_vertex_size_offset);
-			dst_vertex_size_offset += mesh.m_vertex_buffer.get_size();
+			case Type::SetUniform:
+			{
+				SetUniformCommand command;
+				read(data, command);
+				const char* values = data + ((sizeof(SetUniformCommand) + Alignment - 1) & ~(Alignment - 1));
+				command.m_program->set_value(command.m_handle, values, command.m_value_sizeof, command.m_count);
+				break;
+			}
+			case Type::BindBufferRange:
+			{
+				BindBufferRangeCommand command;
+				read(data, command);
+				impl::bind_buffer_range(command.m_target, command.m_index, command.m_buffer, command.m_offset, command.m_size);
+				break;
+			}
+			case Type::DrawMesh:
+			{
+				DrawMeshCommand command;
+				read(data, command);
+				if (command.m_mesh_primitive)
+					command.m_mesh->draw();
+				else
+					command.m_mesh->draw(command.m_primitive_type);
+				break;
+			}
+			case Type::DrawMeshPool:
+			{
+				DrawMeshPoolCommand command;
+				read(data, command);
+				command.m_pool->draw();
+				break;
+			}
+			case Type::DrawMeshPoolIndirect:
+			{
+				DrawMeshPoolCommand command;
+				read(data, command);
+				command.m_pool->draw_indirect(*command.m_draws, command.m_max_draw_count, command.m_draw_count);
+				break;
+			}
+			}
+			offset += header.m_size;
 		}
+	}
 
-		dst.set_instances_count(dst.m_instances_count);
-		return dst;
+	inline void CommandList::clear()
+	{
+		m_size = 0;
+		m_command_count = 0;
 	}
 
-	inline Mesh& Mesh::set_vertex_attributes(const std::vector<VertexAttribute>& attributes)
+	inline bool CommandList::empty() const
 	{
-		PICOGL_ASSERT(m_vao);
-		m_vertex_attributes = attributes;
+		return m_command_count == 0;
+	}
 
-		GLsizeiptr total_size = 0;
-		GLsizei attributes_sizeof = 0;
-		for (const VertexAttribute& attribute : attributes)
-		{
-			PICOGL_ASSERT(attribute.m_size > 0);
-			total_size += attribute.m_size;
-			attributes_sizeof += attribute.m_channel_count * impl::get_scalar_sizeof(attribute.m_type);
-		}
-		m_vertex_buffer = Buffer::make(GL_ARRAY_BUFFER, total_size);
+	inline std::size_t CommandList::command_count() const
+	{
+		return m_command_count;
+	}
 
-		std::vector<char> vertex_data(total_size);
-		GLuint index = 0;
-		std::size_t offset = 0;
-		glBindVertexArray(m_vao);
-		m_vertex_buffer.bind();
-		for (const VertexAttribute& attribute : attributes)
-			set_vertex_attribute(vertex_data, index, offset, attributes_sizeof, attribute);
+	inline std::size_t CommandList::size() const
+	{
+		return m_size;
+	}
 
-		m_vertex_buffer.upload_data(vertex_data.data());
-		return *this;
+	inline void CommandList::set_value(Program& program, const Program::UniformHandle handle, const void* data, const GLuint data_sizeof, const GLsizei count)
+	{
+		if (handle == Program::InvalidUniform)
+			return;
+		record(Type::SetUniform, SetUniformCommand{ &program, handle, data_sizeof, count }, data, std::size_t(data_sizeof) * count);
 	}
 
-	inline Mesh& Mesh::set_instances_count(const std::vector<GLuint>& instances_count)
+	inline Query Query::make(const GLenum target)
 	{
-		PICOGL_ASSERT(instances_count.size() == get_submeshes_count());
-		m_instances_count = instances_count;
+		Query query;
+		query.m_gl = impl::GLObject<impl::GLObjectType::Query>::make();
+		query.m_target = target;
+		return query;
+	}
 
-		std::vector<DrawElementsIndirectCommand> draws(m_submeshes.size());
-		std::size_t mesh_id = 0;
-		for (const SubMesh& submesh : m_submeshes) {
-			DrawElementsIndirectCommand& draw = draws[mesh_id];
+	inline void Query::begin() const
+	{
+		glBeginQuery(m_target, m_gl);
+	}
 
-			draw.m_count = submesh.m_index_count;
-			draw.m_instance_count = instances_count[mesh_id];
-			draw.m_first_index = submesh.m_first_index;
-			draw.m_base_vertex = submesh.m_indice_offset;
-			draw.m_base_instance = 0;
+	inline void Query::end() const
+	{
+		glEndQuery(m_target);
+	}
 
-			++mesh_id;
-		}
+	inline void Query::timestamp() const
+	{
+		PICOGL_ASSERT(m_target == GL_TIMESTAMP);
+		glQueryCounter(m_gl, GL_TIMESTAMP);
+	}
 
-		m_indirect_draw_buffer = Buffer::make(GL_DRAW_INDIRECT_BUFFER, draws);
-		return *this;
+	inline bool Query::available() const
+	{
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(m_gl, GL_QUERY_RESULT_AVAILABLE, &available);
+		return available == GL_TRUE;
 	}
 
-	inline void Mesh::set_vertex_attribute(std::vector<char>& vertex_data, GLuint& index, std::size_t& offset, const GLsizei stride, const VertexAttribute& attribute)
+	inline Query::operator GLuint() const
 	{
-		const std::size_t scalar_sizeof = impl::get_scalar_sizeof(attribute.m_type);
-		const std::size_t attribute_sizeof = scalar_sizeof * attribute.m_channel_count;
-		PICOGL_ASSERT(attribute.m_size % attribute_sizeof == 0);
+		return m_gl;
+	}
 
-		const char* src = attribute.m_data;
-		char* dst = vertex_data.data() + offset;
-		const char* dst_end = vertex_data.data() + vertex_data.size();
-		while (dst < dst_end) {
-			std::memcpy(dst, src, attribute_sizeof);
-			src += attribute_sizeof;
-			dst += stride;
+	namespace impl
+	{
+		inline GpuProfiler*& current_gpu_profiler()
+		{
+			static GpuProfiler* profiler = nullptr;
+			return profiler;
 		}
+	}
 
-		setup_attribute_pointer(index, offset, stride, attribute);
+	inline GpuProfiler::Scope::Scope(const std::string& name)
+	{
+		GpuProfiler* profiler = GpuProfiler::get_current();
+		if (profiler && profiler->m_recording) {
+			m_profiler = profiler;
+			m_profiler->begin_scope(name);
+		}
+	}
 
-		const GLsizei vertex_count = static_cast<GLsizei>(attribute.m_size / attribute_sizeof);
-		if (!m_vertex_count)
-			m_vertex_count = vertex_count;
-		else
-			PICOGL_ASSERT(vertex_count == m_vertex_count);
+	inline GpuProfiler::Scope::~Scope()
+	{
+		if (m_profiler)
+			m_profiler->end_scope();
+	}
 
-		offset += attribute_sizeof;
-		++index;
+	inline GpuProfiler* GpuProfiler::get_current()
+	{
+		return impl::current_gpu_profiler();
 	}
 
-	inline void Mesh::setup_attribute_pointer(const GLuint index, const std::size_t offset, const GLsizei stride, const VertexAttribute& attribute)
+	inline void GpuProfiler::set_current(GpuProfiler* profiler)
 	{
-		if (attribute.m_type == GL_FLOAT)
-			glVertexAttribPointer(index, attribute.m_channel_count, attribute.m_type, attribute.m_normalized, stride, ((char*)0) + offset);
-		else if (attribute.m_type == GL_INT || attribute.m_type == GL_UNSIGNED_INT)
-			glVertexAttribIPointer(index, attribute.m_channel_count, attribute.m_type, stride, ((char*)0) + offset);
-		else
-			PICOGL_ASSERT(false);
+		impl::current_gpu_profiler() = profiler;
+	}
 
-		glEnableVertexAttribArray(index);
+	inline GpuProfiler GpuProfiler::make(const GLsizei frame_count, const std::size_t history_size)
+	{
+		PICOGL_ASSERT(frame_count > 0 && history_size > 0);
+		GpuProfiler profiler;
+		profiler.m_frames.resize(frame_count);
+		profiler.m_history_size = history_size;
+		return profiler;
 	}
 
-	inline void Mesh::draw() const
+	inline void GpuProfiler::begin_frame()
 	{
-		draw(m_primitive_type);
+		PICOGL_ASSERT(!m_frames.empty() && !m_recording);
+		m_collected_events.clear();
+		m_frame = (m_frame + 1) % m_frames.size();
+		// The slot after the previous frame holds the oldest one.
+		if (!collect(m_frames[m_frame]))
+			m_frames.insert(m_frames.begin() + m_frame, Frame{});
+		m_recording = true;
 	}
 
-	inline void Mesh::draw(GLenum primitive_type) const
+	inline void GpuProfiler::end_frame()
 	{
-		PICOGL_ASSERT(m_vao);
-		glBindVertexArray(m_vao);
-		if (m_index_buffer) {
-			m_index_buffer.bind();
-			if (m_indirect_draw_buffer) {
-				m_indirect_draw_buffer.bind();
-				glMultiDrawElementsIndirect(primitive_type, m_indice_type, 0, GLsizei(m_submeshes.size()), 0);
-			} else
-				glDrawElements(primitive_type, m_index_count, m_indice_type, 0);
-		} else
-			glDrawArrays(primitive_type, 0, m_index_count);
+		PICOGL_ASSERT(m_recording && m_open_records.empty());
+		m_recording = false;
 	}
 
-	inline void Mesh::draw(GLenum primitive_type, GLsizei force_vertex_count) const
+	inline void GpuProfiler::begin_scope(const std::string& name)
 	{
-		PICOGL_ASSERT(m_vao);
-		glBindVertexArray(m_vao);
-		glDrawArrays(primitive_type, 0, force_vertex_count);
+		PICOGL_ASSERT(m_recording);
+		Frame& frame = m_frames[m_frame];
+		const std::string full_name = m_open_records.empty() ? name : m_scopes[frame.m_records[m_open_records.back()].m_scope].m_name + "/" + name;
+
+		auto it = m_scope_indices.find(full_name);
+		if (it == m_scope_indices.end()) {
+			ScopeStats scope;
+			scope.m_name = full_name;
+			scope.m_depth = GLuint(m_open_records.size());
+			scope.m_history_ms.reserve(m_history_size);
+			it = m_scope_indices.emplace(full_name, m_scopes.size()).first;
+			m_scopes.push_back(std::move(scope));
+		}
+
+		m_open_records.push_back(frame.m_records.size());
+		frame.m_records.push_back({ it->second, record_timestamp(frame), 0 });
+#if PICOGL_INSTRUMENT
+		Instrumentation::begin_scope(full_name);
+#endif
 	}
 
-	inline Mesh::operator GLuint() const
+	inline void GpuProfiler::end_scope()
 	{
-		return m_vao;
+		PICOGL_ASSERT(m_recording && !m_open_records.empty());
+		Frame& frame = m_frames[m_frame];
+#if PICOGL_INSTRUMENT
+		Instrumentation::end_scope();
+#endif
+		frame.m_records[m_open_records.back()].m_end_query = record_timestamp(frame);
+		m_open_records.pop_back();
 	}
 
-	inline GLsizei Mesh::get_vertex_sizeof() const
+	inline const std::vector<GpuProfiler::ScopeStats>& GpuProfiler::get_scopes() const
 	{
-		GLsizei vertex_sizeof = 0;
-		for (const VertexAttribute& attribute : m_vertex_attributes)
-			vertex_sizeof += attribute.m_channel_count * impl::get_scalar_sizeof(attribute.m_type);
-		return vertex_sizeof;
+		return m_scopes;
 	}
 
-	inline GLsizei Mesh::get_submeshes_count() const
+	inline const GpuProfiler::ScopeStats* GpuProfiler::find_scope(const std::string& name) const
 	{
-		return GLsizei(m_submeshes.size());
+		const auto it = m_scope_indices.find(name);
+		return it != m_scope_indices.end() ? &m_scopes[it->second] : nullptr;
 	}
 
-	inline Query Query::make(const GLenum target)
+	inline const std::vector<GpuProfiler::Event>& GpuProfiler::get_collected_events() const
 	{
-		Query query;
-		query.m_gl = impl::GLObject<impl::GLObjectType::Query>::make();
-		query.m_target = target;
-		return query;
+		return m_collected_events;
 	}
 
-	inline void Query::begin() const
+	inline std::size_t GpuProfiler::record_timestamp(Frame& frame)
 	{
-		glBeginQuery(m_target, m_gl);
+		if (frame.m_query_count == frame.m_queries.size())
+			frame.m_queries.push_back(Query::make(GL_TIMESTAMP));
+		frame.m_queries[frame.m_query_count].timestamp();
+		return frame.m_query_count++;
 	}
 
-	inline void Query::end() const
+	inline bool GpuProfiler::collect(Frame& frame)
 	{
-		glEndQuery(m_target);
+		for (std::size_t i = 0; i < frame.m_query_count; ++i)
+			if (!frame.m_queries[i].available())
+				return false;
+
+		m_frame_ms.assign(m_scopes.size(), -1.0);
+		for (const Record& record : frame.m_records) {
+			GLuint64 begin = 0, end = 0;
+			frame.m_queries[record.m_begin_query].get(begin, GL_QUERY_RESULT);
+			frame.m_queries[record.m_end_query].get(end, GL_QUERY_RESULT);
+			m_collected_events.push_back({ record.m_scope, begin, end });
+			m_frame_ms[record.m_scope] = std::max(m_frame_ms[record.m_scope], 0.0) + double(end - begin) * 1e-6;
+		}
+		for (std::size_t scope = 0; scope < m_scopes.size(); ++scope)
+			if (m_frame_ms[scope] >= 0.0)
+				add_sample(m_scopes[scope], float(m_frame_ms[scope]));
+
+		frame.m_query_count = 0;
+		frame.m_records.clear();
+		return true;
 	}
 
-	inline Query::operator GLuint() const
+	inline void GpuProfiler::add_sample(ScopeStats& scope, const float ms)
 	{
-		return m_gl;
+		if (scope.m_history_ms.size() < m_history_size)
+			scope.m_history_ms.push_back(ms);
+		else
+			scope.m_history_ms[scope.m_next] = ms;
+		scope.m_next = (scope.m_next + 1) % m_history_size;
+
+		std::vector<float> sorted = scope.m_history_ms;
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (const float sample : sorted)
+			sum += sample;
+		scope.m_last_ms = ms;
+		scope.m_min_ms = sorted.front();
+		scope.m_avg_ms = float(sum / sorted.size());
+		scope.m_p95_ms = sorted[(sorted.size() * 95 + 99) / 100 - 1];
 	}
 }
 
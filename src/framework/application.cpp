@@ -24,7 +24,7 @@ namespace framework
 		}
 
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 		glfwWindowHint(GLFW_CONTEXT_DEBUG, GLFW_TRUE);
 
@@ -88,6 +88,13 @@ namespace framework
 		spdlog::info(" OpenGL version: {}.{}", GLVersion.major, GLVersion.minor);
 		spdlog::info(" GPU: {}", (const char*)renderer);
 		spdlog::info(" GLSL version: {}", (const char*)shading_langage_version);
+
+		picogl::StateCache::set_current(&m_state_cache);
+		m_gpu_profiler = picogl::GpuProfiler::make();
+		picogl::GpuProfiler::set_current(&m_gpu_profiler);
+		m_tracer = Tracer::make();
+		Tracer::set_current(&m_tracer);
+		m_tracer.set_thread_name("main");
 	}
 
 	void Application::launch()
@@ -96,24 +103,49 @@ namespace framework
 
 		while (!glfwWindowShouldClose(m_main_window.get()))
 		{
+			m_tracer.begin_frame();
+#if PICOGL_INSTRUMENT
+			picogl::Instrumentation::next_frame();
+#endif
 			glfwPollEvents();
 			ImGui_ImplOpenGL3_NewFrame();
 			ImGui_ImplGlfw_NewFrame();
 			ImGui::NewFrame();
+			m_gpu_profiler.begin_frame();
 
-			update();
-
-			render();
-
-			gui();
+			{
+				PICOGL_TRACE_SCOPE("update");
+				update();
+			}
+			{
+				PICOGL_TRACE_SCOPE("render");
+				render();
+			}
+			{
+				PICOGL_TRACE_SCOPE("gui");
+				gui();
+			}
 
-			ImGui::Render();
-			picogl::Framebuffer::get_default().bind_draw();
-			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			{
+				PICOGL_TRACE_SCOPE("imgui");
+				PICOGL_GPU_SCOPE("imgui");
+				ImGui::Render();
+				picogl::Framebuffer::get_default().bind_draw();
+				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			}
+			m_state_cache.invalidate();
+			m_gpu_profiler.end_frame();
 
-			glfwSwapBuffers(m_main_window.get());
+			{
+				PICOGL_TRACE_SCOPE("swap");
+				glfwSwapBuffers(m_main_window.get());
+			}
+			m_tracer.end_frame(&m_gpu_profiler);
 		}
 
+		picogl::StateCache::set_current(nullptr);
+		picogl::GpuProfiler::set_current(nullptr);
+		Tracer::set_current(nullptr);
 		ImGui_ImplOpenGL3_Shutdown();
 		ImGui_ImplGlfw_Shutdown();
 		ImGui::DestroyContext();
@@ -1,4 +1,5 @@
 #include <picogl/framework/asset_io.h>
+#include <picogl/framework/trace.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -11,6 +12,7 @@
 #include <picogl/picogl.hpp>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/hash.hpp>
 #include <glm/gtx/transform.hpp>
 #include <spdlog/spdlog.h>
@@ -18,15 +20,98 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <unordered_map>
 #include <string>
 #include <queue>
+#include <utility>
 
 namespace framework
 {
 	constexpr float pi = 3.14159265f;
 
+	namespace
+	{
+		// Two triangles per cell of a row-major vertex grid, using every step-th row and column.
+		// The last row and column are always kept so that coarser grids cover the same surface.
+		std::vector<std::uint32_t> make_grid_triangles(const std::uint32_t row_count, const std::uint32_t column_count, const std::uint32_t step, const bool flip)
+		{
+			const auto make_lines = [step](const std::uint32_t count) {
+				std::vector<std::uint32_t> lines;
+				for (std::uint32_t i = 0; i + 1 < count; i += step)
+					lines.push_back(i);
+				lines.push_back(count - 1);
+				return lines;
+			};
+			const std::vector<std::uint32_t> rows = make_lines(row_count);
+			const std::vector<std::uint32_t> columns = make_lines(column_count);
+
+			std::vector<std::uint32_t> triangles;
+			triangles.reserve(6 * (rows.size() - 1) * (columns.size() - 1));
+			for (std::size_t t = 0; t + 1 < rows.size(); ++t) {
+				for (std::size_t p = 0; p + 1 < columns.size(); ++p) {
+					const std::uint32_t current_id = columns[p] + column_count * rows[t];
+					const std::uint32_t next_in_row = columns[p + 1] + column_count * rows[t];
+					const std::uint32_t next_in_col = columns[p] + column_count * rows[t + 1];
+					const std::uint32_t next_next = columns[p + 1] + column_count * rows[t + 1];
+					if (flip)
+						triangles.insert(triangles.end(), { current_id, next_in_col, next_in_row, next_in_row, next_in_col, next_next });
+					else
+						triangles.insert(triangles.end(), { current_id, next_in_row, next_in_col, next_in_row, next_next, next_in_col });
+				}
+			}
+			return triangles;
+		}
+
+		std::vector<std::vector<std::uint32_t>> make_grid_lods(const std::uint32_t row_count, const std::uint32_t column_count, const std::uint32_t lod_count, const bool flip)
+		{
+			std::vector<std::vector<std::uint32_t>> lods;
+			for (std::uint32_t lod = 1; lod < lod_count; ++lod)
+				lods.push_back(make_grid_triangles(row_count, column_count, 1u << lod, flip));
+			return lods;
+		}
+
+		// Reorders triangles for the post-transform cache, and for overdraw unless they are split into meshlets,
+		// which are only reordered internally. Vertices are then renumbered in order of first use.
+		// Returns the cache statistics of the full resolution level before and after.
+		std::pair<VertexCacheStats, VertexCacheStats> optimize_mesh(
+			std::vector<std::uint32_t>& indices,
+			std::vector<std::vector<std::uint32_t>>& lods,
+			const std::vector<Meshlet>& meshlets,
+			std::vector<glm::vec3>& ps,
+			std::vector<glm::vec3>& ns,
+			std::vector<glm::vec2>& uvs,
+			std::vector<glm::vec3>& cs)
+		{
+			const std::size_t vertex_count = ps.size();
+			const VertexCacheStats before = analyze_vertex_cache(indices, vertex_count);
+
+			if (meshlets.empty())
+				indices = optimize_overdraw(optimize_vertex_cache(indices, vertex_count), ps);
+			else {
+				for (const Meshlet& meshlet : meshlets) {
+					const auto first = indices.begin() + meshlet.m_first_index;
+					const std::vector<std::uint32_t> optimized = optimize_vertex_cache({ first, first + meshlet.m_index_count }, vertex_count);
+					std::copy(optimized.begin(), optimized.end(), first);
+				}
+			}
+			for (std::vector<std::uint32_t>& lod : lods)
+				lod = optimize_vertex_cache(lod, vertex_count);
+
+			const std::vector<std::uint32_t> remap = make_vertex_fetch_remap(indices, vertex_count);
+			remap_indices(indices, remap);
+			for (std::vector<std::uint32_t>& lod : lods)
+				remap_indices(lod, remap);
+			remap_vertices(ps, remap);
+			remap_vertices(ns, remap);
+			remap_vertices(uvs, remap);
+			remap_vertices(cs, remap);
+
+			return { before, analyze_vertex_cache(indices, vertex_count) };
+		}
+	}
+
 	AABB make_aabb(const std::vector<glm::vec3>& positions)
 	{
 		AABB aabb = AABB::make_empty();
@@ -53,8 +138,9 @@ namespace framework
 		return str;
 	}
 
-	std::vector<Mesh> make_mesh_from_obj(const std::filesystem::path& filepath)
+	std::vector<Mesh> make_mesh_from_obj(const std::filesystem::path& filepath, const VertexFormat format, const std::vector<float>& lod_ratios, const std::uint32_t meshlet_triangle_count, const bool optimize)
 	{
+		PICOGL_TRACE_SCOPE("make_mesh_from_obj");
 		struct Vertex {
 			glm::vec3 m_position;
 			glm::vec3 m_normal;
@@ -161,8 +247,39 @@ namespace framework
 				uvs[i] = v.m_uv;
 			}
 
+			std::vector<std::vector<std::uint32_t>> lods;
+			if (!lod_ratios.empty()) {
+				SimplifyOptions options;
+				options.m_ratios = lod_ratios;
+				for (LodLevel& level : make_lod_chain(indices, pos, ns, uvs, options)) {
+					spdlog::info("{} {}: lod {} with {} triangles, error {}", filepath.filename().string(), shape.name, lods.size() + 1, level.m_indices.size() / 3, level.m_error);
+					lods.push_back(std::move(level.m_indices));
+					mesh.m_lod_errors.push_back(level.m_error);
+				}
+			}
+
+			if (lods.empty() && meshlet_triangle_count) {
+				Meshlets meshlets = make_meshlets(indices, pos, meshlet_triangle_count);
+				indices = std::move(meshlets.m_indices);
+				mesh.m_meshlets = std::move(meshlets.m_meshlets);
+			} else if (meshlet_triangle_count)
+				spdlog::warn("{} {}: meshlets are not combined with levels of detail", filepath.filename().string(), shape.name);
+
+			if (optimize) {
+				const auto [before, after] = optimize_mesh(indices, lods, mesh.m_meshlets, pos, ns, uvs, col);
+				spdlog::info("{} {}: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", filepath.filename().string(), shape.name,
+					before.m_acmr, after.m_acmr, before.m_atvr, after.m_atvr);
+			}
+
 			mesh.m_aabb = make_aabb(pos);
-			mesh.m_mesh = utils::make_triangle_mesh(indices, pos, ns, uvs, col);
+			utils::set_triangle_mesh(mesh, indices, pos, ns, uvs, col, format, lods);
+			if (!mesh.m_meshlets.empty()) {
+				std::vector<GLuint> cluster_index_counts;
+				cluster_index_counts.reserve(mesh.m_meshlets.size());
+				for (const Meshlet& meshlet : mesh.m_meshlets)
+					cluster_index_counts.push_back(meshlet.m_index_count);
+				mesh.m_mesh.set_clusters(cluster_index_counts);
+			}
 			meshes.push_back(std::move(mesh));
 		}
 
@@ -226,7 +343,7 @@ namespace framework
 		return dst;
 	}
 
-	Mesh make_cube()
+	Mesh make_cube(const VertexFormat format)
 	{
 		static const std::vector<glm::uvec3> tris = {
 			{ 0, 3, 1 }, { 0, 2, 3 },
@@ -269,17 +386,16 @@ namespace framework
 
 		Mesh mesh;
 		mesh.m_aabb = make_aabb(positions);
-		mesh.m_mesh = utils::make_triangle_mesh(tris, positions, std::vector<glm::vec3>(positions.size(), glm::vec3(1)), uvs, std::vector<glm::vec3>(positions.size(), glm::vec3(1)));
+		utils::set_triangle_mesh(mesh, tris, positions, std::vector<glm::vec3>(positions.size(), glm::vec3(1)), uvs, std::vector<glm::vec3>(positions.size(), glm::vec3(1)), format);
 		return mesh;
 	}
 
-	Mesh make_torus(const float R, const float r, std::uint32_t precision)
+	Mesh make_torus(const float R, const float r, std::uint32_t precision, const VertexFormat format, const std::uint32_t lod_count)
 	{
 		precision = std::max(precision, 2u);
 		std::vector<glm::vec3> positions((precision + 1u) * precision);
 		std::vector<glm::vec3> normals(positions.size());
 		std::vector<glm::vec2> uvs(positions.size());
-		std::vector<glm::uvec3> triangles(2u * precision * (precision - 1u));
 
 		const float frac = 1.0f / ((float)precision - 1.0f);
 		const float frac_uv = 1.0f / (float)precision;
@@ -300,31 +416,23 @@ namespace framework
 			}
 		}
 
-		std::uint32_t tri_id = 0;
-		for (std::uint32_t t = 0; t < precision - 1u; ++t) {
-			for (std::uint32_t p = 0; p < precision; ++p, tri_id += 2u) {
-				const std::uint32_t current_id = p + (precision + 1u) * t;
-				const std::uint32_t next_in_row = current_id + 1u;
-				const std::uint32_t next_in_col = current_id + precision + 1u;
-				const std::uint32_t next_next = next_in_col + 1u;
-				triangles[tri_id] = glm::uvec3(current_id, next_in_row, next_in_col);
-				triangles[tri_id + 1] = glm::uvec3(next_in_row, next_next, next_in_col);
-			}
-		}
+		std::vector<std::uint32_t> triangles = make_grid_triangles(precision, precision + 1u, 1u, false);
+		std::vector<std::vector<std::uint32_t>> lods = make_grid_lods(precision, precision + 1u, lod_count, false);
+		std::vector<glm::vec3> colors(positions.size(), glm::vec3(1));
+		optimize_mesh(triangles, lods, {}, positions, normals, uvs, colors);
 
 		Mesh mesh;
 		mesh.m_aabb = make_aabb(positions);
-		mesh.m_mesh = utils::make_triangle_mesh(triangles, positions, normals, uvs, std::vector<glm::vec3>(positions.size(), glm::vec3(1)));
+		utils::set_triangle_mesh(mesh, triangles, positions, normals, uvs, colors, format, lods);
 		return mesh;
 	}
 
-	Mesh make_sphere(std::uint32_t precision)
+	Mesh make_sphere(std::uint32_t precision, const VertexFormat format, const std::uint32_t lod_count)
 	{
 		precision = std::max(precision, 2u);
 		std::vector<glm::vec3> positions((precision + 1u) * precision);
 		std::vector<glm::vec3> normals(positions.size());
 		std::vector<glm::vec2> uvs(positions.size());
-		std::vector<glm::uvec3> triangles(2u * precision * (precision - 1u));
 
 		const float frac_p = 1.0f / (float)precision;
 		const float frac_t = 1.0f / ((float)precision - 1.0f);
@@ -342,21 +450,14 @@ namespace framework
 			}
 		}
 
-		std::uint32_t tri_id = 0;
-		for (std::uint32_t t = 0; t < precision - 1; ++t) {
-			for (std::uint32_t p = 0; p < precision; ++p, tri_id += 2) {
-				const std::uint32_t current_id = p + (precision + 1) * t;
-				const std::uint32_t next_in_row = current_id + 1;
-				const std::uint32_t next_in_col = current_id + precision + 1;
-				const std::uint32_t next_next = next_in_col + 1;
-				triangles[tri_id] = glm::uvec3(current_id, next_in_col, next_in_row);
-				triangles[tri_id + 1] = glm::uvec3(next_in_row, next_in_col, next_next);
-			}
-		}
+		std::vector<std::uint32_t> triangles = make_grid_triangles(precision, precision + 1u, 1u, true);
+		std::vector<std::vector<std::uint32_t>> lods = make_grid_lods(precision, precision + 1u, lod_count, true);
+		std::vector<glm::vec3> colors(positions.size(), glm::vec3(1));
+		optimize_mesh(triangles, lods, {}, positions, normals, uvs, colors);
 
 		Mesh mesh;
 		mesh.m_aabb = { glm::vec3(-1), glm::vec3(1) };
-		mesh.m_mesh = utils::make_triangle_mesh(triangles, positions, normals, uvs, std::vector<glm::vec3>(positions.size(), glm::vec3(1)));
+		utils::set_triangle_mesh(mesh, triangles, positions, normals, uvs, colors, format, lods);
 		return mesh;
 	}
 
@@ -401,6 +502,27 @@ namespace framework
 			picogl::Texture::Options::AutomaticAlignment | picogl::Texture::Options::GenerateMipmap);
 	}
 
+	void update_texture_from_image(picogl::Texture& dst, const Image& src, picogl::UploadPool& pool)
+	{
+		PICOGL_ASSERT(dst.width() == GLsizei(src.m_width) && dst.height() == GLsizei(src.m_height));
+
+		const std::size_t row_size = std::size_t(src.m_width) * src.m_pixel_sizeof;
+		update_texture_from_rows(dst, pool, [&](const std::uint32_t y, std::byte* row) {
+			std::memcpy(row, src.m_pixels.data() + y * row_size, row_size);
+			});
+	}
+
+	void update_texture_from_rows(picogl::Texture& dst, picogl::UploadPool& pool, const std::function<void(std::uint32_t y, std::byte* row)>& fill_row)
+	{
+		picogl::UploadPool::Staging staging = pool.acquire(dst);
+		PICOGL_ASSERT(staging.row_stride() > 0);
+		for (std::uint32_t y = 0; y < std::uint32_t(dst.height()); ++y)
+			fill_row(y, static_cast<std::byte*>(staging.data()) + y * staging.row_stride());
+
+		dst.upload_data(std::move(staging));
+		dst.generate_mipmap();
+	}
+
 	picogl::Texture make_cubemap_from_file(const std::filesystem::path& filepath, GLenum internal_format)
 	{
 		const Image img = make_image_from_file(filepath);
@@ -509,6 +631,34 @@ namespace framework
 			const float u = t * t * (3.0f - 2.0f * t);
 			return glm::mix(a, b, u);
 		}
+
+		glm::u16vec4 quantize_position(const glm::vec3& position, const AABB& aabb)
+		{
+			// Flat axes would divide by zero.
+			const glm::vec3 extent = glm::max(aabb.diagonal(), glm::vec3(1e-8f));
+			const glm::vec3 t = glm::clamp((position - aabb.m_min) / extent, glm::vec3(0), glm::vec3(1));
+			return glm::u16vec4(glm::round(t * 65535.0f), 0);
+		}
+
+		glm::mat4 make_dequantization(const AABB& aabb)
+		{
+			return glm::translate(aabb.m_min) * glm::scale(glm::max(aabb.diagonal(), glm::vec3(1e-8f)));
+		}
+
+		std::uint32_t quantize_normal(const glm::vec3& normal)
+		{
+			return glm::packSnorm3x10_1x2(glm::vec4(normal, 0));
+		}
+
+		std::uint32_t quantize_uv(const glm::vec2& uv)
+		{
+			return glm::packHalf2x16(uv);
+		}
+
+		std::uint32_t quantize_color(const glm::vec3& color)
+		{
+			return glm::packUnorm4x8(glm::vec4(color, 1));
+		}
 	}
 }
 
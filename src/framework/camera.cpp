@@ -1,5 +1,6 @@
 #include <picogl/framework/camera.h>
 
+#include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace framework
@@ -35,4 +36,18 @@ namespace framework
 		return m_inverse_view[1];
 	}
 
+	std::array<glm::vec4, 6> Camera::frustum_planes() const
+	{
+		// Gribb-Hartmann extraction, clip space is -w <= x, y, z <= w.
+		const glm::vec4 x = glm::row(m_view_proj, 0);
+		const glm::vec4 y = glm::row(m_view_proj, 1);
+		const glm::vec4 z = glm::row(m_view_proj, 2);
+		const glm::vec4 w = glm::row(m_view_proj, 3);
+
+		std::array<glm::vec4, 6> planes = { w + x, w - x, w + y, w - y, w + z, w - z };
+		for (glm::vec4& plane : planes)
+			plane /= glm::length(glm::vec3(plane));
+		return planes;
+	}
+
 }
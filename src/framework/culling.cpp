@@ -0,0 +1,358 @@
+#include <picogl/framework/culling.h>
+#include <picogl/framework/asset_io.h>
+
+#define PICOGL_IMPLEMENTATION
+#include <picogl/picogl.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace framework
+{
+	namespace
+	{
+		constexpr GLuint workgroup_size = 64;
+
+		GLuint workgroup_count(const GLsizei count, const GLuint size = workgroup_size)
+		{
+			return (GLuint(count) + size - 1) / size;
+		}
+
+		void dispatch_compute(const GLuint x, const GLuint y = 1, const GLuint z = 1)
+		{
+			PICOGL_INSTRUMENT_CALL(Dispatches, 1);
+			glDispatchCompute(x, y, z);
+		}
+
+		// Pixels covered by one world unit at unit distance, relative to the level switch size.
+		float get_lod_scale(const Camera& camera, const float lod_pixel_size)
+		{
+			return camera.m_h / (2.0f * std::tan(camera.m_fov / 2.0f)) / lod_pixel_size;
+		}
+
+		// Matches select_lod in cull_instances.comp.
+		GLuint select_lod(const Camera& camera, const float lod_scale, const InstanceBounds& instance, const GLuint lod_count)
+		{
+			if (lod_count <= 1)
+				return 0;
+
+			const glm::vec3 center = 0.5f * (instance.m_min + instance.m_max);
+			const float radius = 0.5f * glm::length(instance.m_max - instance.m_min);
+			const float distance_to_camera = std::max(glm::length(center - camera.m_position) - radius, 1e-4f);
+			const float projected_size = 2.0f * radius * lod_scale / distance_to_camera;
+			if (projected_size >= 1.0f)
+				return 0;
+			return std::min(GLuint(std::floor(-std::log2(projected_size))) + 1, lod_count - 1);
+		}
+	}
+
+	DepthPyramid DepthPyramid::make(const std::filesystem::path& shader_folder, ProgramCache& cache)
+	{
+		DepthPyramid pyramid;
+		pyramid.m_program = cache.make_program({ { GL_COMPUTE_SHADER, make_string_from_file(shader_folder / "depth_pyramid.comp") } });
+		return pyramid;
+	}
+
+	void DepthPyramid::build(const picogl::Texture& depth)
+	{
+		if (m_pyramid.width() != depth.width() || m_pyramid.height() != depth.height()) {
+			m_pyramid = picogl::Texture::make_2d(GL_R32F, depth.width(), depth.height(), 1, 1, nullptr, picogl::Texture::Options::AllocateMipmap);
+			m_pyramid.set_filtering(GL_NEAREST, GL_NEAREST_MIPMAP_NEAREST);
+			m_pyramid.set_label("depth_pyramid");
+		}
+
+		m_program.use();
+		GLsizei source_width = depth.width();
+		GLsizei source_height = depth.height();
+		for (GLsizei level = 0; level < level_count(); ++level) {
+			// The first level is a copy of the depth, each next one halves the previous one.
+			const GLsizei width = level ? std::max(source_width / 2, 1) : source_width;
+			const GLsizei height = level ? std::max(source_height / 2, 1) : source_height;
+
+			if (level)
+				m_pyramid.bind_as_sampler(GL_TEXTURE0);
+			else
+				depth.bind_as_sampler(GL_TEXTURE0);
+			m_pyramid.bind_as_image(0, level, 0, GL_WRITE_ONLY);
+
+			m_program.set("source_level", GLint(level ? level - 1 : 0));
+			m_program.set("source_size", glm::ivec2(source_width, source_height));
+			m_program.set("destination_size", glm::ivec2(width, height));
+			m_program.set("reduce", GLint(level > 0));
+			dispatch_compute(workgroup_count(width, 8), workgroup_count(height, 8));
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+			source_width = width;
+			source_height = height;
+		}
+	}
+
+	void DepthPyramid::bind_as_sampler(const GLuint slot) const
+	{
+		m_pyramid.bind_as_sampler(slot);
+	}
+
+	GLsizei DepthPyramid::width() const
+	{
+		return m_pyramid.width();
+	}
+
+	GLsizei DepthPyramid::height() const
+	{
+		return m_pyramid.height();
+	}
+
+	GLsizei DepthPyramid::level_count() const
+	{
+		return m_pyramid ? m_pyramid.lod_count_2D() : 0;
+	}
+
+	InstanceCuller InstanceCuller::make(const std::filesystem::path& shader_folder, ProgramCache& cache)
+	{
+		InstanceCuller culler;
+		culler.m_cull_program = cache.make_program({ { GL_COMPUTE_SHADER, make_string_from_file(shader_folder / "cull_instances.comp") } });
+		culler.m_compact_program = cache.make_program({ { GL_COMPUTE_SHADER, make_string_from_file(shader_folder / "compact_draws.comp") } });
+		culler.m_draw_count = picogl::Buffer::make(GL_PARAMETER_BUFFER, sizeof(GLuint));
+
+		culler.m_stats_buffer = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, sizeof(Stats));
+		for (StatsReadback& readback : culler.m_stats_readbacks)
+			readback.m_buffer = picogl::Buffer::make_persistent(GL_COPY_WRITE_BUFFER, sizeof(Stats),
+				GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+		return culler;
+	}
+
+	void InstanceCuller::set_instances(const picogl::MeshPool& pool, const std::vector<InstanceBounds>& bounds)
+	{
+		m_instance_count = GLsizei(bounds.size());
+		m_pool_draw_count = pool.get_draw_count();
+		if (!m_instance_count || !m_pool_draw_count)
+			return;
+
+		std::vector<GLuint> draw_instance_counts(m_pool_draw_count, 0);
+		for (const InstanceBounds& instance : bounds)
+			++draw_instance_counts[instance.m_draw_id];
+
+		// One command per level of each draw. Each command gets a region of the visible list large enough
+		// for all the instances of the draw, since they may all pick the same level.
+		std::vector<picogl::Mesh::DrawElementsIndirectCommand> draws;
+		std::vector<glm::uvec2> draw_lods(m_pool_draw_count);
+		GLuint offset = 0;
+		for (GLsizei draw_id = 0; draw_id < m_pool_draw_count; ++draw_id) {
+			// The pool draw may be at any level, only its base vertex is kept.
+			const picogl::Mesh::DrawElementsIndirectCommand& pool_draw = pool.get_draws()[draw_id];
+			const std::vector<picogl::Mesh::LodRange>& lods = pool.get_lods(draw_id);
+			draw_lods[draw_id] = glm::uvec2(GLuint(draws.size()), GLuint(lods.size()));
+
+			for (const picogl::Mesh::LodRange& lod : lods) {
+				picogl::Mesh::DrawElementsIndirectCommand draw = pool_draw;
+				draw.m_count = lod.m_index_count;
+				draw.m_first_index = lod.m_first_index;
+				draw.m_instance_count = 0;
+				draw.m_base_instance = offset;
+				offset += draw_instance_counts[draw_id];
+				draws.push_back(draw);
+			}
+		}
+		m_command_count = GLsizei(draws.size());
+
+		m_bounds = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, bounds);
+		m_draw_lods = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, draw_lods);
+		m_reset_draws = picogl::Buffer::make(GL_DRAW_INDIRECT_BUFFER, draws);
+		m_draws = picogl::Buffer::make(GL_DRAW_INDIRECT_BUFFER, m_reset_draws.get_size());
+		m_visible_instances = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, offset * sizeof(GLuint));
+		// Nothing was visible before, the first late phase draws everything that passes.
+		m_visibility = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, std::vector<GLuint>(m_instance_count, 0));
+		m_compacted_draws = picogl::Buffer::make(GL_DRAW_INDIRECT_BUFFER, m_reset_draws.get_size());
+
+		for (const picogl::Buffer* buffer : { &m_bounds, &m_draw_lods, &m_reset_draws, &m_draws, &m_visible_instances, &m_visibility, &m_compacted_draws })
+			buffer->set_label("instance_culler");
+	}
+
+	void InstanceCuller::cull(const Camera& camera)
+	{
+		begin_frame();
+		dispatch(camera, Phase::Frustum, nullptr);
+		end_frame();
+	}
+
+	void InstanceCuller::cull_early(const Camera& camera)
+	{
+		begin_frame();
+		dispatch(camera, Phase::Early, nullptr);
+	}
+
+	void InstanceCuller::cull_late(const Camera& camera, const DepthPyramid& pyramid)
+	{
+		dispatch(camera, Phase::Late, &pyramid);
+		end_frame();
+	}
+
+	void InstanceCuller::draw(const picogl::MeshPool& pool) const
+	{
+		if (!m_instance_count || !m_pool_draw_count)
+			return;
+
+		pool.draw_indirect(m_compacted_draws, m_command_count, &m_draw_count);
+	}
+
+	void InstanceCuller::set_lod_pixel_size(const float pixel_size)
+	{
+		m_lod_pixel_size = pixel_size;
+	}
+
+	std::vector<GLuint> InstanceCuller::select_lods(const Camera& camera, const picogl::MeshPool& pool, const std::vector<InstanceBounds>& bounds) const
+	{
+		constexpr GLuint no_instance = ~GLuint(0);
+		std::vector<GLuint> lods(pool.get_draw_count(), no_instance);
+		const float lod_scale = get_lod_scale(camera, m_lod_pixel_size);
+		for (const InstanceBounds& instance : bounds) {
+			GLuint& lod = lods[instance.m_draw_id];
+			if (lod != 0)
+				lod = std::min(lod, select_lod(camera, lod_scale, instance, GLuint(pool.get_lods(GLsizei(instance.m_draw_id)).size())));
+		}
+		std::replace(lods.begin(), lods.end(), no_instance, GLuint(0));
+		return lods;
+	}
+
+	void InstanceCuller::bind_visible_instances(const GLuint index) const
+	{
+		m_visible_instances.bind_as_ssbo(index);
+	}
+
+	GLsizei InstanceCuller::instance_count() const
+	{
+		return m_instance_count;
+	}
+
+	const InstanceCuller::Stats& InstanceCuller::stats() const
+	{
+		return m_stats;
+	}
+
+	void InstanceCuller::begin_frame()
+	{
+		for (StatsReadback& readback : m_stats_readbacks) {
+			if (readback.m_pending && readback.m_fence.signaled()) {
+				std::memcpy(&m_stats, readback.m_buffer.get_mapped_data(), sizeof(Stats));
+				readback.m_pending = false;
+			}
+		}
+
+		const Stats zero = {};
+		m_stats_buffer.upload_data(&zero);
+	}
+
+	void InstanceCuller::dispatch(const Camera& camera, const Phase phase, const DepthPyramid* pyramid)
+	{
+		if (!m_instance_count || !m_pool_draw_count)
+			return;
+
+		const std::array<glm::vec4, 6> planes = camera.frustum_planes();
+
+		m_reset_draws.copy_to(m_draws);
+		m_cull_program.use();
+		m_cull_program.set(m_cull_program.get_uniform_handle("frustum_planes"), planes.data(), GLsizei(planes.size()));
+		m_cull_program.set("instance_count", GLuint(m_instance_count));
+		m_cull_program.set("phase", GLuint(phase));
+		m_cull_program.set("camera_position", camera.m_position);
+		m_cull_program.set("lod_scale", get_lod_scale(camera, m_lod_pixel_size));
+		if (pyramid) {
+			pyramid->bind_as_sampler(GL_TEXTURE0);
+			m_cull_program.set("view_proj", camera.m_view_proj);
+			m_cull_program.set("pyramid_size", glm::ivec2(pyramid->width(), pyramid->height()));
+			m_cull_program.set("pyramid_level_count", GLint(pyramid->level_count()));
+		}
+		m_bounds.bind_as_ssbo(0);
+		m_draws.bind_as_ssbo(1);
+		m_visible_instances.bind_as_ssbo(2);
+		m_visibility.bind_as_ssbo(5);
+		m_stats_buffer.bind_as_ssbo(6);
+		m_draw_lods.bind_as_ssbo(7);
+		dispatch_compute(workgroup_count(m_instance_count));
+
+		const GLuint zero = 0;
+		m_draw_count.upload_data(&zero);
+
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		m_compact_program.use();
+		m_compact_program.set("command_count", GLuint(m_command_count));
+		m_draws.bind_as_ssbo(1);
+		m_compacted_draws.bind_as_ssbo(3);
+		m_draw_count.bind_as_ssbo(4);
+		dispatch_compute(workgroup_count(m_command_count));
+
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	void InstanceCuller::end_frame()
+	{
+		// Skipped while the GPU still holds the slot, the counters are only informative.
+		StatsReadback& readback = m_stats_readbacks[m_stats_frame];
+		if (readback.m_pending)
+			return;
+
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		m_stats_buffer.copy_to(readback.m_buffer);
+		readback.m_fence = picogl::Fence::make();
+		readback.m_pending = true;
+		m_stats_frame = (m_stats_frame + 1) % m_stats_readbacks.size();
+	}
+
+	ClusterCuller ClusterCuller::make(const std::filesystem::path& shader_folder, ProgramCache& cache)
+	{
+		ClusterCuller culler;
+		culler.m_program = cache.make_program({ { GL_COMPUTE_SHADER, make_string_from_file(shader_folder / "cull_clusters.comp") } });
+		return culler;
+	}
+
+	void ClusterCuller::set_clusters(const std::vector<Meshlet>& meshlets, const GLuint instance_count)
+	{
+		m_cluster_count = GLsizei(meshlets.size());
+		m_instance_count = instance_count;
+		if (!m_cluster_count)
+			return;
+
+		// Bounding sphere and normal cone of each cluster.
+		std::vector<glm::vec4> clusters;
+		clusters.reserve(2 * meshlets.size());
+		for (const Meshlet& meshlet : meshlets) {
+			clusters.emplace_back(meshlet.m_center, meshlet.m_radius);
+			clusters.emplace_back(meshlet.m_cone_axis, meshlet.m_cone_cutoff);
+		}
+		m_clusters = picogl::Buffer::make(GL_SHADER_STORAGE_BUFFER, clusters);
+		m_clusters.set_label("cluster_culler");
+	}
+
+	void ClusterCuller::cull(const Camera& camera, const glm::mat4& model, const picogl::Mesh& mesh)
+	{
+		if (!m_cluster_count)
+			return;
+		PICOGL_ASSERT(mesh.get_submeshes_count() == m_cluster_count && mesh.get_indirect_draw_buffer());
+
+		const float scale_x = glm::length(glm::vec3(model[0]));
+		const float scale_y = glm::length(glm::vec3(model[1]));
+		const float scale_z = glm::length(glm::vec3(model[2]));
+		const float max_scale = std::max(scale_x, std::max(scale_y, scale_z));
+		const float min_scale = std::min(scale_x, std::min(scale_y, scale_z));
+
+		const std::array<glm::vec4, 6> planes = camera.frustum_planes();
+		m_program.use();
+		m_program.set(m_program.get_uniform_handle("frustum_planes"), planes.data(), GLsizei(planes.size()));
+		m_program.set("model", model);
+		m_program.set("max_scale", max_scale);
+		m_program.set("cone_culling", GLint(max_scale - min_scale <= 1e-3f * max_scale));
+		m_program.set("camera_position", camera.m_position);
+		m_program.set("cluster_count", GLuint(m_cluster_count));
+		m_program.set("instance_count", m_instance_count);
+		m_clusters.bind_as_ssbo(0);
+		mesh.get_indirect_draw_buffer().bind_as_ssbo(1);
+		dispatch_compute(workgroup_count(m_cluster_count));
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	GLsizei ClusterCuller::cluster_count() const
+	{
+		return m_cluster_count;
+	}
+}
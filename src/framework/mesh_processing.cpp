@@ -0,0 +1,922 @@
+#include <picogl/framework/mesh_processing.h>
+#include <picogl/framework/trace.h>
+
+#include <glm/gtx/hash.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+
+namespace framework
+{
+	namespace
+	{
+		constexpr std::uint32_t invalid = ~0u;
+		constexpr std::size_t attribute_count = 5; // Weighted normal and uv.
+		constexpr float border_weight = 10.0f;
+
+		using Attributes = std::array<float, attribute_count>;
+
+		// Runs func(begin, end) over contiguous ranges of [0, count), one per thread.
+		void parallel_for(const std::size_t count, const std::uint32_t thread_count, const std::function<void(std::size_t, std::size_t)>& func)
+		{
+			constexpr std::size_t min_range_size = 1 << 12;
+			const std::size_t range_count = std::min<std::size_t>(thread_count, (count + min_range_size - 1) / min_range_size);
+			if (range_count <= 1) {
+				func(0, count);
+				return;
+			}
+
+			const std::size_t range_size = (count + range_count - 1) / range_count;
+			std::vector<std::thread> threads;
+			threads.reserve(range_count - 1);
+			for (std::size_t r = 1; r < range_count; ++r)
+				threads.emplace_back([&func](const std::size_t begin, const std::size_t end) {
+					PICOGL_TRACE_SCOPE("parallel_for");
+					func(begin, end);
+					}, r * range_size, std::min(count, (r + 1) * range_size));
+			func(0, std::min(count, range_size));
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+
+		// Symmetric 4x4 matrix of the squared distance to a set of planes, weighted by area.
+		struct Quadric
+		{
+			void add_plane(const glm::vec3& n, const float d, const float w)
+			{
+				m_a00 += w * n.x * n.x;
+				m_a11 += w * n.y * n.y;
+				m_a22 += w * n.z * n.z;
+				m_a10 += w * n.y * n.x;
+				m_a20 += w * n.z * n.x;
+				m_a21 += w * n.z * n.y;
+				m_b0 += w * d * n.x;
+				m_b1 += w * d * n.y;
+				m_b2 += w * d * n.z;
+				m_c += w * d * d;
+			}
+
+			float evaluate(const glm::vec3& p) const
+			{
+				return m_a00 * p.x * p.x + m_a11 * p.y * p.y + m_a22 * p.z * p.z
+					+ 2.0f * (m_a10 * p.x * p.y + m_a20 * p.x * p.z + m_a21 * p.y * p.z)
+					+ 2.0f * (m_b0 * p.x + m_b1 * p.y + m_b2 * p.z) + m_c;
+			}
+
+			Quadric& operator+=(const Quadric& q)
+			{
+				m_a00 += q.m_a00; m_a11 += q.m_a11; m_a22 += q.m_a22;
+				m_a10 += q.m_a10; m_a20 += q.m_a20; m_a21 += q.m_a21;
+				m_b0 += q.m_b0; m_b1 += q.m_b1; m_b2 += q.m_b2;
+				m_c += q.m_c;
+				m_w += q.m_w;
+				return *this;
+			}
+
+			float m_a00 = 0, m_a11 = 0, m_a22 = 0, m_a10 = 0, m_a20 = 0, m_a21 = 0;
+			float m_b0 = 0, m_b1 = 0, m_b2 = 0, m_c = 0;
+			float m_w = 0;
+		};
+
+		// Each attribute varies linearly over a triangle as dot(g, p) + d. Moving a vertex to p with attributes a
+		// costs the sum of w * (dot(g, p) + d - a)^2: the quadric holds the terms in p, the gradients sum w * (g, d).
+		struct AttributeQuadric
+		{
+			float evaluate(const glm::vec3& p, const Attributes& a) const
+			{
+				float error = m_quadric.evaluate(p);
+				for (std::size_t k = 0; k < attribute_count; ++k)
+					error += a[k] * a[k] * m_quadric.m_w - 2.0f * a[k] * (glm::dot(glm::vec3(m_gradients[k]), p) + m_gradients[k].w);
+				return error;
+			}
+
+			AttributeQuadric& operator+=(const AttributeQuadric& q)
+			{
+				m_quadric += q.m_quadric;
+				for (std::size_t k = 0; k < attribute_count; ++k)
+					m_gradients[k] += q.m_gradients[k];
+				return *this;
+			}
+
+			Quadric m_quadric;
+			std::array<glm::vec4, attribute_count> m_gradients = {};
+		};
+
+		float normalized(const float error, const float weight)
+		{
+			return weight > 0.0f ? std::abs(error) / weight : 0.0f;
+		}
+
+		enum class VertexKind : std::uint8_t
+		{
+			Manifold, // Collapses along any edge.
+			Border, // Only along the open edges of the mesh.
+			Seam, // Two vertices at the same position, only along the seam and together.
+			Locked,
+		};
+
+		struct Collapse
+		{
+			std::uint32_t m_from = invalid; // Position of the vertices removed.
+			std::uint32_t m_to = invalid;
+			float m_error = 0.0f; // Position and attributes, used for ordering.
+			float m_position_error = 0.0f;
+		};
+
+		// Vertices are grouped by position, the first one of each group stands for the group.
+		class Simplifier
+		{
+		public:
+			Simplifier(const std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+				const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvs, const SimplifyOptions& options);
+
+			// Collapses edges until the index count or the error limit is reached.
+			void simplify(const std::size_t target_index_count, const float max_error);
+
+			const std::vector<std::uint32_t>& indices() const { return m_indices; }
+			// In object units.
+			float error() const { return std::sqrt(m_error) * m_extent; }
+
+		private:
+			void build_adjacency();
+			void classify(const std::size_t begin, const std::size_t end);
+			void compute_quadrics(const std::size_t begin, const std::size_t end);
+
+			bool has_edge(const std::uint32_t from, const std::uint32_t to, const bool same_position) const;
+			bool find_targets(const std::uint32_t from, const std::uint32_t to, std::array<std::uint32_t, 2>& targets) const;
+			bool can_collapse(const std::uint32_t from, const std::uint32_t to, const std::array<std::uint32_t, 2>& targets) const;
+			Collapse rank(const std::uint32_t from, const std::uint32_t to) const;
+			bool has_flips(const std::uint32_t from, const std::uint32_t to) const;
+
+			std::vector<std::uint32_t> m_indices;
+			std::vector<glm::vec3> m_positions; // Normalized to the unit cube.
+			std::vector<Attributes> m_attributes;
+			std::vector<std::uint32_t> m_remap; // First vertex at the same position.
+			std::vector<std::uint32_t> m_wedges; // Next vertex at the same position, circular.
+			std::vector<VertexKind> m_kinds;
+			std::vector<Quadric> m_quadrics; // Per position.
+			std::vector<AttributeQuadric> m_attribute_quadrics; // Per vertex.
+			std::vector<std::uint32_t> m_adjacency_offsets; // Triangles around each position.
+			std::vector<std::uint32_t> m_adjacency;
+			std::vector<std::uint32_t> m_collapse_remap;
+			std::uint32_t m_thread_count = 1;
+			float m_extent = 1.0f;
+			float m_error = 0.0f; // Largest squared position error so far, normalized.
+		};
+
+		Simplifier::Simplifier(const std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+			const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvs, const SimplifyOptions& options)
+			: m_indices(indices)
+		{
+			m_thread_count = options.m_thread_count ? options.m_thread_count : std::max(1u, std::thread::hardware_concurrency());
+
+			const std::size_t vertex_count = positions.size();
+			glm::vec3 min = glm::vec3(std::numeric_limits<float>::max()), max = -min;
+			for (const glm::vec3& p : positions) {
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+			}
+			const glm::vec3 diagonal = max - min;
+			m_extent = std::max(std::max(diagonal.x, diagonal.y), std::max(diagonal.z, 1e-20f));
+
+			m_positions.resize(vertex_count);
+			m_attributes.resize(vertex_count, Attributes{});
+			for (std::size_t v = 0; v < vertex_count; ++v) {
+				m_positions[v] = (positions[v] - min) / m_extent;
+				Attributes& a = m_attributes[v];
+				if (v < normals.size())
+					for (int k = 0; k < 3; ++k)
+						a[k] = normals[v][k] * options.m_normal_weight;
+				if (v < uvs.size())
+					for (int k = 0; k < 2; ++k)
+						a[3 + k] = uvs[v][k] * options.m_uv_weight;
+			}
+
+			m_remap.resize(vertex_count);
+			m_wedges.resize(vertex_count);
+			std::unordered_map<glm::vec3, std::uint32_t> first_vertices;
+			first_vertices.reserve(vertex_count);
+			for (std::uint32_t v = 0; v < vertex_count; ++v) {
+				const std::uint32_t first = first_vertices.emplace(positions[v], v).first->second;
+				m_remap[v] = first;
+				m_wedges[v] = v;
+				if (first != v) {
+					m_wedges[v] = m_wedges[first];
+					m_wedges[first] = v;
+				}
+			}
+
+			build_adjacency();
+			m_kinds.resize(vertex_count, VertexKind::Locked);
+			parallel_for(vertex_count, m_thread_count, [this](std::size_t begin, std::size_t end) { classify(begin, end); });
+			m_quadrics.resize(vertex_count);
+			m_attribute_quadrics.resize(vertex_count);
+			parallel_for(vertex_count, m_thread_count, [this](std::size_t begin, std::size_t end) { compute_quadrics(begin, end); });
+			m_collapse_remap.resize(vertex_count);
+		}
+
+		void Simplifier::build_adjacency()
+		{
+			m_adjacency_offsets.assign(m_positions.size() + 1, 0);
+			for (const std::uint32_t index : m_indices)
+				++m_adjacency_offsets[m_remap[index] + 1];
+			std::partial_sum(m_adjacency_offsets.begin(), m_adjacency_offsets.end(), m_adjacency_offsets.begin());
+
+			m_adjacency.resize(m_indices.size());
+			std::vector<std::uint32_t> cursors(m_adjacency_offsets.begin(), m_adjacency_offsets.end() - 1);
+			for (std::size_t i = 0; i < m_indices.size(); ++i)
+				m_adjacency[cursors[m_remap[m_indices[i]]]++] = std::uint32_t(i / 3);
+		}
+
+		bool Simplifier::has_edge(const std::uint32_t from, const std::uint32_t to, const bool same_position) const
+		{
+			const std::uint32_t position = m_remap[from];
+			for (std::uint32_t a = m_adjacency_offsets[position]; a < m_adjacency_offsets[position + 1]; ++a) {
+				const std::uint32_t* triangle = &m_indices[3 * std::size_t(m_adjacency[a])];
+				for (int k = 0; k < 3; ++k) {
+					const std::uint32_t corner = triangle[k], next = triangle[(k + 1) % 3];
+					if (same_position ? (m_remap[corner] == position && m_remap[next] == m_remap[to]) : (corner == from && next == to))
+						return true;
+				}
+			}
+			return false;
+		}
+
+		void Simplifier::classify(const std::size_t begin, const std::size_t end)
+		{
+			for (std::size_t v = begin; v < end; ++v) {
+				if (m_remap[v] != v)
+					continue;
+
+				// Open edges of each of the first two vertices at this position, and of the position itself.
+				std::uint32_t wedge_count = 0;
+				for (std::uint32_t w = std::uint32_t(v); wedge_count == 0 || w != v; w = m_wedges[w])
+					++wedge_count;
+
+				std::array<glm::uvec2, 2> open_index = {};
+				glm::uvec2 open_position = {};
+				for (std::uint32_t a = m_adjacency_offsets[v]; a < m_adjacency_offsets[v + 1]; ++a) {
+					const std::uint32_t* triangle = &m_indices[3 * std::size_t(m_adjacency[a])];
+					for (int k = 0; k < 3; ++k) {
+						const std::uint32_t corner = triangle[k];
+						if (m_remap[corner] != v)
+							continue;
+						const std::uint32_t next = triangle[(k + 1) % 3], prev = triangle[(k + 2) % 3];
+						const std::size_t wedge = corner == v ? 0 : 1;
+						open_index[wedge].x += !has_edge(next, corner, false);
+						open_index[wedge].y += !has_edge(corner, prev, false);
+						open_position.x += !has_edge(next, corner, true);
+						open_position.y += !has_edge(corner, prev, true);
+					}
+				}
+
+				VertexKind kind = VertexKind::Locked;
+				if (wedge_count == 1 && open_index[0] == open_position) {
+					if (open_position == glm::uvec2(0))
+						kind = VertexKind::Manifold;
+					else if (open_position == glm::uvec2(1))
+						kind = VertexKind::Border;
+				} else if (wedge_count == 2 && open_position == glm::uvec2(0) && open_index[0] == glm::uvec2(1) && open_index[1] == glm::uvec2(1))
+					kind = VertexKind::Seam;
+
+				std::uint32_t w = std::uint32_t(v);
+				do {
+					m_kinds[w] = kind;
+					w = m_wedges[w];
+				} while (w != v);
+			}
+		}
+
+		void Simplifier::compute_quadrics(const std::size_t begin, const std::size_t end)
+		{
+			for (std::size_t v = begin; v < end; ++v) {
+				if (m_remap[v] != v)
+					continue;
+
+				Quadric& quadric = m_quadrics[v];
+				for (std::uint32_t a = m_adjacency_offsets[v]; a < m_adjacency_offsets[v + 1]; ++a) {
+					const std::uint32_t* triangle = &m_indices[3 * std::size_t(m_adjacency[a])];
+					const glm::vec3& p0 = m_positions[triangle[0]];
+					const glm::vec3 e1 = m_positions[triangle[1]] - p0;
+					const glm::vec3 e2 = m_positions[triangle[2]] - p0;
+					const glm::vec3 normal = glm::cross(e1, e2);
+					const float length = glm::length(normal);
+					if (length == 0.0f)
+						continue;
+
+					const glm::vec3 n = normal / length;
+					const float area = 0.5f * length;
+					quadric.add_plane(n, -glm::dot(n, p0), area);
+					quadric.m_w += area;
+
+					for (int k = 0; k < 3; ++k) {
+						const std::uint32_t corner = triangle[k];
+						if (m_remap[corner] != v)
+							continue;
+
+						// Constrains open edges, either on the mesh border or along a seam, to stay in place.
+						const std::uint32_t next = triangle[(k + 1) % 3], prev = triangle[(k + 2) % 3];
+						for (const glm::uvec2 edge : { glm::uvec2(corner, next), glm::uvec2(prev, corner) }) {
+							if (has_edge(edge.y, edge.x, false))
+								continue;
+							const glm::vec3 direction = m_positions[edge.y] - m_positions[edge.x];
+							const float edge_length = glm::length(direction);
+							if (edge_length == 0.0f)
+								continue;
+							const glm::vec3 edge_normal = glm::normalize(glm::cross(direction, n));
+							const float weight = edge_length * edge_length * border_weight;
+							quadric.add_plane(edge_normal, -glm::dot(edge_normal, m_positions[edge.x]), weight);
+							quadric.m_w += weight;
+						}
+
+						// Attribute gradients over the triangle plane, from the barycentric coordinates.
+						const float e11 = glm::dot(e1, e1), e12 = glm::dot(e1, e2), e22 = glm::dot(e2, e2);
+						const float det = e11 * e22 - e12 * e12;
+						if (det == 0.0f)
+							continue;
+
+						AttributeQuadric& attribute_quadric = m_attribute_quadrics[corner];
+						const Attributes& a0 = m_attributes[triangle[0]];
+						const Attributes& a1 = m_attributes[triangle[1]];
+						const Attributes& a2 = m_attributes[triangle[2]];
+						for (std::size_t c = 0; c < attribute_count; ++c) {
+							const float da1 = a1[c] - a0[c], da2 = a2[c] - a0[c];
+							const glm::vec3 g = (da1 * (e22 * e1 - e12 * e2) + da2 * (e11 * e2 - e12 * e1)) / det;
+							const float d = a0[c] - glm::dot(g, p0);
+							attribute_quadric.m_quadric.add_plane(g, d, area);
+							attribute_quadric.m_gradients[c] += area * glm::vec4(g, d);
+						}
+						attribute_quadric.m_quadric.m_w += area;
+					}
+				}
+			}
+		}
+
+		bool Simplifier::find_targets(const std::uint32_t from, const std::uint32_t to, std::array<std::uint32_t, 2>& targets) const
+		{
+			// Each vertex at the source position follows the edge it shares with a vertex at the target position.
+			targets = { invalid, invalid };
+			std::size_t wedge = 0;
+			std::uint32_t w = from;
+			do {
+				for (std::uint32_t a = m_adjacency_offsets[from]; a < m_adjacency_offsets[from + 1]; ++a) {
+					const std::uint32_t* triangle = &m_indices[3 * std::size_t(m_adjacency[a])];
+					if (triangle[0] != w && triangle[1] != w && triangle[2] != w)
+						continue;
+					for (int k = 0; k < 3; ++k) {
+						if (m_remap[triangle[k]] != to)
+							continue;
+						if (targets[wedge] != invalid && targets[wedge] != triangle[k])
+							return false;
+						targets[wedge] = triangle[k];
+					}
+				}
+				if (targets[wedge] == invalid)
+					return false;
+				w = m_wedges[w];
+			} while (w != from && ++wedge < targets.size());
+			return w == from;
+		}
+
+		bool Simplifier::can_collapse(const std::uint32_t from, const std::uint32_t to, const std::array<std::uint32_t, 2>& targets) const
+		{
+			switch (m_kinds[from])
+			{
+			case VertexKind::Manifold:
+				return true;
+			case VertexKind::Border:
+				return !has_edge(from, to, true) || !has_edge(to, from, true);
+			case VertexKind::Seam:
+			{
+				const std::uint32_t sibling = m_wedges[from];
+				return m_kinds[to] != VertexKind::Manifold && targets[0] != targets[1]
+					&& (!has_edge(from, targets[0], false) || !has_edge(targets[0], from, false))
+					&& (!has_edge(sibling, targets[1], false) || !has_edge(targets[1], sibling, false));
+			}
+			default:
+				return false;
+			}
+		}
+
+		Collapse Simplifier::rank(const std::uint32_t from, const std::uint32_t to) const
+		{
+			std::array<std::uint32_t, 2> targets;
+			if (m_kinds[from] == VertexKind::Locked || !find_targets(from, to, targets) || !can_collapse(from, to, targets))
+				return {};
+
+			const glm::vec3& p = m_positions[to];
+			Collapse collapse = { from, to };
+			collapse.m_position_error = normalized(m_quadrics[from].evaluate(p), m_quadrics[from].m_w);
+			collapse.m_error = collapse.m_position_error;
+			std::uint32_t w = from;
+			for (std::size_t wedge = 0; wedge < targets.size() && targets[wedge] != invalid; ++wedge, w = m_wedges[w]) {
+				const AttributeQuadric& quadric = m_attribute_quadrics[w];
+				collapse.m_error += normalized(quadric.evaluate(p, m_attributes[targets[wedge]]), quadric.m_quadric.m_w);
+			}
+			return collapse;
+		}
+
+		bool Simplifier::has_flips(const std::uint32_t from, const std::uint32_t to) const
+		{
+			const glm::vec3& target = m_positions[to];
+			for (std::uint32_t a = m_adjacency_offsets[from]; a < m_adjacency_offsets[from + 1]; ++a) {
+				const std::uint32_t* triangle = &m_indices[3 * std::size_t(m_adjacency[a])];
+				std::array<std::uint32_t, 3> corners;
+				for (int k = 0; k < 3; ++k)
+					corners[k] = m_remap[m_collapse_remap[triangle[k]]];
+
+				// Triangles along the collapsed edge disappear.
+				if (corners[0] == to || corners[1] == to || corners[2] == to)
+					continue;
+
+				std::array<glm::vec3, 3> before, after;
+				for (int k = 0; k < 3; ++k) {
+					before[k] = m_positions[corners[k]];
+					after[k] = corners[k] == from ? target : before[k];
+				}
+				const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+				const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+				if (glm::dot(n0, n1) <= 0.0f)
+					return true;
+			}
+			return false;
+		}
+
+		void Simplifier::simplify(const std::size_t target_index_count, const float max_error)
+		{
+			const float max_squared_error = max_error * max_error;
+			std::vector<Collapse> collapses;
+			std::vector<std::uint8_t> locked(m_positions.size());
+
+			while (m_indices.size() > target_index_count) {
+				std::iota(m_collapse_remap.begin(), m_collapse_remap.end(), 0u);
+
+				// Edges are ranked once per pass in both directions, open edges being seen from their only triangle.
+				const std::size_t triangle_count = m_indices.size() / 3;
+				collapses.assign(3 * triangle_count, {});
+				parallel_for(triangle_count, m_thread_count, [&](std::size_t begin, std::size_t end) {
+					for (std::size_t t = begin; t < end; ++t) {
+						for (int k = 0; k < 3; ++k) {
+							const std::uint32_t a = m_indices[3 * t + k], b = m_indices[3 * t + (k + 1) % 3];
+							const std::uint32_t ra = m_remap[a], rb = m_remap[b];
+							if (ra == rb || (ra > rb && has_edge(b, a, true)))
+								continue;
+							// The most expensive test only runs on the cheaper direction, and on the other one if it fails.
+							std::array<Collapse, 2> directions = { rank(ra, rb), rank(rb, ra) };
+							if (directions[1].m_from != invalid && (directions[0].m_from == invalid || directions[1].m_error < directions[0].m_error))
+								std::swap(directions[0], directions[1]);
+							for (const Collapse& collapse : directions) {
+								if (collapse.m_from != invalid && !has_flips(collapse.m_from, collapse.m_to)) {
+									collapses[3 * t + k] = collapse;
+									break;
+								}
+							}
+						}
+					}
+				});
+				collapses.erase(std::remove_if(collapses.begin(), collapses.end(), [](const Collapse& c) { return c.m_from == invalid; }), collapses.end());
+				if (collapses.empty())
+					break;
+
+				// Most collapses remove two triangles. Only the cheapest ones needed to reach the target are sorted,
+				// with some slack since collapses next to an earlier one in the pass are skipped.
+				const auto by_error = [](const Collapse& a, const Collapse& b) { return a.m_error < b.m_error; };
+				const std::size_t goal = std::min(collapses.size(), std::max<std::size_t>(1, (m_indices.size() - target_index_count) / 6));
+				std::nth_element(collapses.begin(), collapses.begin() + (goal - 1), collapses.end(), by_error);
+				const float error_limit = collapses[goal - 1].m_error * 1.5f;
+				const auto last = std::partition(collapses.begin(), collapses.end(), [&](const Collapse& c) { return c.m_error <= error_limit; });
+				std::sort(collapses.begin(), last, by_error);
+
+				std::fill(locked.begin(), locked.end(), std::uint8_t(0));
+				std::size_t removed_index_count = 0;
+				bool collapsed = false;
+				for (auto it = collapses.begin(); it != last && m_indices.size() - removed_index_count > target_index_count; ++it) {
+					const Collapse& collapse = *it;
+					if (locked[collapse.m_from] || locked[collapse.m_to] || collapse.m_position_error > max_squared_error)
+						continue;
+
+					// Neighbors may have moved since the collapse was ranked.
+					std::array<std::uint32_t, 2> targets;
+					if (!find_targets(collapse.m_from, collapse.m_to, targets) || has_flips(collapse.m_from, collapse.m_to))
+						continue;
+
+					std::uint32_t w = collapse.m_from;
+					for (std::size_t wedge = 0; wedge < targets.size() && targets[wedge] != invalid; ++wedge, w = m_wedges[w]) {
+						m_collapse_remap[w] = targets[wedge];
+						m_attribute_quadrics[targets[wedge]] += m_attribute_quadrics[w];
+					}
+					m_quadrics[collapse.m_to] += m_quadrics[collapse.m_from];
+					m_error = std::max(m_error, collapse.m_position_error);
+
+					locked[collapse.m_from] = locked[collapse.m_to] = 1;
+					removed_index_count += m_kinds[collapse.m_from] == VertexKind::Border ? 3 : 6;
+					collapsed = true;
+				}
+				if (!collapsed)
+					break;
+
+				std::size_t index_count = 0;
+				for (std::size_t i = 0; i < m_indices.size(); i += 3) {
+					const std::uint32_t a = m_collapse_remap[m_indices[i]];
+					const std::uint32_t b = m_collapse_remap[m_indices[i + 1]];
+					const std::uint32_t c = m_collapse_remap[m_indices[i + 2]];
+					if (m_remap[a] == m_remap[b] || m_remap[b] == m_remap[c] || m_remap[c] == m_remap[a])
+						continue;
+					m_indices[index_count++] = a;
+					m_indices[index_count++] = b;
+					m_indices[index_count++] = c;
+				}
+				m_indices.resize(index_count);
+				build_adjacency();
+			}
+		}
+	}
+
+	std::vector<LodLevel> make_lod_chain(
+		const std::vector<std::uint32_t>& indices,
+		const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& normals,
+		const std::vector<glm::vec2>& uvs,
+		const SimplifyOptions& options)
+	{
+		PICOGL_TRACE_SCOPE("make_lod_chain");
+		std::vector<LodLevel> levels;
+		if (indices.empty() || options.m_ratios.empty())
+			return levels;
+
+		Simplifier simplifier(indices, positions, normals, uvs, options);
+		const std::size_t triangle_count = indices.size() / 3;
+		for (const float ratio : options.m_ratios) {
+			const std::size_t previous_count = levels.empty() ? indices.size() : levels.back().m_indices.size();
+			simplifier.simplify(3 * std::size_t(std::ceil(ratio * triangle_count)), options.m_max_error);
+			if (simplifier.indices().empty() || simplifier.indices().size() >= previous_count)
+				break;
+			levels.push_back({ simplifier.indices(), simplifier.error() });
+		}
+		return levels;
+	}
+
+	Meshlets make_meshlets(
+		const std::vector<std::uint32_t>& indices,
+		const std::vector<glm::vec3>& positions,
+		const std::uint32_t max_triangle_count)
+	{
+		PICOGL_TRACE_SCOPE("make_meshlets");
+		const std::size_t triangle_count = indices.size() / 3;
+		std::vector<glm::vec3> centroids(triangle_count), normals(triangle_count);
+		std::vector<std::uint32_t> adjacency_offsets(positions.size() + 1, 0), adjacency(indices.size());
+		for (std::size_t t = 0; t < triangle_count; ++t) {
+			const glm::vec3& p0 = positions[indices[3 * t]];
+			const glm::vec3& p1 = positions[indices[3 * t + 1]];
+			const glm::vec3& p2 = positions[indices[3 * t + 2]];
+			centroids[t] = (p0 + p1 + p2) / 3.0f;
+			normals[t] = glm::cross(p1 - p0, p2 - p0);
+		}
+		for (const std::uint32_t index : indices)
+			++adjacency_offsets[index + 1];
+		std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+		std::vector<std::uint32_t> cursors(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for (std::size_t i = 0; i < indices.size(); ++i)
+			adjacency[cursors[indices[i]]++] = std::uint32_t(i / 3);
+
+		Meshlets meshlets;
+		meshlets.m_indices.reserve(indices.size());
+		std::vector<std::uint32_t> triangle_meshlets(triangle_count, invalid); // Meshlet of each triangle once assigned.
+		std::vector<std::uint32_t> candidate_meshlets(triangle_count, invalid); // Last meshlet each triangle was a candidate for.
+		std::vector<std::uint32_t> vertex_meshlets(positions.size(), invalid);
+		std::vector<std::uint32_t> triangles, candidates;
+
+		// Each meshlet starts next to the previous one when possible, otherwise at the first triangle left.
+		std::size_t first_left = 0;
+		std::uint32_t seed = invalid;
+		while (true) {
+			if (seed == invalid) {
+				while (first_left < triangle_count && triangle_meshlets[first_left] != invalid)
+					++first_left;
+				if (first_left == triangle_count)
+					break;
+				seed = std::uint32_t(first_left);
+			}
+
+			const std::uint32_t meshlet_id = std::uint32_t(meshlets.m_meshlets.size());
+			triangles.clear();
+			candidates = { seed };
+			candidate_meshlets[seed] = meshlet_id;
+			glm::vec3 centroid_sum = glm::vec3(0);
+
+			while (triangles.size() < max_triangle_count && !candidates.empty()) {
+				// Fewest new vertices first, then closest to the current center.
+				const glm::vec3 center = triangles.empty() ? centroids[seed] : centroid_sum / float(triangles.size());
+				std::size_t best = 0;
+				std::uint32_t best_new_vertex_count = 4;
+				float best_distance = 0.0f;
+				for (std::size_t c = 0; c < candidates.size(); ++c) {
+					const std::uint32_t t = candidates[c];
+					std::uint32_t new_vertex_count = 0;
+					for (int k = 0; k < 3; ++k)
+						new_vertex_count += vertex_meshlets[indices[3 * t + k]] != meshlet_id;
+					const glm::vec3 offset = centroids[t] - center;
+					const float distance = glm::dot(offset, offset);
+					if (new_vertex_count < best_new_vertex_count || (new_vertex_count == best_new_vertex_count && distance < best_distance)) {
+						best = c;
+						best_new_vertex_count = new_vertex_count;
+						best_distance = distance;
+					}
+				}
+
+				const std::uint32_t triangle = candidates[best];
+				candidates[best] = candidates.back();
+				candidates.pop_back();
+				triangle_meshlets[triangle] = meshlet_id;
+				triangles.push_back(triangle);
+				centroid_sum += centroids[triangle];
+
+				for (int k = 0; k < 3; ++k) {
+					const std::uint32_t vertex = indices[3 * triangle + k];
+					vertex_meshlets[vertex] = meshlet_id;
+					for (std::uint32_t a = adjacency_offsets[vertex]; a < adjacency_offsets[vertex + 1]; ++a) {
+						const std::uint32_t neighbor = adjacency[a];
+						if (triangle_meshlets[neighbor] == invalid && candidate_meshlets[neighbor] != meshlet_id) {
+							candidate_meshlets[neighbor] = meshlet_id;
+							candidates.push_back(neighbor);
+						}
+					}
+				}
+			}
+
+			Meshlet meshlet;
+			meshlet.m_first_index = std::uint32_t(meshlets.m_indices.size());
+			meshlet.m_index_count = std::uint32_t(3 * triangles.size());
+
+			glm::vec3 min = glm::vec3(std::numeric_limits<float>::max()), max = -min;
+			glm::vec3 normal_sum = glm::vec3(0);
+			for (const std::uint32_t t : triangles) {
+				for (int k = 0; k < 3; ++k) {
+					const std::uint32_t vertex = indices[3 * t + k];
+					meshlets.m_indices.push_back(vertex);
+					min = glm::min(min, positions[vertex]);
+					max = glm::max(max, positions[vertex]);
+				}
+				const float length = glm::length(normals[t]);
+				if (length > 0.0f)
+					normal_sum += normals[t] / length;
+			}
+
+			meshlet.m_center = 0.5f * (min + max);
+			meshlet.m_radius = 0.0f;
+			for (const std::uint32_t t : triangles)
+				for (int k = 0; k < 3; ++k)
+					meshlet.m_radius = std::max(meshlet.m_radius, glm::length(positions[indices[3 * t + k]] - meshlet.m_center));
+
+			// Cone of all the triangle normals around their average, culling needs it narrower than a half sphere.
+			float min_dot = -1.0f;
+			const float normal_sum_length = glm::length(normal_sum);
+			if (normal_sum_length > 0.0f) {
+				meshlet.m_cone_axis = normal_sum / normal_sum_length;
+				min_dot = 1.0f;
+				for (const std::uint32_t t : triangles) {
+					const float length = glm::length(normals[t]);
+					if (length > 0.0f)
+						min_dot = std::min(min_dot, glm::dot(normals[t] / length, meshlet.m_cone_axis));
+				}
+			} else
+				meshlet.m_cone_axis = glm::vec3(0, 0, 1);
+			meshlet.m_cone_cutoff = min_dot > 0.0f ? std::sqrt(1.0f - min_dot * min_dot) : 1.0f;
+
+			meshlets.m_meshlets.push_back(meshlet);
+
+			// Leftover candidate with the fewest free neighbors, so that meshlets do not leave isolated triangles behind.
+			seed = invalid;
+			std::uint32_t seed_neighbor_count = ~0u;
+			for (const std::uint32_t t : candidates) {
+				std::uint32_t neighbor_count = 0;
+				for (int k = 0; k < 3; ++k) {
+					const std::uint32_t vertex = indices[3 * t + k];
+					for (std::uint32_t a = adjacency_offsets[vertex]; a < adjacency_offsets[vertex + 1]; ++a)
+						neighbor_count += triangle_meshlets[adjacency[a]] == invalid;
+				}
+				if (neighbor_count < seed_neighbor_count) {
+					seed = t;
+					seed_neighbor_count = neighbor_count;
+				}
+			}
+		}
+		return meshlets;
+	}
+
+	VertexCacheStats analyze_vertex_cache(const std::vector<std::uint32_t>& indices, const std::size_t vertex_count, const std::uint32_t cache_size)
+	{
+		// A vertex is in the cache while fewer than cache_size misses happened since it was last loaded.
+		std::vector<std::uint32_t> timestamps(vertex_count, 0);
+		std::vector<std::uint8_t> referenced(vertex_count, 0);
+		std::uint32_t time = cache_size + 1;
+		std::size_t miss_count = 0, referenced_count = 0;
+		for (const std::uint32_t index : indices) {
+			if (time - timestamps[index] > cache_size) {
+				timestamps[index] = time++;
+				++miss_count;
+			}
+			referenced_count += !referenced[index];
+			referenced[index] = 1;
+		}
+
+		VertexCacheStats stats;
+		if (!indices.empty()) {
+			stats.m_acmr = float(miss_count) / float(indices.size() / 3);
+			stats.m_atvr = float(miss_count) / float(referenced_count);
+		}
+		return stats;
+	}
+
+	std::vector<std::uint32_t> optimize_vertex_cache(const std::vector<std::uint32_t>& indices, const std::size_t vertex_count, const std::uint32_t cache_size)
+	{
+		const std::size_t triangle_count = indices.size() / 3;
+		std::vector<std::uint32_t> adjacency_offsets(vertex_count + 1, 0), adjacency(indices.size());
+		for (const std::uint32_t index : indices)
+			++adjacency_offsets[index + 1];
+		std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+		std::vector<std::uint32_t> cursors(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for (std::size_t i = 0; i < indices.size(); ++i)
+			adjacency[cursors[indices[i]]++] = std::uint32_t(i / 3);
+
+		std::vector<std::uint32_t> live_counts(vertex_count);
+		for (std::size_t v = 0; v < vertex_count; ++v)
+			live_counts[v] = adjacency_offsets[v + 1] - adjacency_offsets[v];
+
+		std::vector<std::uint32_t> timestamps(vertex_count, 0);
+		std::vector<std::uint8_t> emitted(triangle_count, 0);
+		std::vector<std::uint32_t> dead_ends, candidates;
+		std::vector<std::uint32_t> output;
+		output.reserve(indices.size());
+
+		std::uint32_t time = cache_size + 1;
+		std::size_t cursor = 0;
+		std::uint32_t fanning = indices.empty() ? invalid : 0;
+		while (fanning != invalid) {
+			candidates.clear();
+			for (std::uint32_t a = adjacency_offsets[fanning]; a < adjacency_offsets[fanning + 1]; ++a) {
+				const std::uint32_t t = adjacency[a];
+				if (emitted[t])
+					continue;
+				for (int k = 0; k < 3; ++k) {
+					const std::uint32_t v = indices[3 * std::size_t(t) + k];
+					output.push_back(v);
+					dead_ends.push_back(v);
+					candidates.push_back(v);
+					--live_counts[v];
+					if (time - timestamps[v] > cache_size)
+						timestamps[v] = time++;
+				}
+				emitted[t] = 1;
+			}
+
+			// Candidate with triangles left that stays the longest in the cache once they are emitted.
+			fanning = invalid;
+			std::uint32_t best_priority = 0;
+			for (const std::uint32_t v : candidates) {
+				if (!live_counts[v])
+					continue;
+				std::uint32_t priority = 0;
+				if (time - timestamps[v] + 2 * live_counts[v] <= cache_size)
+					priority = time - timestamps[v];
+				if (fanning == invalid || priority > best_priority) {
+					fanning = v;
+					best_priority = priority;
+				}
+			}
+
+			// Dead end, back to a recent vertex with triangles left, or to the next one in input order.
+			while (fanning == invalid && !dead_ends.empty()) {
+				const std::uint32_t v = dead_ends.back();
+				dead_ends.pop_back();
+				if (live_counts[v])
+					fanning = v;
+			}
+			while (fanning == invalid && cursor < vertex_count) {
+				if (live_counts[cursor])
+					fanning = std::uint32_t(cursor);
+				++cursor;
+			}
+		}
+		return output;
+	}
+
+	std::vector<std::uint32_t> optimize_overdraw(const std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		const std::uint32_t cache_size, const float threshold)
+	{
+		const std::size_t triangle_count = indices.size() / 3;
+		if (!triangle_count)
+			return indices;
+
+		// Misses of each triangle, with the cache emptied at the given triangle.
+		std::vector<std::uint32_t> timestamps(positions.size(), 0);
+		std::uint32_t time = cache_size + 1;
+		const auto count_misses = [&](const std::size_t t) {
+			std::uint32_t miss_count = 0;
+			for (int k = 0; k < 3; ++k) {
+				const std::uint32_t v = indices[3 * t + k];
+				if (time - timestamps[v] > cache_size) {
+					timestamps[v] = time++;
+					++miss_count;
+				}
+			}
+			return miss_count;
+		};
+		const auto flush = [&]() { time += cache_size + 1; };
+
+		// Hard boundaries where the cache optimizer restarted, with all three vertices missing.
+		std::vector<std::size_t> hard_boundaries;
+		for (std::size_t t = 0; t < triangle_count; ++t)
+			if (count_misses(t) == 3)
+				hard_boundaries.push_back(t);
+		hard_boundaries.push_back(triangle_count);
+
+		// Soft boundaries as soon as the cache efficiency since the last one is good enough.
+		std::vector<std::size_t> boundaries;
+		for (std::size_t h = 0; h + 1 < hard_boundaries.size(); ++h) {
+			const std::size_t begin = hard_boundaries[h], end = hard_boundaries[h + 1];
+			flush();
+			std::size_t cluster_miss_count = 0;
+			for (std::size_t t = begin; t < end; ++t)
+				cluster_miss_count += count_misses(t);
+			const float limit = threshold * float(cluster_miss_count) / float(end - begin);
+
+			flush();
+			boundaries.push_back(begin);
+			std::size_t miss_count = 0, start = begin;
+			for (std::size_t t = begin; t < end; ++t) {
+				miss_count += count_misses(t);
+				if (t + 1 < end && float(miss_count) / float(t + 1 - start) <= limit) {
+					boundaries.push_back(t + 1);
+					miss_count = 0;
+					start = t + 1;
+					flush();
+				}
+			}
+		}
+		boundaries.push_back(triangle_count);
+
+		glm::vec3 mesh_centroid = glm::vec3(0);
+		float mesh_area = 0.0f;
+		std::vector<glm::vec3> centroids(boundaries.size() - 1), normals(boundaries.size() - 1);
+		for (std::size_t c = 0; c + 1 < boundaries.size(); ++c) {
+			glm::vec3 centroid = glm::vec3(0), normal = glm::vec3(0);
+			float area = 0.0f;
+			for (std::size_t t = boundaries[c]; t < boundaries[c + 1]; ++t) {
+				const glm::vec3& p0 = positions[indices[3 * t]];
+				const glm::vec3& p1 = positions[indices[3 * t + 1]];
+				const glm::vec3& p2 = positions[indices[3 * t + 2]];
+				const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				const float triangle_area = glm::length(n);
+				centroid += triangle_area / 3.0f * (p0 + p1 + p2);
+				normal += n;
+				area += triangle_area;
+			}
+			mesh_centroid += centroid;
+			mesh_area += area;
+			centroids[c] = area > 0.0f ? centroid / area : centroid;
+			const float normal_length = glm::length(normal);
+			normals[c] = normal_length > 0.0f ? normal / normal_length : normal;
+		}
+		if (mesh_area > 0.0f)
+			mesh_centroid = mesh_centroid / mesh_area;
+
+		std::vector<float> keys(centroids.size());
+		for (std::size_t c = 0; c < centroids.size(); ++c)
+			keys[c] = glm::dot(centroids[c] - mesh_centroid, normals[c]);
+		std::vector<std::size_t> order(centroids.size());
+		std::iota(order.begin(), order.end(), std::size_t(0));
+		std::stable_sort(order.begin(), order.end(), [&keys](const std::size_t a, const std::size_t b) { return keys[a] > keys[b]; });
+
+		std::vector<std::uint32_t> output;
+		output.reserve(indices.size());
+		for (const std::size_t c : order)
+			output.insert(output.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+		return output;
+	}
+
+	std::vector<std::uint32_t> make_vertex_fetch_remap(const std::vector<std::uint32_t>& indices, const std::size_t vertex_count)
+	{
+		std::vector<std::uint32_t> remap(vertex_count, invalid);
+		std::uint32_t next = 0;
+		for (const std::uint32_t index : indices)
+			if (remap[index] == invalid)
+				remap[index] = next++;
+		for (std::uint32_t& index : remap)
+			if (index == invalid)
+				index = next++;
+		return remap;
+	}
+
+	void remap_indices(std::vector<std::uint32_t>& indices, const std::vector<std::uint32_t>& remap)
+	{
+		for (std::uint32_t& index : indices)
+			index = remap[index];
+	}
+}
@@ -0,0 +1,147 @@
+#include <picogl/framework/program_cache.h>
+#include <picogl/framework/trace.h>
+
+#include <glad/glad.h>
+
+#define PICOGL_IMPLEMENTATION
+#include <picogl/picogl.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace framework
+{
+	namespace
+	{
+		std::uint64_t hash_bytes(const void* data, const std::size_t size, std::uint64_t hash = 14695981039346656037ull)
+		{
+			// FNV-1a
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (std::size_t i = 0; i < size; ++i) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+	}
+
+	ProgramCache ProgramCache::make(const std::filesystem::path& folder)
+	{
+		ProgramCache cache;
+		cache.m_folder = folder;
+
+		GLint format_count = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+		std::vector<GLint> formats(static_cast<std::size_t>(format_count));
+		if (format_count > 0)
+			glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+
+		std::uint64_t hash = hash_bytes(formats.data(), formats.size() * sizeof(GLint));
+		for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+			const char* str = reinterpret_cast<const char*>(glGetString(name));
+			if (str)
+				hash = hash_bytes(str, std::strlen(str), hash);
+		}
+		cache.m_driver_hash = hash;
+
+		std::error_code error;
+		std::filesystem::create_directories(folder, error);
+		cache.m_enabled = format_count > 0 && !error;
+		if (!cache.m_enabled)
+			spdlog::warn("Program cache disabled, programs are built from source");
+
+		return cache;
+	}
+
+	picogl::Program ProgramCache::make_program(const Sources& sources)
+	{
+		picogl::Program program = make_program_async(sources);
+		finish({ program });
+		return program;
+	}
+
+	picogl::Program ProgramCache::make_program_async(const Sources& sources)
+	{
+		PICOGL_TRACE_SCOPE("make_program_async");
+		std::uint64_t hash = m_driver_hash;
+		for (const auto& source : sources) {
+			hash = hash_bytes(&source.first, sizeof(GLenum), hash);
+			hash = hash_bytes(source.second.data(), source.second.size(), hash);
+		}
+		const std::filesystem::path filepath = m_folder / fmt::format("{:016x}.bin", hash);
+
+		if (m_enabled)
+		{
+			std::ifstream stream(filepath, std::ios::in | std::ios::binary);
+			GLenum format = 0;
+			if (stream && stream.read(reinterpret_cast<char*>(&format), sizeof(format))) {
+				const std::vector<char> binary{ std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+				picogl::Program program = picogl::Program::make_from_binary(format, binary.data(), static_cast<GLsizei>(binary.size()));
+				if (program.linked()) {
+					++m_hit_count;
+					return program;
+				}
+				spdlog::warn("Stale program binary {}, rebuilding from source", filepath.string());
+			}
+		}
+		++m_miss_count;
+
+		// Compile errors show up in the program link log.
+		std::vector<picogl::Shader> shaders;
+		shaders.reserve(sources.size());
+		for (const auto& source : sources)
+			shaders.push_back(picogl::Shader::make_async(source.first, source.second));
+
+		picogl::Program program = picogl::Program::make_async({ shaders.begin(), shaders.end() }, m_enabled);
+		m_pending_stores.emplace_back(program, filepath);
+
+		return program;
+	}
+
+	void ProgramCache::finish(const std::vector<std::reference_wrapper<picogl::Program>>& programs)
+	{
+		PICOGL_TRACE_SCOPE("finish_programs");
+		for (picogl::Program& program : programs)
+		{
+			program.finish();
+
+			const auto pending = std::find_if(m_pending_stores.begin(), m_pending_stores.end(), [&](const auto& store) {
+				return store.first == program;
+				});
+			if (pending == m_pending_stores.end())
+				continue;
+
+			const std::filesystem::path filepath = pending->second;
+			m_pending_stores.erase(pending);
+
+			if (!program.linked()) {
+				spdlog::error("Program link failed: {}", program.get_log());
+				continue;
+			}
+			if (!m_enabled)
+				continue;
+
+			GLenum format = 0;
+			const std::vector<char> binary = program.get_binary(format);
+			std::ofstream stream(filepath, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (stream && !binary.empty()) {
+				stream.write(reinterpret_cast<const char*>(&format), sizeof(format));
+				stream.write(binary.data(), binary.size());
+			}
+		}
+	}
+
+	std::size_t ProgramCache::hit_count() const
+	{
+		return m_hit_count;
+	}
+
+	std::size_t ProgramCache::miss_count() const
+	{
+		return m_miss_count;
+	}
+}
@@ -5,7 +5,9 @@
 #include <picogl/picogl.hpp>
 
 #include <spdlog/spdlog.h>
-#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <thread>
 
 namespace framework
 {
@@ -13,10 +15,10 @@ namespace framework
 	{
 		m_program.use();
 		const glm::mat3 model_transform = glm::transpose(glm::inverse(glm::mat3(model)));
-		m_program.set_uniform("view_proj", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(camera.m_view_proj));
-		m_program.set_uniform("model", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(model));
-		m_program.set_uniform("normal_transform", glUniformMatrix3fv, 1, GL_FALSE, glm::value_ptr(model_transform));
-		m_program.set_uniform("uniform_color", glUniform4fv, 1, glm::value_ptr(color));
+		m_program.set("view_proj", camera.m_view_proj);
+		m_program.set("model", model);
+		m_program.set("normal_transform", model_transform);
+		m_program.set("uniform_color", color);
 		mesh.draw();
 	}
 
@@ -24,40 +26,62 @@ namespace framework
 	{
 		m_program.use();
 		const glm::mat3 model_transform = glm::transpose(glm::inverse(glm::mat3(model)));
-		m_program.set_uniform("view_proj", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(camera.m_view_proj));
-		m_program.set_uniform("model", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(model));
-		m_program.set_uniform("normal_transform", glUniformMatrix3fv, 1, GL_FALSE, glm::value_ptr(model_transform));
-		m_program.set_uniform("light_pos", glUniform3fv, 1, glm::value_ptr(light_position));
-		m_program.set_uniform("camera_pos", glUniform3fv, 1, glm::value_ptr(camera.m_position));
+		m_program.set("view_proj", camera.m_view_proj);
+		m_program.set("model", model);
+		m_program.set("normal_transform", model_transform);
+		m_program.set("light_pos", light_position);
+		m_program.set("camera_pos", camera.m_position);
 		mesh.draw();
 	}
 
-	void TextureRenderer::render(const picogl::Texture& tex, const glm::mat3& uv_transform, float lod)
+	void TextureRenderer::render(const picogl::Texture& tex, const glm::mat3& uv_transform, float lod, const picogl::Sampler* sampler)
 	{
 		m_program.use();
-		m_program.set_uniform("screen_to_uv", glUniformMatrix3fv, 1, GL_FALSE, glm::value_ptr(uv_transform));
-		m_program.set_uniform("lod", glUniform1f, lod);
-		tex.bind_as_sampler(GL_TEXTURE0);
+		m_program.set("screen_to_uv", uv_transform);
+		m_program.set("lod", lod);
+		tex.bind_as_sampler(GL_TEXTURE0, sampler);
 		m_dummy.draw(GL_TRIANGLES, 3);
 	}
 
-	void MultiRenderer::render(const Camera& camera, const picogl::Mesh& m, const picogl::Buffer& instance_ssbo, const picogl::Buffer& instance_offset_ssbo)
+	void MultiRenderer::render(const Camera& camera, const picogl::Mesh& m, const picogl::StreamBuffer::Range& instances, const picogl::Buffer& instance_offset_ssbo)
+	{
+		setup(camera, instances, instance_offset_ssbo);
+		m.draw();
+	}
+
+	void MultiRenderer::render(const Camera& camera, const picogl::MeshPool& pool, const picogl::StreamBuffer::Range& instances, const picogl::Buffer& instance_offset_ssbo)
+	{
+		setup(camera, instances, instance_offset_ssbo);
+		pool.draw();
+	}
+
+	void MultiRenderer::setup(const Camera& camera, const picogl::StreamBuffer::Range& instances, const picogl::Buffer& instance_offset_ssbo)
 	{
 		m_program.use();
-		instance_ssbo.bind_as_ssbo(0);
+		instances.bind(GL_SHADER_STORAGE_BUFFER, 0);
 		instance_offset_ssbo.bind_as_ssbo(1);
-		m_program.set_uniform("view_proj", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(camera.m_view_proj));
-		m_program.set_uniform("light_pos", glUniform3fv, 1, glm::value_ptr(camera.m_position));
-		m_program.set_uniform("camera_pos", glUniform3fv, 1, glm::value_ptr(camera.m_position));
-		m.draw();
+		m_program.set("view_proj", camera.m_view_proj);
+		m_program.set("light_pos", camera.m_position);
+		m_program.set("camera_pos", camera.m_position);
+	}
+
+	void CulledMultiRenderer::render(const Camera& camera, const picogl::MeshPool& pool, const InstanceCuller& culler, const picogl::StreamBuffer::Range& instances)
+	{
+		m_program.use();
+		instances.bind(GL_SHADER_STORAGE_BUFFER, 0);
+		culler.bind_visible_instances(1);
+		m_program.set("view_proj", camera.m_view_proj);
+		m_program.set("light_pos", camera.m_position);
+		m_program.set("camera_pos", camera.m_position);
+		culler.draw(pool);
 	}
 
 	void GridRenderer::render(const Camera& camera)
 	{
 		const glm::mat4 identity = glm::mat4(1);
 		m_program.use();
-		m_program.set_uniform("view_proj", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(camera.m_view_proj));
-		m_program.set_uniform("model", glUniformMatrix4fv, 1, GL_FALSE, glm::value_ptr(identity));
+		m_program.set("view_proj", camera.m_view_proj);
+		m_program.set("model", identity);
 		m_plane.draw();
 	}
 
@@ -65,31 +89,39 @@ namespace framework
 	{
 		m_program.use();
 		cubemap.bind_as_sampler(GL_TEXTURE0);
-		m_program.set_uniform("camera_ray_derivatives", glUniformMatrix3fv, 1, GL_FALSE, glm::value_ptr(camera.m_ray_derivatives));
+		m_program.set("camera_ray_derivatives", camera.m_ray_derivatives);
 		m_dummy.draw(GL_TRIANGLES, 3);
 	}
 
-	RendererCollection RendererCollection::make(const std::filesystem::path& shader_folder)
+	RendererCollection RendererCollection::make(const std::filesystem::path& shader_folder, ProgramCache& cache)
 	{
 		RendererCollection collection;
 
-		auto mesh_interface_vert = picogl::Shader::make(GL_VERTEX_SHADER, make_string_from_file(shader_folder / "mesh_interface.vert"));
-		auto screen_quad_vert = picogl::Shader::make(GL_VERTEX_SHADER, make_string_from_file(shader_folder / "screen_quad.vert"));
-		auto multi_interface = picogl::Shader::make(GL_VERTEX_SHADER, make_string_from_file(shader_folder / "mesh_multi_draw.vert"));
+		// Shaders are only compiled by the cache on a miss, all of them at once.
+		const auto source = [&](const GLenum type, const char* filename) {
+			return std::make_pair(type, make_string_from_file(shader_folder / filename));
+		};
+
+		const auto mesh_interface_vert = source(GL_VERTEX_SHADER, "mesh_interface.vert");
+		const auto screen_quad_vert = source(GL_VERTEX_SHADER, "screen_quad.vert");
+		const auto multi_interface = source(GL_VERTEX_SHADER, "mesh_multi_draw.vert");
+		const auto culled_multi_interface = source(GL_VERTEX_SHADER, "mesh_multi_draw_culled.vert");
 
-		auto single_color_frag = picogl::Shader::make(GL_FRAGMENT_SHADER, make_string_from_file(shader_folder / "single_color.frag"));
-		auto phong_frag = picogl::Shader::make(GL_FRAGMENT_SHADER, make_string_from_file(shader_folder / "phong.frag"));
-		auto texture_frag = picogl::Shader::make(GL_FRAGMENT_SHADER, make_string_from_file(shader_folder / "texture.frag"));
-		auto uber_frag = picogl::Shader::make(GL_FRAGMENT_SHADER, make_string_from_file(shader_folder / "uber_shading_multi.frag"));
-		auto grid_frag = picogl::Shader::make(GL_FRAGMENT_SHADER, make_string_from_file(shader_folder / "grid.frag"));
-		auto cubemap_frag = picogl::Shader::make(GL_FRAGMENT_SHADER, make_string_from_file(shader_folder / "cube_map.frag"));
+		const auto single_color_frag = source(GL_FRAGMENT_SHADER, "single_color.frag");
+		const auto phong_frag = source(GL_FRAGMENT_SHADER, "phong.frag");
+		const auto texture_frag = source(GL_FRAGMENT_SHADER, "texture.frag");
+		const auto uber_frag = source(GL_FRAGMENT_SHADER, "uber_shading_multi.frag");
+		const auto grid_frag = source(GL_FRAGMENT_SHADER, "grid.frag");
+		const auto cubemap_frag = source(GL_FRAGMENT_SHADER, "cube_map.frag");
 
-		collection.m_single_color.m_program = picogl::Program::make({ mesh_interface_vert, single_color_frag });
-		collection.m_phong.m_program = picogl::Program::make({ mesh_interface_vert, phong_frag });
-		collection.m_texture.m_program = picogl::Program::make({ screen_quad_vert, texture_frag });
+		collection.m_single_color.m_program = cache.make_program_async({ mesh_interface_vert, single_color_frag });
+		collection.m_phong.m_program = cache.make_program_async({ mesh_interface_vert, phong_frag });
+		collection.m_texture.m_program = cache.make_program_async({ screen_quad_vert, texture_frag });
 
-		collection.m_multi_renderer.m_program = picogl::Program::make({ multi_interface, uber_frag });
-		collection.m_grid_renderer.m_program = picogl::Program::make({ mesh_interface_vert, grid_frag });
+		collection.m_multi_renderer.m_program = cache.make_program_async({ multi_interface, uber_frag });
+		collection.m_culled_multi_renderer.m_program = cache.make_program_async({ culled_multi_interface, uber_frag });
+		collection.m_grid_renderer.m_program = cache.make_program_async({ mesh_interface_vert, grid_frag });
+		collection.m_cubemap_renderer.m_program = cache.make_program_async({ screen_quad_vert, cubemap_frag });
 
 		collection.m_texture.m_dummy = picogl::Mesh::make();
 		const float infty = 1e2f;
@@ -104,9 +136,22 @@ namespace framework
 			});
 		collection.m_grid_renderer.m_plane = std::move(plane);
 
-		collection.m_cubemap_renderer.m_program = picogl::Program::make({ screen_quad_vert , cubemap_frag });
 		collection.m_cubemap_renderer.m_dummy = picogl::Mesh::make();
 
+		// The meshes above were built while the driver compiled, wait for whatever is left.
+		std::vector<std::reference_wrapper<picogl::Program>> programs = {
+			collection.m_single_color.m_program,
+			collection.m_phong.m_program,
+			collection.m_texture.m_program,
+			collection.m_multi_renderer.m_program,
+			collection.m_culled_multi_renderer.m_program,
+			collection.m_grid_renderer.m_program,
+			collection.m_cubemap_renderer.m_program,
+		};
+		while (!std::all_of(programs.begin(), programs.end(), [](const picogl::Program& program) { return program.ready(); }))
+			std::this_thread::yield();
+		cache.finish(programs);
+
 		return collection;
 	}
 }
\ No newline at end of file
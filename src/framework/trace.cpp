@@ -0,0 +1,288 @@
+#include <picogl/framework/trace.h>
+
+#include <glad/glad.h>
+
+#define PICOGL_IMPLEMENTATION
+#include <picogl/picogl.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace framework
+{
+	namespace
+	{
+		std::atomic<Tracer*>& current_tracer()
+		{
+			static std::atomic<Tracer*> tracer = nullptr;
+			return tracer;
+		}
+
+		void write_escaped(std::ostream& out, const char* str)
+		{
+			for (; *str; ++str) {
+				if (*str == '"' || *str == '\\')
+					out << '\\' << *str;
+				else if (static_cast<unsigned char>(*str) >= 0x20)
+					out << *str;
+			}
+		}
+
+		void write_event(std::ostream& out, const char* name, const std::uint32_t track, const std::int64_t begin_ns, const std::int64_t end_ns)
+		{
+			out << ",\n{\"name\":\"";
+			write_escaped(out, name);
+			out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track
+				<< ",\"ts\":" << double(begin_ns) * 1e-3
+				<< ",\"dur\":" << double(std::max<std::int64_t>(end_ns - begin_ns, 0)) * 1e-3 << "}";
+		}
+
+		void write_track_name(std::ostream& out, const std::uint32_t track, const std::string& name)
+		{
+			out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\"";
+			write_escaped(out, name.c_str());
+			out << "\"}}";
+		}
+	}
+
+	Tracer* Tracer::get_current()
+	{
+		return current_tracer().load(std::memory_order_acquire);
+	}
+
+	void Tracer::set_current(Tracer* tracer)
+	{
+		current_tracer().store(tracer, std::memory_order_release);
+	}
+
+	Tracer Tracer::make(const std::size_t thread_capacity, const std::size_t gpu_capacity)
+	{
+		Tracer tracer;
+		tracer.m_shared = std::make_shared<Shared>();
+		tracer.m_shared->m_start = std::chrono::steady_clock::now();
+		tracer.m_shared->m_thread_capacity = std::max<std::size_t>(thread_capacity, 1);
+		tracer.m_gpu_events.resize(std::max<std::size_t>(gpu_capacity, 1));
+		return tracer;
+	}
+
+	void Tracer::begin_scope(const char* name)
+	{
+		get_thread_buffer().m_open_scopes.emplace_back(name, now_ns());
+	}
+
+	void Tracer::end_scope()
+	{
+		ThreadBuffer& buffer = get_thread_buffer();
+		if (buffer.m_open_scopes.empty())
+			return;
+		const auto [name, begin_ns] = buffer.m_open_scopes.back();
+		buffer.m_open_scopes.pop_back();
+		write(buffer, name, begin_ns, now_ns());
+	}
+
+	void Tracer::set_thread_name(const std::string& name)
+	{
+		ThreadBuffer& buffer = get_thread_buffer();
+		std::lock_guard<std::mutex> lock(m_shared->m_mutex);
+		buffer.m_name = name;
+	}
+
+	void Tracer::begin_frame()
+	{
+		// Both clocks are read back to back, the GPU one without waiting for previous commands to complete.
+		GLint64 gpu_ns = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+		m_frame_begin_ns = now_ns();
+		m_gpu_to_cpu_ns = m_frame_begin_ns - gpu_ns;
+		begin_scope("frame");
+	}
+
+	void Tracer::end_frame(const picogl::GpuProfiler* profiler)
+	{
+		end_scope();
+		const std::int64_t frame_end_ns = now_ns();
+
+		// The collected frame is a few frames old, the clock offset drifts too little to matter meanwhile.
+		if (profiler) {
+			for (const picogl::GpuProfiler::Event& event : profiler->get_collected_events()) {
+				const char* name = m_gpu_names.insert(profiler->get_scopes()[event.m_scope].m_name).first->c_str();
+				m_gpu_events[m_gpu_write_count % m_gpu_events.size()] = {
+					name, std::int64_t(event.m_begin_ns) + m_gpu_to_cpu_ns, std::int64_t(event.m_end_ns) + m_gpu_to_cpu_ns };
+				++m_gpu_write_count;
+			}
+		}
+
+		const float frame_ms = float(frame_end_ns - m_frame_begin_ns) * 1e-6f;
+		constexpr std::int64_t spike_dump_interval_ns = 1000000000;
+		if (m_spike_frame_ms > 0.0f && frame_ms > m_spike_frame_ms && (m_spike_dump_ns < 0 || frame_end_ns - m_spike_dump_ns > spike_dump_interval_ns)) {
+			m_spike_dump_ns = frame_end_ns;
+			if (dump(m_spike_dump_path))
+				spdlog::warn("Frame {} took {:.2f} ms, trace written to {}", m_frame_index, frame_ms, m_spike_dump_path.string());
+		}
+		if (!m_dump_path.empty()) {
+			if (dump(m_dump_path))
+				spdlog::info("Trace written to {}", m_dump_path.string());
+			m_dump_path.clear();
+		}
+		++m_frame_index;
+	}
+
+	void Tracer::request_dump(const std::filesystem::path& path)
+	{
+		m_dump_path = path;
+	}
+
+	void Tracer::dump_on_frame_time(const float frame_ms, const std::filesystem::path& path)
+	{
+		m_spike_frame_ms = frame_ms;
+		m_spike_dump_path = path;
+	}
+
+	bool Tracer::dump(const std::filesystem::path& path) const
+	{
+		std::ofstream out(path);
+		if (!out) {
+			spdlog::error("Cannot write trace to {}", path.string());
+			return false;
+		}
+		out << std::fixed << std::setprecision(3);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"picogl\"}}";
+
+		write_track_name(out, 0, "GPU");
+		const std::size_t gpu_count = std::min(m_gpu_write_count, m_gpu_events.size());
+		for (std::size_t i = m_gpu_write_count - gpu_count; i < m_gpu_write_count; ++i) {
+			const GpuEvent& event = m_gpu_events[i % m_gpu_events.size()];
+			write_event(out, event.m_name, 0, event.m_begin_ns, event.m_end_ns);
+		}
+
+		std::vector<std::pair<std::shared_ptr<ThreadBuffer>, std::string>> threads;
+		{
+			std::lock_guard<std::mutex> lock(m_shared->m_mutex);
+			for (const std::shared_ptr<ThreadBuffer>& thread : m_shared->m_threads)
+				threads.emplace_back(thread, thread->m_name);
+		}
+
+		struct Copy
+		{
+			const char* m_name;
+			std::int64_t m_begin_ns;
+			std::int64_t m_end_ns;
+		};
+		std::vector<Copy> copies;
+		for (const auto& [thread, name] : threads) {
+			const std::uint64_t capacity = thread->m_capacity;
+			const std::uint64_t write_count = thread->m_write_count.load(std::memory_order_acquire);
+			const std::uint64_t first = write_count > capacity ? write_count - capacity : 0;
+			copies.clear();
+			for (std::uint64_t i = first; i < write_count; ++i) {
+				const Event& event = thread->m_events[i % capacity];
+				copies.push_back({
+					event.m_name.load(std::memory_order_relaxed),
+					event.m_begin_ns.load(std::memory_order_relaxed),
+					event.m_end_ns.load(std::memory_order_relaxed) });
+			}
+
+			// The writer may have wrapped around meanwhile, the slots it reused, or is reusing, are skipped.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const std::uint64_t last_write_count = thread->m_write_count.load(std::memory_order_relaxed);
+			const std::uint64_t first_valid = last_write_count >= capacity ? last_write_count - capacity + 1 : 0;
+
+			write_track_name(out, thread->m_track, name);
+			for (std::uint64_t i = std::max(first, first_valid); i < write_count; ++i) {
+				const Copy& copy = copies[i - first];
+				if (copy.m_name)
+					write_event(out, copy.m_name, thread->m_track, copy.m_begin_ns, copy.m_end_ns);
+			}
+		}
+
+		out << "\n]}\n";
+		return bool(out);
+	}
+
+	std::uint64_t Tracer::frame_index() const
+	{
+		return m_frame_index;
+	}
+
+	Tracer::ThreadBuffer& Tracer::get_thread_buffer()
+	{
+		struct ThreadSlot
+		{
+			std::weak_ptr<Shared> m_owner;
+			std::shared_ptr<ThreadBuffer> m_buffer;
+
+			~ThreadSlot()
+			{
+				if (m_buffer)
+					m_buffer->m_in_use.store(false, std::memory_order_release);
+			}
+		};
+		thread_local ThreadSlot slot;
+
+		// Owner comparison does not touch the reference counts.
+		if (slot.m_buffer && !slot.m_owner.owner_before(m_shared) && !m_shared.owner_before(slot.m_owner))
+			return *slot.m_buffer;
+
+		if (slot.m_buffer)
+			slot.m_buffer->m_in_use.store(false, std::memory_order_release);
+
+		// Buffers of exited threads are reused, short lived workers do not pile up.
+		std::lock_guard<std::mutex> lock(m_shared->m_mutex);
+		std::shared_ptr<ThreadBuffer> buffer;
+		for (const std::shared_ptr<ThreadBuffer>& thread : m_shared->m_threads) {
+			if (!thread->m_in_use.load(std::memory_order_acquire)) {
+				buffer = thread;
+				break;
+			}
+		}
+		if (!buffer) {
+			buffer = std::make_shared<ThreadBuffer>();
+			buffer->m_capacity = m_shared->m_thread_capacity;
+			buffer->m_events = std::make_unique<Event[]>(buffer->m_capacity);
+			buffer->m_track = std::uint32_t(m_shared->m_threads.size() + 1);
+			buffer->m_name = "thread " + std::to_string(buffer->m_track);
+			m_shared->m_threads.push_back(buffer);
+		}
+		buffer->m_in_use.store(true, std::memory_order_relaxed);
+		buffer->m_open_scopes.clear();
+
+		slot.m_owner = m_shared;
+		slot.m_buffer = buffer;
+		return *buffer;
+	}
+
+	std::int64_t Tracer::now_ns() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_shared->m_start).count();
+	}
+
+	void Tracer::write(ThreadBuffer& buffer, const char* name, const std::int64_t begin_ns, const std::int64_t end_ns)
+	{
+		// The fence orders the previous write count before the slot stores, so that a reader seeing
+		// any of them also sees that the slot is being reused.
+		const std::uint64_t index = buffer.m_write_count.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		Event& event = buffer.m_events[index % buffer.m_capacity];
+		event.m_name.store(name, std::memory_order_relaxed);
+		event.m_begin_ns.store(begin_ns, std::memory_order_relaxed);
+		event.m_end_ns.store(end_ns, std::memory_order_relaxed);
+		buffer.m_write_count.store(index + 1, std::memory_order_release);
+	}
+
+	TraceScope::TraceScope(const char* name)
+	{
+		m_tracer = Tracer::get_current();
+		if (m_tracer)
+			m_tracer->begin_scope(name);
+	}
+
+	TraceScope::~TraceScope()
+	{
+		if (m_tracer)
+			m_tracer->end_scope();
+	}
+}
@@ -50,7 +50,7 @@ namespace framework
 
 		auto setup_framebuffer = [](picogl::Framebuffer& framebuffer, const std::vector<GLenum>& additional_attachments)
 		{
-			framebuffer.set_depth_attachment(GL_DEPTH_COMPONENT32);
+			framebuffer.set_depth_attachment(GL_DEPTH_COMPONENT32, true);
 			framebuffer.add_color_attachment(GL_RGBA8);
 			for (const GLenum format : additional_attachments)
 				framebuffer.add_color_attachment(format);
@@ -78,6 +78,13 @@ namespace framework
 		return m_framebuffer.sample_count() > 1 ? m_resolve_framebuffer : m_framebuffer;
 	}
 
+	const picogl::Texture& Viewport::resolve_depth()
+	{
+		if (m_framebuffer.sample_count() > 1)
+			m_framebuffer.blit_depth_to(m_resolve_framebuffer);
+		return final_framebuffer().depth_texture();
+	}
+
 	Viewport2D::Viewport2D(const::std::string& name, const::std::vector<GLenum>& additional_attachments)
 		: Viewport(name, additional_attachments)
 	{